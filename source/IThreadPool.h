@@ -1,20 +1,79 @@
 #pragma once
 
+#include <chrono>
+#include <cstddef>
 #include <functional>
 #include <memory>
 #include "mbind.h"
 
+#define TASK_CALLSITE_STRING(value) #value
+#define TASK_CALLSITE_LINE(line) TASK_CALLSITE_STRING(line)
+/// TaskHints::tag naming the source line it is used on, e.g. TaskHints{TaskHints::noAffinity, TASK_CALLSITE}.
+#define TASK_CALLSITE __FILE__ ":" TASK_CALLSITE_LINE(__LINE__)
+
+/// Hints for the placement of a task, a pool ignores the hints it does not support.
+struct TaskHints
+{
+    static constexpr std::size_t noAffinity{static_cast<std::size_t>(-1)};
+    static constexpr std::chrono::steady_clock::time_point noDeadline{std::chrono::steady_clock::time_point::max()};
+
+    /// Key of the data the task works on (e.g. a shard id), tasks with the same key prefer the same worker.
+    std::size_t affinity{noAffinity};
+    /// Name of the task for diagnostics (e.g. the Watchdog reports or the profile of SimpleThreadPool), the string needs
+    /// to outlive the task. Tasks of one call site share the name, see TASK_CALLSITE.
+    const char* tag{nullptr};
+    /// Time the task should be finished by, a pool supporting deadlines executes the earliest deadline first.
+    /// \note The deadline is a priority, not a guarantee: SimpleThreadPool orders the tasks per worker and lets a task
+    /// without a deadline go after SimpleThreadPool::UrgentQuota tasks with one.
+    std::chrono::steady_clock::time_point deadline{noDeadline};
+};
+
 class IThreadPool
 {
 public:
+    using MethodType = std::unique_ptr<mbind>;
+
     virtual ~IThreadPool() = default;
 
     template <typename Function, typename... Args>
     void schedule(Function&& f, Args&&... args);
 
+    /// Schedules the task with placement @p hints, e.g. with an affinity key to keep the data of a shard in one cache.
+    template <typename Function, typename... Args>
+    void schedule_with(const TaskHints& hints, Function&& f, Args&&... args);
+
+    /// Schedules the task only if it can be done without blocking and without executing the task on the calling thread.
+    /// \returns false if the task was not scheduled, the task is then dropped.
+    template <typename Function, typename... Args>
+    bool try_schedule(Function&& f, Args&&... args);
+
+    /// Schedules methods created by Bind::bind at once, a pool can enqueue the whole batch under one lock.
+    /// \note If an exception is thrown the methods taken by the pool are null, the refused and the not tried ones are left untouched.
+    void schedule_batch(MethodType* methods, std::size_t count, const TaskHints& hints = TaskHints());
+
+    /// Enqueues the tasks held back by the calling thread (e.g. coalesced by SimpleThreadPool), so the thread does not
+    /// wait for a task it holds itself. Called by the waits of the library (e.g. ContinuationTask::wait()) before they
+    /// block, other blocking calls need to call it first.
+    static void before_blocking() noexcept;
+
 protected:
-    using MethodType = std::unique_ptr<mbind>;
+    using BlockingHook = void (*)() noexcept;
+
+    /// Sets the function called by IThreadPool::before_blocking() on the calling thread, e.g. once the thread holds tasks back.
+    static void setBlockingHook(BlockingHook hook) noexcept;
+    /// \note On failure the @p method must be left untouched.
     virtual void scheduleInner(MethodType&& method) = 0;
+    /// \note On failure the @p method must be left untouched.
+    /// \note The default implementation ignores the @p hints.
+    virtual void scheduleHintedInner(MethodType&& method, const TaskHints& hints);
+    /// \note On failure the @p method must be left untouched.
+    /// \note The default implementation never fails.
+    virtual bool tryScheduleInner(MethodType& method);
+    /// \note The default implementation calls IThreadPool::scheduleHintedInner for each method.
+    virtual void scheduleBatchInner(MethodType* methods, std::size_t count, const TaskHints& hints);
+
+private:
+    static BlockingHook& blockingHook() noexcept;
 };
 
 template <typename Function, typename... Args>
@@ -23,3 +82,62 @@ void IThreadPool::schedule(Function&& f, Args&&... args)
     MethodType method = Bind::bind(std::forward<Function>(f), std::forward<Args>(args)...);
     scheduleInner(std::move(method));
 }
+
+template <typename Function, typename... Args>
+void IThreadPool::schedule_with(const TaskHints& hints, Function&& f, Args&&... args)
+{
+    MethodType method = Bind::bind(std::forward<Function>(f), std::forward<Args>(args)...);
+    scheduleHintedInner(std::move(method), hints);
+}
+
+template <typename Function, typename... Args>
+bool IThreadPool::try_schedule(Function&& f, Args&&... args)
+{
+    MethodType method = Bind::bind(std::forward<Function>(f), std::forward<Args>(args)...);
+    return tryScheduleInner(method);
+}
+
+inline void IThreadPool::scheduleHintedInner(MethodType&& method, const TaskHints&)
+{
+    scheduleInner(std::move(method));
+}
+
+inline bool IThreadPool::tryScheduleInner(MethodType& method)
+{
+    scheduleInner(std::move(method));
+    return true;
+}
+
+inline void IThreadPool::schedule_batch(MethodType* methods, std::size_t count, const TaskHints& hints /* = TaskHints()*/)
+{
+    scheduleBatchInner(methods, count, hints);
+}
+
+inline void IThreadPool::before_blocking() noexcept
+{
+    if (auto hook = blockingHook())
+    {
+        hook();
+    }
+}
+
+inline void IThreadPool::setBlockingHook(BlockingHook hook) noexcept
+{
+    blockingHook() = hook;
+}
+
+inline IThreadPool::BlockingHook& IThreadPool::blockingHook() noexcept
+{
+    thread_local BlockingHook hook{nullptr};
+    return hook;
+}
+
+inline void IThreadPool::scheduleBatchInner(MethodType* methods, std::size_t count, const TaskHints& hints)
+{
+    for (std::size_t idx = 0; idx < count; ++idx)
+    {
+        scheduleHintedInner(std::move(methods[idx]), hints);
+        // A pool executing the method on the caller does not take it
+        methods[idx].reset();
+    }
+}
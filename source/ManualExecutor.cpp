@@ -0,0 +1,105 @@
+#include "ManualExecutor.h"
+
+#include <cassert>
+
+ManualExecutor::ManualExecutor()
+    : _owner(std::this_thread::get_id())
+    , _sleeping{false}
+{
+}
+
+bool ManualExecutor::run_one()
+{
+    assert(isOwner());
+
+    MethodType task;
+    if (!pop(task))
+        return false;
+
+    (*task)();
+    return true;
+}
+
+std::size_t ManualExecutor::run_until_idle()
+{
+    std::size_t executed{0};
+    while (run_one())
+    {
+        ++executed;
+    }
+
+    return executed;
+}
+
+std::size_t ManualExecutor::run_until(Clock::time_point deadline)
+{
+    std::size_t executed{0};
+    while (Clock::now() < deadline)
+    {
+        if (run_one())
+        {
+            ++executed;
+        }
+        else
+        {
+            waitForTask(deadline);
+        }
+    }
+
+    return executed;
+}
+
+void ManualExecutor::scheduleInner(MethodType&& method)
+{
+    if (isOwner())
+    {
+        // Fast path, the owner can't be sleeping while it is scheduling
+        _local.push_back(std::move(method));
+        return;
+    }
+
+    _inbox.push(std::move(method));
+
+    // Pairs with the fence in waitForTask, either the owner sees the pushed task or this thread sees it sleeping
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (_sleeping.load(std::memory_order_relaxed))
+    {
+        std::lock_guard<std::mutex> lk(_wakeMtx);
+        _wake.notify_one();
+    }
+}
+
+bool ManualExecutor::isOwner() const
+{
+    return std::this_thread::get_id() == _owner;
+}
+
+bool ManualExecutor::pop(MethodType& task)
+{
+    if (_local.empty())
+    {
+        // Move everything available, so the inbox is not touched for every task
+        MethodType received;
+        while (_inbox.pop(received))
+        {
+            _local.push_back(std::move(received));
+        }
+
+        if (_local.empty())
+            return false;
+    }
+
+    task = std::move(_local.front());
+    _local.pop_front();
+    return true;
+}
+
+void ManualExecutor::waitForTask(Clock::time_point deadline)
+{
+    std::unique_lock<std::mutex> lk(_wakeMtx);
+
+    _sleeping.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    _wake.wait_until(lk, deadline, [&]() { return !_inbox.wasEmpty(); });
+    _sleeping.store(false, std::memory_order_relaxed);
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include "IThreadPool.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <mutex>
+#include <thread>
+#include "mpsc_queue.h"
+#include "ring_queue.h"
+
+/// Thread pool without threads, the tasks are executed by the owner thread when it calls one of the run methods.
+/// Intended for components having their own event loop, continuations scheduled on this executor get back on
+/// the loop thread without a thread hop.
+/// \note The owner is the thread creating the instance, the run methods can be called only from the owner thread.
+/// \note Tasks scheduled from other threads go through a lock-free inbox, tasks scheduled from the owner thread
+/// (e.g. continuations of the executed tasks) are queued without any synchronization.
+/// \note Exceptions of the tasks are propagated to the caller of the run method, not executed tasks stay queued.
+class ManualExecutor final : public IThreadPool
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    ManualExecutor();
+    /// @note Not executed tasks are destroyed.
+    ~ManualExecutor() = default;
+
+    ManualExecutor(const ManualExecutor&) = delete;
+    ManualExecutor& operator=(const ManualExecutor&) = delete;
+
+    /// Executes one task if there is any.
+    /// @returns true if a task was executed
+    bool run_one();
+    /// Executes tasks till there is none, including the tasks scheduled by the executed tasks.
+    /// @returns Count of executed tasks.
+    std::size_t run_until_idle();
+    /// Executes tasks till the @p duration elapses, when idle waits for new tasks.
+    /// @returns Count of executed tasks.
+    template <typename Rep, typename Period>
+    std::size_t run_for(const std::chrono::duration<Rep, Period>& duration);
+    /// Executes tasks till the @p deadline, when idle waits for new tasks.
+    /// @returns Count of executed tasks.
+    std::size_t run_until(Clock::time_point deadline);
+
+private:
+    void scheduleInner(MethodType&& method) override;
+    bool isOwner() const;
+    bool pop(MethodType& task);
+    void waitForTask(Clock::time_point deadline);
+
+    const std::thread::id _owner;
+    // Accessed only by the owner thread
+    RingQueue<MethodType> _local;
+    MpscQueue<MethodType> _inbox;
+
+    std::atomic_bool _sleeping;
+    std::mutex _wakeMtx;
+    std::condition_variable _wake;
+};
+
+template <typename Rep, typename Period>
+std::size_t ManualExecutor::run_for(const std::chrono::duration<Rep, Period>& duration)
+{
+    return run_until(Clock::now() + std::chrono::duration_cast<Clock::duration>(duration));
+}
@@ -0,0 +1,431 @@
+#include "Reactor.h"
+
+#ifdef __linux__
+
+#include <cassert>
+#include <cerrno>
+#include <cstdint>
+#include <system_error>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "canceled_exception.h"
+
+namespace
+{
+    constexpr int maxEvents{64};
+
+    std::system_error lastError(const char* operation)
+    {
+        return std::system_error(errno, std::generic_category(), operation);
+    }
+
+    bool wouldBlock()
+    {
+        return errno == EAGAIN || errno == EWOULDBLOCK || errno == EINTR;
+    }
+
+    void setNonBlocking(int fd)
+    {
+        const auto flags = ::fcntl(fd, F_GETFL);
+        if (flags < 0 || ::fcntl(fd, F_SETFL, flags | O_NONBLOCK) < 0)
+            throw lastError("fcntl");
+    }
+
+    bool isRegularFile(int fd)
+    {
+        struct stat info;
+        if (::fstat(fd, &info) < 0)
+            throw lastError("fstat");
+
+        return S_ISREG(info.st_mode);
+    }
+
+    std::exception_ptr canceled()
+    {
+        return std::make_exception_ptr(CanceledException());
+    }
+}
+
+Reactor::Reactor(IThreadPool& completionPool)
+    : _completionPool(completionPool)
+    , _epoll(::epoll_create1(EPOLL_CLOEXEC))
+    , _wakeup(::eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC))
+{
+    if (_epoll < 0 || _wakeup < 0)
+    {
+        const auto error = lastError("epoll_create1/eventfd");
+        if (_epoll >= 0)
+            ::close(_epoll);
+        if (_wakeup >= 0)
+            ::close(_wakeup);
+        throw error;
+    }
+
+    epoll_event event{};
+    event.events = EPOLLIN;
+    event.data.fd = _wakeup;
+    if (::epoll_ctl(_epoll, EPOLL_CTL_ADD, _wakeup, &event) < 0)
+    {
+        const auto error = lastError("epoll_ctl");
+        ::close(_epoll);
+        ::close(_wakeup);
+        throw error;
+    }
+
+    _thread = std::thread(&Reactor::reactorMethod, this);
+}
+
+Reactor::~Reactor()
+{
+    const std::uint64_t stop{1};
+    while (::write(_wakeup, &stop, sizeof(stop)) < 0 && errno == EINTR)
+    {
+    }
+    _thread.join();
+
+    std::vector<Completion> completed;
+    for (auto& item : _descriptors)
+    {
+        for (auto* queue : {&item.second.readers, &item.second.writers})
+        {
+            for (auto& operation : *queue)
+            {
+                completed.emplace_back(std::move(operation), canceled());
+            }
+        }
+    }
+    _descriptors.clear();
+    complete(completed);
+
+    ::close(_epoll);
+    ::close(_wakeup);
+}
+
+ContinuationTask Reactor::async_wait(int fd, Interest interest)
+{
+    const short events = interest == Interest::Read ? POLLIN : POLLOUT;
+
+    return submit(fd, interest, [fd, events]() {
+        pollfd poll{fd, events, 0};
+        const auto result = ::poll(&poll, 1, 0);
+        if (result < 0 && !wouldBlock())
+            throw lastError("poll");
+
+        return result > 0;
+    });
+}
+
+ContinuationTask Reactor::async_read(int fd, void* buffer, std::size_t size, std::size_t& transferred)
+{
+    return submit(fd, Interest::Read, [fd, buffer, size, &transferred]() {
+        const auto result = ::read(fd, buffer, size);
+        if (result < 0)
+        {
+            if (wouldBlock())
+                return false;
+            throw lastError("read");
+        }
+
+        transferred = static_cast<std::size_t>(result);
+        return true;
+    });
+}
+
+ContinuationTask Reactor::async_write(int fd, const void* buffer, std::size_t size, std::size_t& transferred)
+{
+    return submit(fd, Interest::Write, [fd, buffer, size, &transferred]() {
+        // send does not raise SIGPIPE when the peer is closed
+        auto result = ::send(fd, buffer, size, MSG_NOSIGNAL);
+        if (result < 0 && errno == ENOTSOCK)
+        {
+            result = ::write(fd, buffer, size);
+        }
+
+        if (result < 0)
+        {
+            if (wouldBlock())
+                return false;
+            throw lastError("write");
+        }
+
+        transferred = static_cast<std::size_t>(result);
+        return true;
+    });
+}
+
+ContinuationTask Reactor::async_accept(int fd, int& accepted)
+{
+    return submit(fd, Interest::Read, [fd, &accepted]() {
+        const auto result = ::accept4(fd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (result < 0)
+        {
+            // The connection could be aborted before it was accepted
+            if (wouldBlock() || errno == ECONNABORTED)
+                return false;
+            throw lastError("accept");
+        }
+
+        accepted = result;
+        return true;
+    });
+}
+
+void Reactor::release(int fd)
+{
+    std::vector<Completion> completed;
+
+    {
+        std::lock_guard<std::mutex> lk(_descriptorsMtx);
+        auto it = _descriptors.find(fd);
+        if (it == _descriptors.end())
+            return;
+
+        for (auto* queue : {&it->second.readers, &it->second.writers})
+        {
+            for (auto& operation : *queue)
+            {
+                completed.emplace_back(std::move(operation), canceled());
+            }
+        }
+
+        if (it->second.registered)
+        {
+            // The descriptor could be already closed, so the error is ignored
+            (void)::epoll_ctl(_epoll, EPOLL_CTL_DEL, fd, nullptr);
+        }
+        _descriptors.erase(it);
+    }
+
+    complete(completed);
+}
+
+ContinuationTask Reactor::submit(int fd, Interest interest, Attempt&& attempt)
+{
+    auto operation = std::make_unique<Operation>(Operation{std::move(attempt), TaskCompletionSource(_completionPool)});
+    auto task = operation->completion.get_task();
+    std::vector<Completion> completed;
+
+    {
+        std::lock_guard<std::mutex> lk(_descriptorsMtx);
+        auto it = _descriptors.find(fd);
+        if (it == _descriptors.end())
+        {
+            try
+            {
+                Descriptor descriptor;
+                descriptor.regular = isRegularFile(fd);
+                if (!descriptor.regular)
+                {
+                    setNonBlocking(fd);
+                }
+                it = _descriptors.emplace(fd, std::move(descriptor)).first;
+            }
+            catch (...)
+            {
+                completed.emplace_back(std::move(operation), std::current_exception());
+            }
+        }
+
+        if (operation && !it->second.regular)
+        {
+            auto& queue = interest == Interest::Read ? it->second.readers : it->second.writers;
+            if (queue.empty())
+            {
+                // Fast path, the descriptor could be already ready
+                try
+                {
+                    if (operation->attempt())
+                    {
+                        completed.emplace_back(std::move(operation), nullptr);
+                    }
+                }
+                catch (...)
+                {
+                    completed.emplace_back(std::move(operation), std::current_exception());
+                }
+            }
+
+            if (operation)
+            {
+                queue.push_back(std::move(operation));
+                try
+                {
+                    arm(fd, it->second);
+                }
+                catch (...)
+                {
+                    completed.emplace_back(std::move(queue.back()), std::current_exception());
+                    queue.pop_back();
+                }
+            }
+        }
+    }
+
+    // Only operations on regular files are left, the pool is used outside of the lock as it could execute them inline
+    if (operation)
+    {
+        submitSynchronous(std::move(operation));
+    }
+
+    complete(completed);
+    return task;
+}
+
+void Reactor::submitSynchronous(std::unique_ptr<Operation>&& operation)
+{
+    auto method = [](std::unique_ptr<Operation>&& operation) {
+        std::vector<Completion> completed;
+        try
+        {
+            if (!operation->attempt())
+                throw std::system_error(EWOULDBLOCK, std::generic_category(), "regular file");
+            completed.emplace_back(std::move(operation), nullptr);
+        }
+        catch (...)
+        {
+            completed.emplace_back(std::move(operation), std::current_exception());
+        }
+
+        complete(completed);
+    };
+
+    _completionPool.schedule(std::move(method), std::move(operation));
+}
+
+void Reactor::reactorMethod() noexcept
+{
+    epoll_event events[maxEvents];
+
+    while (true)
+    {
+        const auto count = ::epoll_wait(_epoll, events, maxEvents, -1);
+        if (count < 0)
+        {
+            assert(errno == EINTR);
+            continue;
+        }
+
+        for (int idx = 0; idx < count; ++idx)
+        {
+            if (events[idx].data.fd == _wakeup)
+                return;
+
+            try
+            {
+                onReady(events[idx].data.fd, events[idx].events);
+            }
+            catch (...)
+            {
+                // There is nobody to report to, the failures of operations are reported through their tasks
+            }
+        }
+    }
+}
+
+void Reactor::onReady(int fd, unsigned events)
+{
+    std::vector<Completion> completed;
+
+    {
+        std::lock_guard<std::mutex> lk(_descriptorsMtx);
+        auto it = _descriptors.find(fd);
+        if (it == _descriptors.end())
+            return;
+
+        // On error or hang-up the operations are attempted, so they report the reason
+        auto& descriptor = it->second;
+        if (events & (EPOLLIN | EPOLLERR | EPOLLHUP))
+        {
+            drain(descriptor.readers, completed);
+        }
+        if (events & (EPOLLOUT | EPOLLERR | EPOLLHUP))
+        {
+            drain(descriptor.writers, completed);
+        }
+
+        try
+        {
+            arm(fd, descriptor);
+        }
+        catch (...)
+        {
+            for (auto* queue : {&descriptor.readers, &descriptor.writers})
+            {
+                for (auto& operation : *queue)
+                {
+                    completed.emplace_back(std::move(operation), std::current_exception());
+                }
+                queue->clear();
+            }
+        }
+    }
+
+    complete(completed);
+}
+
+void Reactor::drain(OperationQueue& queue, std::vector<Completion>& completed)
+{
+    while (!queue.empty())
+    {
+        try
+        {
+            if (!queue.front()->attempt())
+                break;
+
+            completed.emplace_back(std::move(queue.front()), nullptr);
+        }
+        catch (...)
+        {
+            completed.emplace_back(std::move(queue.front()), std::current_exception());
+        }
+
+        queue.pop_front();
+    }
+}
+
+void Reactor::arm(int fd, Descriptor& descriptor)
+{
+    // One-shot, so an event is delivered only once and the descriptor is re-armed only when there are operations
+    epoll_event event{};
+    event.events = EPOLLONESHOT;
+    event.events |= descriptor.readers.empty() ? 0u : static_cast<std::uint32_t>(EPOLLIN);
+    event.events |= descriptor.writers.empty() ? 0u : static_cast<std::uint32_t>(EPOLLOUT);
+    event.data.fd = fd;
+    if (event.events == EPOLLONESHOT)
+        return;
+
+    auto operation = descriptor.registered ? EPOLL_CTL_MOD : EPOLL_CTL_ADD;
+    if (::epoll_ctl(_epoll, operation, fd, &event) < 0)
+    {
+        // The descriptor could be closed and its number reused, the kernel drops closed descriptors from the epoll
+        operation = errno == ENOENT ? EPOLL_CTL_ADD : errno == EEXIST ? EPOLL_CTL_MOD : -1;
+        if (operation < 0 || ::epoll_ctl(_epoll, operation, fd, &event) < 0)
+            throw lastError("epoll_ctl");
+    }
+
+    descriptor.registered = true;
+}
+
+void Reactor::complete(std::vector<Completion>& completed)
+{
+    for (auto& item : completed)
+    {
+        if (item.second)
+        {
+            item.first->completion.set_exception(std::move(item.second));
+        }
+        else
+        {
+            item.first->completion.set_done();
+        }
+    }
+
+    completed.clear();
+}
+
+#endif
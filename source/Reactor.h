@@ -0,0 +1,98 @@
+#pragma once
+
+#ifdef __linux__
+
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "IThreadPool.h"
+#include "continuation_task.h"
+#include "task_completion_source.h"
+
+/// Completes asynchronous I/O operations as ContinuationTask instances, a thread is blocked only in epoll_wait
+/// no matter how many operations are outstanding.
+/// The tasks are completed on the reactor thread, their continuations are scheduled on the completion pool.
+/// \note The file descriptors are switched to the non-blocking mode on the first operation.
+/// \note Regular files are always ready for epoll, so their operations are executed on the completion pool.
+/// \note Operations of one direction (read/accept or write) on the same descriptor are executed in FIFO order.
+/// \note The buffers and the result references need to stay alive till the operation task is completed.
+/// \note Failed operations store std::system_error in the future of the task.
+class Reactor final
+{
+public:
+    enum class Interest
+    {
+        Read,
+        Write
+    };
+
+    /// Creates the reactor and starts its thread.
+    /// @param completionPool pool used for continuations of the operation tasks
+    /// @note The @p completionPool instance needs to stay alive as long as this instance and all operation tasks are alive.
+    explicit Reactor(IThreadPool& completionPool);
+    /// Stops the reactor thread, the pending operations are completed with CanceledException.
+    ~Reactor();
+
+    Reactor(const Reactor&) = delete;
+    Reactor& operator=(const Reactor&) = delete;
+
+    /// @returns A task completed when the @p fd is ready for the @p interest.
+    ContinuationTask async_wait(int fd, Interest interest);
+    /// Reads at most @p size bytes, the task is completed when at least one byte was read or on the end of the file.
+    ContinuationTask async_read(int fd, void* buffer, std::size_t size, std::size_t& transferred);
+    /// Writes at most @p size bytes, the task is completed when at least one byte was written.
+    ContinuationTask async_write(int fd, const void* buffer, std::size_t size, std::size_t& transferred);
+    /// Accepts a connection on the listening socket @p fd, the accepted socket is non-blocking.
+    ContinuationTask async_accept(int fd, int& accepted);
+
+    /// Completes all pending operations of the @p fd with CanceledException and removes it from the reactor.
+    /// @note Needs to be called before the @p fd is closed if there could be pending operations.
+    void release(int fd);
+
+private:
+    // Tries to execute the operation, returns false if it would block, throws on failure
+    using Attempt = std::function<bool()>;
+
+    struct Operation
+    {
+        Attempt attempt;
+        TaskCompletionSource completion;
+    };
+
+    using OperationQueue = std::deque<std::unique_ptr<Operation>>;
+
+    struct Descriptor
+    {
+        OperationQueue readers;
+        OperationQueue writers;
+        bool registered{false};
+        bool regular{false};
+    };
+
+    // Result of an operation to be set to its task outside of the lock
+    using Completion = std::pair<std::unique_ptr<Operation>, std::exception_ptr>;
+
+    ContinuationTask submit(int fd, Interest interest, Attempt&& attempt);
+    void submitSynchronous(std::unique_ptr<Operation>&& operation);
+    void reactorMethod() noexcept;
+    void onReady(int fd, unsigned events);
+    static void drain(OperationQueue& queue, std::vector<Completion>& completed);
+    void arm(int fd, Descriptor& descriptor);
+    static void complete(std::vector<Completion>& completed);
+
+    IThreadPool& _completionPool;
+    int _epoll;
+    int _wakeup;
+    std::mutex _descriptorsMtx;
+    std::unordered_map<int, Descriptor> _descriptors;
+    std::thread _thread;
+};
+
+#endif
@@ -1,22 +1,120 @@
 #include "SimpleThreadPool.h"
 
+#include <algorithm>
 #include <cassert>
+#include <cstring>
+#include <iterator>
+#include <map>
+#include <utility>
+#include "queue_full_exception.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <time.h>
+#endif
+
+namespace
+{
+    // Pool owning the current thread, used to prevent pool threads from blocking on their own full queue
+    thread_local const SimpleThreadPool* currentPool = nullptr;
+    // Index of the current thread in the currentPool
+    thread_local std::size_t currentWorker = 0;
+
+    // Tag of the entries holding coalesced tasks, the tasks are profiled one by one instead
+    const char* const batchTag = "SimpleThreadPool batch";
+
+    std::chrono::nanoseconds threadCpuTime() noexcept
+    {
+#ifdef _WIN32
+        // In 100 ns units, updated with the scheduler ticks, so short tasks are measured only statistically
+        FILETIME creation, exit, kernel, user;
+        GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user);
+        const auto ticks = (static_cast<unsigned long long>(kernel.dwHighDateTime) << 32) + kernel.dwLowDateTime
+                           + (static_cast<unsigned long long>(user.dwHighDateTime) << 32) + user.dwLowDateTime;
+        return std::chrono::nanoseconds(ticks * 100);
+#else
+        timespec now{};
+        clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+        return std::chrono::seconds(now.tv_sec) + std::chrono::nanoseconds(now.tv_nsec);
+#endif
+    }
+
+    // Orders the tags by their text, the tasks without a tag first
+    struct TagLess
+    {
+        bool operator()(const char* left, const char* right) const noexcept
+        {
+            if (left == nullptr || right == nullptr)
+                return left == nullptr && right != nullptr;
+
+            return std::strcmp(left, right) < 0;
+        }
+    };
+}
+
+SimpleThreadPool::CoalescingScope::CoalescingScope(SimpleThreadPool& pool) noexcept
+    : _pool(pool)
+    , _previous(std::exchange(coalescingBuffer().scope, &pool))
+{
+}
+
+SimpleThreadPool::CoalescingScope::~CoalescingScope()
+{
+    _pool.flush();
+    coalescingBuffer().scope = _previous;
+}
 
 SimpleThreadPool::SimpleThreadPool(std::size_t threadCount)
-    : _threadCount{threadCount}
+    : SimpleThreadPool(threadCount, 0, OverflowPolicy::Block)
+{
+}
+
+SimpleThreadPool::SimpleThreadPool(std::size_t threadCount, std::size_t capacity, OverflowPolicy policy)
+    : _queuedCount{0}
+    , _deadlineCount{0}
+    , _nextDeadlineWorker{0}
+    , _threadCount{threadCount}
+    , _capacity{capacity}
+    , _policy{policy}
     , _run{false}
+    , _taskTracking{false}
+    , _profiling{false}
+    , _expiredPolicy{ExpiredPolicy::Execute}
+    , _expiredCount{0}
+    , _queueFullCount{0}
+    , _exceptionCapacity{0}
+    , _coalesceBatch{0}
+    , _coalesceDelay{}
+    , _coalescedBuffers{0}
+    , _waitingWorkers{0}
+    , _fiberStackSize{0}
 {
+    for (std::size_t workerIndex = 0; workerIndex < _threadCount; ++workerIndex)
+    {
+        _workers.emplace_back(std::make_unique<Worker>());
+        _workers.back()->coalesced.owner = this;
+    }
 }
 
 SimpleThreadPool::~SimpleThreadPool()
 {
     stop();
 
+#ifndef NDEBUG
+    // Destructor is noexcept
+    for (auto& worker : _workers)
     {
-        std::lock_guard<std::mutex> lk(_exceptMtx);
-        // Destructor is noexcept
-        assert(_exceptions.empty());
+        std::lock_guard<std::mutex> lk(worker->failures.mtx);
+        assert(worker->failures.exceptions.empty());
     }
+
+    std::lock_guard<std::mutex> lk(_callerFailures.mtx);
+    assert(_callerFailures.exceptions.empty());
+#endif
 }
 
 void SimpleThreadPool::start()
@@ -27,7 +125,7 @@ void SimpleThreadPool::start()
 
     for (std::size_t threadNr = 0; threadNr < _threadCount; ++threadNr)
     {
-        _threads.emplace_back(std::make_unique<std::thread>(&SimpleThreadPool::threadPoolMethod, this));
+        _threads.emplace_back(std::make_unique<std::thread>(&SimpleThreadPool::threadPoolMethod, this, threadNr));
     }
 }
 
@@ -36,7 +134,11 @@ void SimpleThreadPool::stop()
     {
         std::lock_guard<std::mutex> lk(_threadWaitMtx);
         _run = false;
-        _threadWait.notify_all();
+        for (auto& worker : _workers)
+        {
+            worker->wake.notify_all();
+        }
+        _queueNotFull.notify_all();
     }
 
     for (auto& thread : _threads)
@@ -53,48 +155,970 @@ void SimpleThreadPool::stop()
 SimpleThreadPool::ExceptContainerType SimpleThreadPool::popExceptions()
 {
     ExceptContainerType exceptions;
+    const auto merge = [&](ExceptionBuffer& buffer) {
+        std::lock_guard<std::mutex> lk(buffer.mtx);
+        exceptions.insert(exceptions.end(), std::make_move_iterator(buffer.exceptions.begin()), std::make_move_iterator(buffer.exceptions.end()));
+        buffer.exceptions.clear();
+    };
 
+    for (auto& worker : _workers)
     {
-        std::lock_guard<std::mutex> lk(_exceptMtx);
-        exceptions = std::move(_exceptions);
-        assert(_exceptions.empty());
+        merge(worker->failures);
     }
+    merge(_callerFailures);
 
     return exceptions;
 }
 
+void SimpleThreadPool::setExceptionCapacity(std::size_t capacity)
+{
+    _exceptionCapacity = capacity;
+}
+
+void SimpleThreadPool::setExceptionHandler(ExceptionHandler handler)
+{
+    _exceptionHandler = std::move(handler);
+}
+
+std::size_t SimpleThreadPool::droppedExceptionCount() const noexcept
+{
+    auto dropped = _callerFailures.dropped.load(std::memory_order_relaxed);
+    for (const auto& worker : _workers)
+    {
+        dropped += worker->failures.dropped.load(std::memory_order_relaxed);
+    }
+
+    return dropped;
+}
+
+void SimpleThreadPool::setQueueFullHandler(QueueFullHandler handler)
+{
+    _queueFullHandler = std::move(handler);
+}
+
+std::size_t SimpleThreadPool::queueFullCount() const noexcept
+{
+    return _queueFullCount.load(std::memory_order_relaxed);
+}
+
+void SimpleThreadPool::setTaskTracking(bool enabled) noexcept
+{
+    _taskTracking.store(enabled, std::memory_order_relaxed);
+}
+
+std::vector<SimpleThreadPool::RunningTask> SimpleThreadPool::runningTasks() const
+{
+    std::vector<RunningTask> tasks;
+    for (std::size_t workerIndex = 0; workerIndex < _workers.size(); ++workerIndex)
+    {
+        const auto& worker = *_workers[workerIndex];
+        const auto startedAt = worker.startedAt.load(std::memory_order_acquire);
+        const auto* tag = worker.tag.load(std::memory_order_acquire);
+        // The tag could belong to a task started meanwhile, then the start time differs
+        if (startedAt != 0 && startedAt == worker.startedAt.load(std::memory_order_relaxed))
+        {
+            tasks.push_back({workerIndex, tag, Clock::time_point(Clock::duration(startedAt))});
+        }
+    }
+
+    return tasks;
+}
+
+void SimpleThreadPool::setExpiredPolicy(ExpiredPolicy policy)
+{
+    _expiredPolicy = policy;
+}
+
+std::size_t SimpleThreadPool::expiredCount() const noexcept
+{
+    return _expiredCount.load(std::memory_order_relaxed);
+}
+
+void SimpleThreadPool::setProfiling(bool enabled) noexcept
+{
+    _profiling.store(enabled, std::memory_order_relaxed);
+}
+
+std::vector<SimpleThreadPool::TagProfile> SimpleThreadPool::profile(std::size_t top /* = 0*/) const
+{
+    std::map<const char*, TagProfile, TagLess> merged;
+    for (const auto& worker : _workers)
+    {
+        std::lock_guard<std::mutex> lk(worker->profile.mtx);
+        for (const auto& entry : worker->profile.tags)
+        {
+            const auto& tag = entry.second;
+            auto inserted = merged.emplace(tag.tag, tag);
+            if (inserted.second)
+                continue;
+
+            auto& total = inserted.first->second;
+            total.count += tag.count;
+            total.totalRunTime += tag.totalRunTime;
+            total.maxRunTime = std::max(total.maxRunTime, tag.maxRunTime);
+            total.totalQueueDelay += tag.totalQueueDelay;
+            total.cpuTime += tag.cpuTime;
+        }
+    }
+
+    std::vector<TagProfile> tags;
+    tags.reserve(merged.size());
+    for (const auto& entry : merged)
+    {
+        tags.push_back(entry.second);
+    }
+
+    const auto byCpuTime = [](const TagProfile& left, const TagProfile& right) { return left.cpuTime > right.cpuTime; };
+    if (top != 0 && top < tags.size())
+    {
+        std::partial_sort(tags.begin(), tags.begin() + top, tags.end(), byCpuTime);
+        tags.resize(top);
+    }
+    else
+    {
+        std::sort(tags.begin(), tags.end(), byCpuTime);
+    }
+
+    return tags;
+}
+
+void SimpleThreadPool::resetProfile()
+{
+    for (auto& worker : _workers)
+    {
+        std::lock_guard<std::mutex> lk(worker->profile.mtx);
+        worker->profile.tags.clear();
+    }
+}
+
+void SimpleThreadPool::setCoalescing(std::size_t maxBatch, Clock::duration maxDelay)
+{
+    _coalesceBatch = maxBatch;
+    _coalesceDelay = maxDelay;
+}
+
+void SimpleThreadPool::flush() noexcept
+{
+    auto& buffer = coalescingBuffer();
+    if (buffer.pool == this)
+    {
+        flush(buffer);
+    }
+}
+
+void SimpleThreadPool::setFibers(std::size_t stackSize)
+{
+    _fiberStackSize = stackSize;
+}
+
 void SimpleThreadPool::scheduleInner(MethodType&& method)
 {
-    std::lock_guard<std::mutex> lk(_threadWaitMtx);
-    _taskQueue.push(std::move(method));
-    _threadWait.notify_one();
+    scheduleHintedInner(std::move(method), TaskHints());
+}
+
+void SimpleThreadPool::scheduleHintedInner(MethodType&& method, const TaskHints& hints)
+{
+    if (hints.affinity == TaskHints::noAffinity && hints.deadline == TaskHints::noDeadline && coalesce(method, hints.tag))
+        return;
+
+    submit(std::move(method), hints);
+}
+
+void SimpleThreadPool::submit(MethodType&& method, const TaskHints& hints)
+{
+    const auto enqueuedAt = profileStamp();
+    {
+        std::lock_guard<std::mutex> lk(_threadWaitMtx);
+        if (!isFull())
+        {
+            enqueue(std::move(method), hints, enqueuedAt);
+            return;
+        }
+    }
+
+    onQueueFull();
+
+    switch (_policy)
+    {
+        case OverflowPolicy::Block:
+        {
+            std::unique_lock<std::mutex> lk(_threadWaitMtx);
+            if (currentPool != this)
+            {
+                _queueNotFull.wait(lk, [&] { return !isFull() || !_run; });
+                if (isFull())
+                    throw QueueFullException();
+            }
+
+            enqueue(std::move(method), hints, enqueuedAt);
+            break;
+        }
+        case OverflowPolicy::Reject:
+            throw QueueFullException();
+        case OverflowPolicy::RunOnCaller:
+            execute(method);
+            break;
+    }
 }
 
-void SimpleThreadPool::threadPoolMethod() noexcept
+bool SimpleThreadPool::tryScheduleInner(MethodType& method)
 {
+    const auto enqueuedAt = profileStamp();
+    {
+        std::lock_guard<std::mutex> lk(_threadWaitMtx);
+        if (!isFull())
+        {
+            enqueue(std::move(method), TaskHints(), enqueuedAt);
+            return true;
+        }
+    }
+
+    onQueueFull();
+    return false;
+}
+
+void SimpleThreadPool::scheduleBatchInner(MethodType* methods, std::size_t count, const TaskHints& hints)
+{
+    std::size_t scheduled{0};
+    const auto enqueuedAt = profileStamp();
+
+    {
+        std::lock_guard<std::mutex> lk(_threadWaitMtx);
+        const auto workerIndex = selectWorker(hints);
+        while (scheduled < count && !isFull())
+        {
+            push(std::move(methods[scheduled]), hints, enqueuedAt, workerIndex);
+            ++scheduled;
+        }
+        notify(workerIndex, scheduled);
+    }
+
+    for (; scheduled < count; ++scheduled)
+    {
+        scheduleHintedInner(std::move(methods[scheduled]), hints);
+        methods[scheduled].reset();
+    }
+}
+
+void SimpleThreadPool::threadPoolMethod(std::size_t workerIndex) noexcept
+{
+    currentPool = this;
+    currentWorker = workerIndex;
+    auto& worker = *_workers[workerIndex];
+
     while (true)
     {
         try
         {
-            MethodType task;
+            QueuedTask task{};
+            WorkerFiber* resumed = nullptr;
 
+            // A running worker continues with its own tasks with a deadline without the pool mutex
+            if (worker.running && _run && takeOwnUrgent(workerIndex, task))
+            {
+                if (_capacity != 0)
+                {
+                    // A producer blocked by the capacity checks it under the pool mutex, the notification below must
+                    // not fall between its check and its wait
+                    std::lock_guard<std::mutex> lk(_threadWaitMtx);
+                }
+            }
+            else
             {
                 std::unique_lock<std::mutex> lk(_threadWaitMtx);
-                _threadWait.wait(lk, [&] { return !_taskQueue.empty() || !_run; });
+                worker.running = false;
+                bool stealSingle{false};
+                bool flushOthers{false};
+                // The woken fibers go first, they hold tasks already in progress. The own tasks with a deadline
+                // taken above yield to them after UrgentQuota tasks.
+                while (_run && worker.resumed.empty() && !take(workerIndex, stealSingle, task))
+                {
+                    worker.signaled = false;
+                    if (_coalesceBatch >= 2)
+                    {
+                        // Announced before the buffers are checked, a worker starting a batch meanwhile flushes it right away
+                        _waitingWorkers.fetch_add(1, std::memory_order_seq_cst);
+                        if (_coalescedBuffers.load(std::memory_order_seq_cst) != 0)
+                        {
+                            _waitingWorkers.fetch_sub(1, std::memory_order_relaxed);
+                            flushOthers = true;
+                            break;
+                        }
+                    }
+
+                    // A task waiting for a busy worker is left to it for a while, it is stolen only if the worker does not make it in time
+                    if (hasWaitingTask(workerIndex))
+                    {
+                        stealSingle = worker.wake.wait_for(lk, StealDelay) == std::cv_status::timeout;
+                    }
+                    else
+                    {
+                        worker.wake.wait(lk);
+                        stealSingle = false;
+                    }
+
+                    if (_coalesceBatch >= 2)
+                    {
+                        _waitingWorkers.fetch_sub(1, std::memory_order_relaxed);
+                    }
+                }
                 if (!_run)
                     break;
 
-                task = std::move(_taskQueue.front());
-                _taskQueue.pop();
+                if (flushOthers)
+                {
+                    // The tasks held back by the busy workers are enqueued rather than waited for, the worker takes
+                    // them in the next round
+                    lk.unlock();
+                    flushCoalesced(false);
+                    continue;
+                }
+
+                if (!worker.resumed.empty())
+                {
+                    resumed = worker.resumed.front();
+                    worker.resumed.erase(worker.resumed.begin());
+                }
+                worker.signaled = false;
+                worker.running = true;
+            }
+
+            if (resumed != nullptr)
+            {
+                resume(*resumed);
+            }
+            else
+            {
+                if (_capacity != 0)
+                {
+                    _queueNotFull.notify_one();
+                }
+
+                if (_expiredPolicy == ExpiredPolicy::Drop && isExpired(task))
+                {
+                    _expiredCount.fetch_add(1, std::memory_order_relaxed);
+                    task.method->drop();
+                }
+                else if (_fiberStackSize != 0)
+                {
+                    runOnFiber(workerIndex, task);
+                }
+                else
+                {
+                    run(task);
+                }
+            }
+
+            // The tasks coalesced by the finished task are not left waiting for the next one
+            auto& buffer = coalescingBuffer();
+            if (buffer.since.load(std::memory_order_relaxed) != 0)
+            {
+                flush(buffer);
+            }
+            // The tasks held back by the busy workers wait at most the coalescing delay
+            if (_coalescedBuffers.load(std::memory_order_relaxed) != 0)
+            {
+                flushCoalesced(true);
+            }
+        }
+        catch (...)
+        {
+            storeException(std::current_exception());
+        }
+    }
+
+    currentPool = nullptr;
+}
+
+void SimpleThreadPool::run(QueuedTask& task) noexcept
+{
+    // Tracked and profiled only by the workers, the tasks executed on a caller are not stuck in the pool
+    if (currentPool != this)
+    {
+        execute(task.method);
+        return;
+    }
+
+    auto& worker = *_workers[currentWorker];
+    const bool tracked = _taskTracking.load(std::memory_order_relaxed);
+    const bool profiled = task.enqueuedAt != 0 && task.tag != batchTag;
+    if (!tracked && !profiled)
+    {
+        execute(task.method);
+        return;
+    }
+
+    const auto startedAt = Clock::now();
+    if (tracked)
+    {
+        worker.tag.store(task.tag, std::memory_order_relaxed);
+        worker.startedAt.store(startedAt.time_since_epoch().count(), std::memory_order_release);
+    }
+    const auto cpuStartedAt = profiled ? threadCpuTime() : std::chrono::nanoseconds::zero();
+
+    execute(task.method);
+
+    if (tracked)
+    {
+        worker.startedAt.store(0, std::memory_order_relaxed);
+    }
+
+    if (profiled)
+    {
+        const auto cpuTime = threadCpuTime() - cpuStartedAt;
+        const auto runTime = Clock::now() - startedAt;
+        const auto queueDelay = startedAt - Clock::time_point(Clock::duration(task.enqueuedAt));
+
+        // OPTIM the table could be a seqlock, the lock is contended only while the profile is merged
+        std::lock_guard<std::mutex> lk(worker.profile.mtx);
+        try
+        {
+            auto& entry = worker.profile.tags.try_emplace(task.tag, TagProfile{task.tag, 0, {}, {}, {}, {}}).first->second;
+            ++entry.count;
+            entry.totalRunTime += runTime;
+            entry.maxRunTime = std::max(entry.maxRunTime, runTime);
+            entry.totalQueueDelay += queueDelay;
+            entry.cpuTime += cpuTime;
+        }
+        catch (...)
+        {
+            // The first task of a new tag could not be recorded, the profile is best effort
+        }
+    }
+}
+
+void SimpleThreadPool::runOnFiber(std::size_t workerIndex, QueuedTask& task) noexcept
+{
+    auto& worker = *_workers[workerIndex];
+    WorkerFiber* fiber = nullptr;
+    if (!worker.idleFibers.empty())
+    {
+        fiber = worker.idleFibers.back();
+        worker.idleFibers.pop_back();
+    }
+    else
+    {
+        try
+        {
+            auto created = std::make_unique<WorkerFiber>();
+            created->pool = this;
+            created->workerIndex = workerIndex;
+            created->fiber = std::make_unique<Fiber>(_fiberStackSize, &SimpleThreadPool::wakeFiber, created.get());
+
+            // The lists never grow later, so the waking and the recycling of the fibers cannot fail
+            worker.idleFibers.reserve(worker.fibers.size() + 1);
+            {
+                std::lock_guard<std::mutex> lk(_threadWaitMtx);
+                worker.resumed.reserve(worker.fibers.size() + 1);
+            }
+            worker.fibers.push_back(std::move(created));
+            fiber = worker.fibers.back().get();
+        }
+        catch (...)
+        {
+            // Without a fiber the task blocks the worker while it waits
+            run(task);
+            return;
+        }
+    }
+
+    fiber->task = std::move(task);
+    try
+    {
+        fiber->fiber->start(&SimpleThreadPool::fiberMethod, fiber);
+    }
+    catch (...)
+    {
+        run(fiber->task);
+        fiber->task.method.reset();
+    }
+    switchedOut(*fiber);
+}
+
+void SimpleThreadPool::resume(WorkerFiber& fiber) noexcept
+{
+    // The task is tracked again with its original start
+    auto& worker = *_workers[fiber.workerIndex];
+    worker.tag.store(fiber.tag, std::memory_order_relaxed);
+    worker.startedAt.store(fiber.startedAt, std::memory_order_release);
+    fiber.fiber->resume();
+    switchedOut(fiber);
+}
+
+void SimpleThreadPool::switchedOut(WorkerFiber& fiber) noexcept
+{
+    auto& worker = *_workers[fiber.workerIndex];
+    if (fiber.fiber->finished())
+    {
+        worker.idleFibers.push_back(&fiber);
+        return;
+    }
+
+    // A suspended task does not run on the worker, the next task of the worker would overwrite its tracking
+    fiber.tag = worker.tag.load(std::memory_order_relaxed);
+    fiber.startedAt = worker.startedAt.exchange(0, std::memory_order_relaxed);
+}
+
+void SimpleThreadPool::fiberMethod(void* fiber) noexcept
+{
+    auto& workerFiber = *static_cast<WorkerFiber*>(fiber);
+    workerFiber.pool->run(workerFiber.task);
+    // The captures of the task are not kept till the fiber is reused
+    workerFiber.task.method.reset();
+}
+
+void SimpleThreadPool::wakeFiber(void* fiber) noexcept
+{
+    auto& workerFiber = *static_cast<WorkerFiber*>(fiber);
+    auto& pool = *workerFiber.pool;
+
+    std::lock_guard<std::mutex> lk(pool._threadWaitMtx);
+    auto& worker = *pool._workers[workerFiber.workerIndex];
+    worker.resumed.push_back(&workerFiber);
+    // A running worker looks at its woken fibers before it waits again
+    if (!worker.running && !worker.signaled)
+    {
+        worker.signaled = true;
+        worker.wake.notify_one();
+    }
+}
+
+SimpleThreadPool::Clock::rep SimpleThreadPool::profileStamp() const noexcept
+{
+    return _profiling.load(std::memory_order_relaxed) ? Clock::now().time_since_epoch().count() : 0;
+}
+
+void SimpleThreadPool::execute(MethodType& task) noexcept
+{
+    try
+    {
+        assert(task);
+        (*task)();
+    }
+    catch (...)
+    {
+        storeException(std::current_exception());
+    }
+}
+
+bool SimpleThreadPool::coalesce(MethodType& method, const char* tag)
+{
+    if (_coalesceBatch < 2)
+        return false;
+
+    auto& buffer = coalescingBuffer();
+    if (currentPool != this && buffer.scope != this)
+        return false;
+
+    if (buffer.pool != this)
+    {
+        // One buffer per thread, the tasks of another pool are not held back
+        flush(buffer);
+    }
+
+    const auto now = Clock::now();
+    bool started{false};
+    bool full{false};
+    {
+        std::lock_guard<std::mutex> lk(buffer.mtx);
+        // Reserved in advance, so a failed allocation leaves the method untouched
+        buffer.tasks.reserve(_coalesceBatch);
+        buffer.pool = this;
+        started = buffer.tasks.empty();
+        if (started)
+        {
+            buffer.since.store(now.time_since_epoch().count(), std::memory_order_relaxed);
+        }
+        buffer.tasks.push_back({std::move(method), tag, _profiling.load(std::memory_order_relaxed) ? now.time_since_epoch().count() : 0});
+
+        full = buffer.tasks.size() >= _coalesceBatch
+               || now - Clock::time_point(Clock::duration(buffer.since.load(std::memory_order_relaxed))) >= _coalesceDelay;
+        if (started && buffer.owner != nullptr)
+        {
+            // Counted before the waiting workers are checked, a worker starting to wait meanwhile flushes the buffer.
+            // A waiting worker could execute the task right away, so it is not held back then.
+            buffer.owner->_coalescedBuffers.fetch_add(1, std::memory_order_seq_cst);
+            full = full || buffer.owner->_waitingWorkers.load(std::memory_order_seq_cst) != 0;
+        }
+    }
+
+    if (started)
+    {
+        setBlockingHook(&SimpleThreadPool::flushCurrentThread);
+    }
+    if (full)
+    {
+        flush(buffer);
+    }
+    return true;
+}
+
+void SimpleThreadPool::runBatch(std::vector<QueuedTask> tasks) noexcept
+{
+    for (auto& task : tasks)
+    {
+        run(task);
+    }
+
+    // The emptied buffer is given back to the thread, so a worker coalescing continuations does not allocate it again
+    auto& buffer = coalescingBuffer();
+    std::lock_guard<std::mutex> lk(buffer.mtx);
+    if (buffer.tasks.capacity() == 0)
+    {
+        tasks.clear();
+        buffer.tasks.swap(tasks);
+    }
+}
+
+SimpleThreadPool::CoalescingBuffer& SimpleThreadPool::coalescingBuffer() noexcept
+{
+    // A worker uses the buffer kept by its pool, so the other workers can flush it
+    if (currentPool != nullptr)
+        return currentPool->_workers[currentWorker]->coalesced;
+
+    thread_local CoalescingBuffer buffer;
+    return buffer;
+}
+
+void SimpleThreadPool::flush(CoalescingBuffer& buffer) noexcept
+{
+    std::vector<QueuedTask> tasks;
+    SimpleThreadPool* target = nullptr;
+    {
+        std::lock_guard<std::mutex> lk(buffer.mtx);
+        if (buffer.tasks.empty())
+            return;
+
+        target = buffer.pool;
+        tasks = std::move(buffer.tasks);
+        buffer.tasks.clear();
+        buffer.since.store(0, std::memory_order_relaxed);
+        if (buffer.owner != nullptr)
+        {
+            buffer.owner->_coalescedBuffers.fetch_sub(1, std::memory_order_relaxed);
+        }
+    }
+
+    auto& pool = *target;
+    try
+    {
+        if (tasks.size() == 1)
+        {
+            pool.submit(std::move(tasks.front().method), TaskHints{TaskHints::noAffinity, tasks.front().tag});
+        }
+        else
+        {
+            auto batch = Bind::bind(&SimpleThreadPool::runBatch, &pool, std::move(tasks));
+            try
+            {
+                pool.submit(std::move(batch), TaskHints{TaskHints::noAffinity, batchTag});
+            }
+            catch (...)
+            {
+                // The refused batch keeps the tasks
+                pool.execute(batch);
+            }
+        }
+    }
+    catch (...)
+    {
+        // The tasks were accepted by schedule, so they are not lost when the pool refuses them, the caller executes them
+        for (auto& task : tasks)
+        {
+            if (task.method)
+            {
+                pool.run(task);
+            }
+        }
+    }
+}
+
+void SimpleThreadPool::flushCurrentThread() noexcept
+{
+    flush(coalescingBuffer());
+}
+
+void SimpleThreadPool::flushCoalesced(bool expiredOnly) noexcept
+{
+    const auto now = Clock::now();
+    for (auto& worker : _workers)
+    {
+        const auto since = worker->coalesced.since.load(std::memory_order_relaxed);
+        if (since != 0 && (!expiredOnly || now - Clock::time_point(Clock::duration(since)) >= _coalesceDelay))
+        {
+            flush(worker->coalesced);
+        }
+    }
+}
+
+bool SimpleThreadPool::isFull() const
+{
+    return _capacity != 0 && _queuedCount >= _capacity;
+}
+
+std::size_t SimpleThreadPool::selectWorker(const TaskHints& hints)
+{
+    if (_workers.empty())
+        return noWorker;
+
+    if (hints.affinity != TaskHints::noAffinity)
+        return std::hash<std::size_t>()(hints.affinity) % _workers.size();
+
+    // Tasks scheduled by a worker (e.g. continuations) stay on it
+    if (currentPool == this)
+        return currentWorker;
+
+    if (hints.deadline != TaskHints::noDeadline)
+    {
+        // The priority queues are per worker, the tasks from outside of the pool are spread over them
+        _nextDeadlineWorker = (_nextDeadlineWorker + 1) % _workers.size();
+        return _nextDeadlineWorker;
+    }
+
+    return noWorker;
+}
+
+void SimpleThreadPool::push(MethodType&& method, const TaskHints& hints, Clock::rep enqueuedAt, std::size_t workerIndex)
+{
+    if (workerIndex == noWorker)
+    {
+        _taskQueue.push_back({std::move(method), hints.tag, enqueuedAt, hints.deadline});
+    }
+    else if (hints.deadline != TaskHints::noDeadline)
+    {
+        auto& worker = *_workers[workerIndex];
+        std::lock_guard<std::mutex> lk(worker.deadlineMtx);
+        worker.deadlines.push_back({std::move(method), hints.tag, enqueuedAt, hints.deadline});
+        std::push_heap(worker.deadlines.begin(), worker.deadlines.end(), LaterDeadline());
+        worker.earliest.store(worker.deadlines.front().deadline.time_since_epoch().count(), std::memory_order_relaxed);
+        ++_deadlineCount;
+    }
+    else
+    {
+        _workers[workerIndex]->tasks.push_back({std::move(method), hints.tag, enqueuedAt, hints.deadline});
+    }
+    ++_queuedCount;
+}
+
+void SimpleThreadPool::enqueue(MethodType&& method, const TaskHints& hints, Clock::rep enqueuedAt)
+{
+    const auto workerIndex = selectWorker(hints);
+    push(std::move(method), hints, enqueuedAt, workerIndex);
+    notify(workerIndex, 1);
+}
+
+void SimpleThreadPool::notify(std::size_t workerIndex, std::size_t count)
+{
+    if (workerIndex != noWorker && count > 0)
+    {
+        auto& worker = *_workers[workerIndex];
+        if (!worker.running)
+        {
+            // The preferred worker takes one of the tasks, the others wake up only to steal the rest
+            if (!worker.signaled)
+            {
+                worker.signaled = true;
+                worker.wake.notify_one();
             }
+            --count;
+        }
+    }
+
+    for (auto& worker : _workers)
+    {
+        if (count == 0)
+            break;
+
+        if (!worker->running && !worker->signaled)
+        {
+            worker->signaled = true;
+            worker->wake.notify_one();
+            --count;
+        }
+    }
+}
+
+bool SimpleThreadPool::take(std::size_t workerIndex, bool stealSingle, QueuedTask& task)
+{
+    // The tasks with a deadline go first, but not more than UrgentQuota of them in a row
+    auto& worker = *_workers[workerIndex];
+    const bool ordinaryTurn = worker.urgentStreak >= UrgentQuota;
+    if (_deadlineCount != 0 && !ordinaryTurn && takeUrgent(workerIndex, task))
+    {
+        ++worker.urgentStreak;
+        --_queuedCount;
+        return true;
+    }
+
+    if (takeOrdinary(workerIndex, stealSingle, task))
+    {
+        worker.urgentStreak = 0;
+        --_queuedCount;
+        return true;
+    }
+
+    // No task without a deadline can be taken, the turn is not wasted and the next quota starts
+    if (ordinaryTurn && _deadlineCount != 0 && takeUrgent(workerIndex, task))
+    {
+        worker.urgentStreak = 1;
+        --_queuedCount;
+        return true;
+    }
+
+    return false;
+}
+
+bool SimpleThreadPool::takeOrdinary(std::size_t workerIndex, bool stealSingle, QueuedTask& task)
+{
+    auto& own = _workers[workerIndex]->tasks;
+    if (!own.empty())
+    {
+        task = std::move(own.front());
+        own.pop_front();
+    }
+    else if (!_taskQueue.empty())
+    {
+        task = std::move(_taskQueue.front());
+        _taskQueue.pop_front();
+    }
+    else
+    {
+        for (std::size_t offset = 1; offset < _workers.size() && !task.method; ++offset)
+        {
+            auto& victim = *_workers[(workerIndex + offset) % _workers.size()];
+            if (victim.tasks.size() > 1 || (stealSingle && victim.running && !victim.tasks.empty()))
+            {
+                task = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+            }
+        }
 
-            assert(task);
-            (*task)();
+        if (!task.method)
+            return false;
+    }
+
+    return true;
+}
+
+bool SimpleThreadPool::takeUrgent(std::size_t workerIndex, QueuedTask& task)
+{
+    auto& own = *_workers[workerIndex];
+    {
+        std::lock_guard<std::mutex> lk(own.deadlineMtx);
+        if (popDeadline(own, task))
+            return true;
+    }
+
+    // Only a worker with no own task steals, the most urgent task waiting for a busy worker. An idle worker is left to
+    // take its own tasks.
+    Worker* victim = nullptr;
+    auto earliest = TaskHints::noDeadline.time_since_epoch().count();
+    for (std::size_t offset = 1; offset < _workers.size(); ++offset)
+    {
+        auto& worker = *_workers[(workerIndex + offset) % _workers.size()];
+        const auto deadline = worker.earliest.load(std::memory_order_relaxed);
+        if (worker.running && deadline < earliest)
+        {
+            earliest = deadline;
+            victim = &worker;
+        }
+    }
+
+    if (victim == nullptr)
+        return false;
+
+    // The victim may have taken the task meanwhile, its next one is taken then
+    std::lock_guard<std::mutex> lk(victim->deadlineMtx);
+    return popDeadline(*victim, task);
+}
+
+bool SimpleThreadPool::takeOwnUrgent(std::size_t workerIndex, QueuedTask& task)
+{
+    // Taken without the pool mutex, so the count of the queued tasks is not guarded by it
+    auto& worker = *_workers[workerIndex];
+    if (worker.urgentStreak >= UrgentQuota
+        || worker.earliest.load(std::memory_order_relaxed) == TaskHints::noDeadline.time_since_epoch().count())
+        return false;
+
+    {
+        std::lock_guard<std::mutex> lk(worker.deadlineMtx);
+        if (!popDeadline(worker, task))
+            return false;
+    }
+
+    ++worker.urgentStreak;
+    --_queuedCount;
+    return true;
+}
+
+bool SimpleThreadPool::popDeadline(Worker& worker, QueuedTask& task)
+{
+    if (worker.deadlines.empty())
+        return false;
+
+    std::pop_heap(worker.deadlines.begin(), worker.deadlines.end(), LaterDeadline());
+    task = std::move(worker.deadlines.back());
+    worker.deadlines.pop_back();
+    worker.earliest.store(worker.deadlines.empty() ? TaskHints::noDeadline.time_since_epoch().count()
+                                                   : worker.deadlines.front().deadline.time_since_epoch().count(),
+                          std::memory_order_relaxed);
+    --_deadlineCount;
+    return true;
+}
+
+bool SimpleThreadPool::isExpired(const QueuedTask& task) const
+{
+    return task.deadline != TaskHints::noDeadline && Clock::now() > task.deadline;
+}
+
+bool SimpleThreadPool::LaterDeadline::operator()(const QueuedTask& left, const QueuedTask& right) const noexcept
+{
+    return left.deadline > right.deadline;
+}
+
+bool SimpleThreadPool::hasWaitingTask(std::size_t workerIndex) const
+{
+    for (std::size_t offset = 1; offset < _workers.size(); ++offset)
+    {
+        const auto& victim = *_workers[(workerIndex + offset) % _workers.size()];
+        if (victim.running && !victim.tasks.empty())
+            return true;
+    }
+
+    return false;
+}
+
+void SimpleThreadPool::onQueueFull()
+{
+    _queueFullCount.fetch_add(1, std::memory_order_relaxed);
+    if (_queueFullHandler)
+    {
+        _queueFullHandler();
+    }
+}
+
+void SimpleThreadPool::storeException(std::exception_ptr exception) noexcept
+{
+    if (_exceptionHandler)
+    {
+        try
+        {
+            _exceptionHandler(exception);
+            return;
         }
         catch (...)
         {
-            std::lock_guard<std::mutex> lk(_exceptMtx);
-            _exceptions.push_back(std::current_exception());
+            exception = std::current_exception();
         }
     }
+
+    auto& buffer = currentPool == this ? _workers[currentWorker]->failures : _callerFailures;
+    std::lock_guard<std::mutex> lk(buffer.mtx);
+    if (_exceptionCapacity != 0 && buffer.exceptions.size() >= _exceptionCapacity)
+    {
+        buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    buffer.exceptions.push_back(std::move(exception));
 }
@@ -1,21 +1,112 @@
 #pragma once
 
 #include "IThreadPool.h"
+#include "fiber.h"
+#include "ring_queue.h"
 
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <exception>
+#include <functional>
 #include <memory>
 #include <mutex>
-#include <queue>
 #include <thread>
+#include <unordered_map>
 #include <vector>
 
+/// Thread pool with a FIFO queue shared by the workers and a personal queue of each worker.
+/// Tasks with an affinity key (see TaskHints) are queued to the worker selected by the key, tasks scheduled by a worker
+/// of the pool (e.g. continuations) are queued to that worker, so their data are likely still in its cache.
+/// \note An idle worker steals from the personal queues only under imbalance: immediately from a queue holding more than
+/// one task, after SimpleThreadPool::StealDelay the single task waiting for a busy worker.
+/// \note Tasks with a deadline (see TaskHints::deadline) are kept in a priority queue of each worker and executed before
+/// the tasks without one, earliest deadline first. Each priority queue has its own lock, a worker takes the most urgent
+/// of its own tasks without the pool mutex. A worker with no own task steals the most urgent one waiting for a busy
+/// worker. The order is thus earliest deadline first per worker, across the workers it is approximated by the stealing.
+/// After SimpleThreadPool::UrgentQuota tasks with a deadline in a row the worker looks for a woken fiber and a task
+/// without a deadline, so a steady stream of deadlines does not starve the other tasks.
 class SimpleThreadPool final : public IThreadPool
 {
 public:
     using ExceptContainerType = std::vector<std::exception_ptr>;
+    using QueueFullHandler = std::function<void()>;
+    using ExceptionHandler = std::function<void(std::exception_ptr)>;
+    using Clock = std::chrono::steady_clock;
+
+    /// Time a single task waits for its busy worker before it can be stolen.
+    static constexpr std::chrono::microseconds StealDelay{500};
+    /// Count of tasks with a deadline a worker takes in a row before it looks for other work.
+    static constexpr std::size_t UrgentQuota{8};
+
+    /// Behavior of IThreadPool::schedule() when the task queue is full.
+    enum class OverflowPolicy
+    {
+        /// The caller is blocked till there is a free space in the queue.
+        /// \note Pool threads are never blocked, their tasks are enqueued over the capacity to prevent a deadlock.
+        /// \note If the pool is not running the task is rejected as with OverflowPolicy::Reject.
+        Block,
+        /// The task is not scheduled and QueueFullException is thrown.
+        Reject,
+        /// The task is executed on the calling thread, its exception is stored as for the pool threads.
+        RunOnCaller
+    };
+
+    /// Handling of the tasks taken by a worker after their TaskHints::deadline.
+    enum class ExpiredPolicy
+    {
+        /// The task is executed late.
+        Execute,
+        /// The task is not executed, mbind::drop() is called instead, so e.g. a ContinuationTask completes with CanceledException.
+        Drop
+    };
+
+    /// Task executed by a worker, see SimpleThreadPool::runningTasks().
+    struct RunningTask
+    {
+        std::size_t worker;
+        /// TaskHints::tag of the task, nullptr if it was not given.
+        const char* tag;
+        Clock::time_point startedAt;
+    };
+
+    /// Statistics of the tasks with one TaskHints::tag executed by the workers, see SimpleThreadPool::profile().
+    struct TagProfile
+    {
+        /// TaskHints::tag of the tasks, nullptr for the tasks without a tag.
+        const char* tag;
+        std::size_t count;
+        Clock::duration totalRunTime;
+        Clock::duration maxRunTime;
+        /// Time from the scheduling (or the coalescing) of the tasks till their start.
+        Clock::duration totalQueueDelay;
+        /// CPU time of the worker threads spent by the tasks, unlike the run time it excludes the waiting.
+        std::chrono::nanoseconds cpuTime;
+    };
+
+    /// Coalesces the tasks scheduled by the current thread outside of the pool, see SimpleThreadPool::setCoalescing().
+    /// The buffered tasks are flushed at the latest by the destructor.
+    /// \note The scopes of one thread need to be nested, the innermost one is in effect.
+    class CoalescingScope final
+    {
+    public:
+        explicit CoalescingScope(SimpleThreadPool& pool) noexcept;
+        ~CoalescingScope();
+
+        CoalescingScope(const CoalescingScope&) = delete;
+        CoalescingScope& operator=(const CoalescingScope&) = delete;
+
+    private:
+        SimpleThreadPool& _pool;
+        SimpleThreadPool* _previous;
+    };
 
     explicit SimpleThreadPool(std::size_t threadCount);
+    /// Creates a pool with a bounded task queue.
+    /// \param capacity maximal count of tasks waiting for execution, 0 means unbounded
+    /// \param policy behavior of IThreadPool::schedule() when the queue is full
+    /// \note IThreadPool::try_schedule() never blocks nor runs the task on the caller, it returns false when the queue is full.
+    SimpleThreadPool(std::size_t threadCount, std::size_t capacity, OverflowPolicy policy);
     /// Destroys the instance.
     /// \note Internally calls SimpleThreadPool::stop().
     /// \note Un-popped exceptions will be swallowed, for DEBUG and assertion is made.
@@ -27,21 +118,246 @@ public:
     void start();
     /// Stops the threads in the thread pool.
     void stop();
+    /// \returns Stored exceptions of the tasks, the buffers of the workers are merged.
     ExceptContainerType popExceptions();
 
+    /// Limits the count of exceptions stored by each worker (and by the callers executing tasks), the exceptions over
+    /// the limit are dropped and counted, so an error storm does not grow the memory without limit.
+    /// \param capacity maximal count of stored exceptions per worker, 0 means unbounded (the default)
+    /// \note Needs to be set before tasks are scheduled, it is not synchronized with the execution.
+    void setExceptionCapacity(std::size_t capacity);
+    /// Sets a handler called on the worker with each exception of a task instead of storing it.
+    /// \note Needs to be set before tasks are scheduled, it is not synchronized with the execution.
+    /// \note An exception thrown by the handler is stored instead.
+    void setExceptionHandler(ExceptionHandler handler);
+    /// \returns Count of exceptions dropped over the capacity since the pool creation.
+    std::size_t droppedExceptionCount() const noexcept;
+
+    /// Sets a handler called on the submitting thread every time a task hits the full queue, before the overflow policy is applied.
+    /// \note Needs to be set before tasks are scheduled, it is not synchronized with the scheduling.
+    void setQueueFullHandler(QueueFullHandler handler);
+    /// \returns Count of submissions which found the queue full since the pool creation.
+    std::size_t queueFullCount() const noexcept;
+
+    /// Enables tracking of the tasks executed by the workers, it costs a clock read and a few relaxed stores per task.
+    /// Disabled by default, it can be changed any time.
+    void setTaskTracking(bool enabled) noexcept;
+    /// \returns Snapshot of the tracked tasks executed at the moment, a task started meanwhile may be missing.
+    /// \note Can be called from any thread, e.g. by a Watchdog.
+    /// \note A task suspended on a fiber is not executed, it is reported again with its original start once resumed.
+    std::vector<RunningTask> runningTasks() const;
+
+    /// Sets the handling of the tasks taken after their deadline, ExpiredPolicy::Execute by default.
+    /// \note Needs to be set before tasks are scheduled, it is not synchronized with the execution.
+    void setExpiredPolicy(ExpiredPolicy policy);
+    /// \returns Count of tasks dropped after their deadline since the pool creation.
+    std::size_t expiredCount() const noexcept;
+
+    /// Enables profiling of the tasks executed by the workers, aggregated by TaskHints::tag in a table of each worker.
+    /// It costs a clock read per scheduling and two clock reads, two thread CPU time reads and an uncontended lock per
+    /// executed task. Disabled by default, it can be changed any time, the tasks scheduled meanwhile are not profiled.
+    void setProfiling(bool enabled) noexcept;
+    /// \returns Statistics of the profiled tasks merged from the tables of the workers, sorted by the CPU time descending.
+    /// Tags with the same text are merged, e.g. the same TASK_CALLSITE seen from different translation units.
+    /// \param top maximal count of the returned tags, 0 returns all
+    std::vector<TagProfile> profile(std::size_t top = 0) const;
+    /// Clears the statistics collected so far.
+    void resetProfile();
+
+    /// Enables coalescing of short tasks. The tasks scheduled in quick succession by one thread (a worker of the pool or
+    /// a thread within a CoalescingScope) are buffered by the thread and enqueued as one entry, which a worker executes
+    /// back-to-back. So the lock and the notification are paid once per batch instead of once per task.
+    /// The buffer is flushed when it holds @p maxBatch tasks, when a task is scheduled @p maxDelay after the first
+    /// buffered one, at the end of the task executed by the worker, at the end of the CoalescingScope, by
+    /// SimpleThreadPool::flush() or before the thread blocks in a wait of the library (see IThreadPool::before_blocking()).
+    /// A worker holds tasks back only while the other workers are busy, a worker running out of tasks flushes the
+    /// buffers of the busy ones and a worker finishing a task flushes the buffers older than @p maxDelay.
+    /// \param maxBatch maximal count of tasks in one entry, less than 2 disables the coalescing (the default)
+    /// \note A task blocking otherwise (e.g. by std::future::wait()) needs to call IThreadPool::before_blocking() first.
+    /// \note The buffer of a thread outside of the pool is flushed only by the thread itself.
+    /// \note Tasks with an affinity key and IThreadPool::try_schedule() are not coalesced.
+    /// \note A batch takes one place of the queue capacity. A batch the pool refuses is executed on the flushing thread.
+    /// \note Needs to be set before tasks are scheduled, it is not synchronized with the scheduling.
+    void setCoalescing(std::size_t maxBatch, Clock::duration maxDelay);
+    /// Enqueues the tasks of this pool buffered by the calling thread, e.g. before the thread waits for them.
+    void flush() noexcept;
+
+    /// Enables the fiber mode, the workers execute each task on a pooled Fiber with a stack of @p stackSize bytes.
+    /// A task waiting by ContinuationTask::wait() or TaskGroup::wait() suspends only its fiber, the worker executes
+    /// other tasks meanwhile and resumes the fiber once the awaited task is completed. So tasks blocking on each other
+    /// do not take the workers and do not deadlock a small pool.
+    /// \param stackSize size of the stack of a fiber, 0 disables the fiber mode (the default)
+    /// \note Other blocking calls (e.g. std::future::wait()) still block the worker.
+    /// \note A suspended fiber is resumed by the worker which started it. Suspended fibers hold their stacks, a fiber is
+    /// created whenever a worker has no idle one, and the fibers are freed with the pool.
+    /// \note The fibers suspended when the pool stops are never resumed, the pool needs to outlive the awaited tasks.
+    /// \note The run time and the CPU time of a suspended task include the tasks its worker executed meanwhile.
+    /// \note Needs to be set before SimpleThreadPool::start().
+    void setFibers(std::size_t stackSize);
+
 private:
-    // OPTIM
-    // each thread could have a non-blocking FIFO as it's personal task queue
+    // Each worker stores its exceptions separately, so failing workers do not contend on a shared lock
+    struct ExceptionBuffer
+    {
+        std::mutex mtx;
+        ExceptContainerType exceptions;
+        std::atomic<std::size_t> dropped{0};
+    };
+
+    struct QueuedTask
+    {
+        MethodType method;
+        // TaskHints::tag
+        const char* tag;
+        // Clock ticks of the scheduling, 0 if the task is not profiled
+        Clock::rep enqueuedAt;
+        Clock::time_point deadline{TaskHints::noDeadline};
+    };
+
+    // Orders a heap of tasks by their deadlines, the earliest on the top
+    struct LaterDeadline
+    {
+        bool operator()(const QueuedTask& left, const QueuedTask& right) const noexcept;
+    };
+
+    // Written by its worker, read only when the profile is requested
+    struct ProfileTable
+    {
+        std::mutex mtx;
+        std::unordered_map<const char*, TagProfile> tags;
+    };
+
+    // Fiber of a worker with the task it executes, see SimpleThreadPool::setFibers()
+    struct WorkerFiber
+    {
+        SimpleThreadPool* pool;
+        std::size_t workerIndex;
+        QueuedTask task;
+        std::unique_ptr<Fiber> fiber;
+        // Tracking of the suspended task, given back to the worker when the fiber is resumed
+        Clock::rep startedAt{0};
+        const char* tag{nullptr};
+    };
+
+    // Tasks buffered by one thread, see SimpleThreadPool::setCoalescing()
+    struct CoalescingBuffer
+    {
+        // Guards the tasks and their pool, the buffer of a worker is flushed also by the other workers of its pool
+        std::mutex mtx;
+        // Pool of the buffered tasks
+        SimpleThreadPool* pool{nullptr};
+        std::vector<QueuedTask> tasks;
+        // Clock ticks of the first buffered task, 0 if the buffer is empty
+        std::atomic<Clock::rep> since{0};
+        // Pool of the worker owning the buffer, null for the other threads
+        SimpleThreadPool* owner{nullptr};
+        // Pool of the innermost CoalescingScope of the thread
+        SimpleThreadPool* scope{nullptr};
+    };
+
+    struct Worker
+    {
+        std::condition_variable wake;
+        RingQueue<QueuedTask> tasks;
+        // Tasks with a deadline, a heap ordered by LaterDeadline and guarded by deadlineMtx
+        std::mutex deadlineMtx;
+        std::vector<QueuedTask> deadlines;
+        // Deadline of the top of the heap in Clock ticks, the maximum if empty, read by the stealing workers without the lock
+        std::atomic<Clock::rep> earliest{TaskHints::noDeadline.time_since_epoch().count()};
+        // Executing a task, so its waiting tasks can be stolen
+        bool running{false};
+        // Notified and not yet looking for a task, it is not notified again
+        bool signaled{false};
+        // Count of tasks with a deadline taken in a row, used only by the worker thread
+        std::size_t urgentStreak{0};
+        // Start of the tracked task in Clock ticks, 0 if there is none, read without the pool mutex
+        std::atomic<Clock::rep> startedAt{0};
+        std::atomic<const char*> tag{nullptr};
+        ExceptionBuffer failures;
+        ProfileTable profile;
+        // All fibers of the worker and the not suspended ones, used only by the worker thread
+        std::vector<std::unique_ptr<WorkerFiber>> fibers;
+        std::vector<WorkerFiber*> idleFibers;
+        // Woken fibers waiting for the worker to resume them, room for all fibers is reserved
+        std::vector<WorkerFiber*> resumed;
+        // Buffer of the worker thread, see SimpleThreadPool::coalescingBuffer()
+        CoalescingBuffer coalesced;
+    };
+
+    static constexpr std::size_t noWorker{static_cast<std::size_t>(-1)};
+
     void scheduleInner(MethodType&& method) override;
-    void threadPoolMethod() noexcept;
+    void scheduleHintedInner(MethodType&& method, const TaskHints& hints) override;
+    bool tryScheduleInner(MethodType& method) override;
+    /// Enqueues as many methods as fit under one lock, the rest is scheduled one by one by the overflow policy.
+    void scheduleBatchInner(MethodType* methods, std::size_t count, const TaskHints& hints) override;
+    void submit(MethodType&& method, const TaskHints& hints);
+    void threadPoolMethod(std::size_t workerIndex) noexcept;
+    void run(QueuedTask& task) noexcept;
+    void runOnFiber(std::size_t workerIndex, QueuedTask& task) noexcept;
+    void resume(WorkerFiber& fiber) noexcept;
+    void switchedOut(WorkerFiber& fiber) noexcept;
+    static void fiberMethod(void* fiber) noexcept;
+    static void wakeFiber(void* fiber) noexcept;
+    Clock::rep profileStamp() const noexcept;
+    void execute(MethodType& task) noexcept;
+    bool coalesce(MethodType& method, const char* tag);
+    void runBatch(std::vector<QueuedTask> tasks) noexcept;
+    static CoalescingBuffer& coalescingBuffer() noexcept;
+    static void flush(CoalescingBuffer& buffer) noexcept;
+    static void flushCurrentThread() noexcept;
+    void flushCoalesced(bool expiredOnly) noexcept;
+    bool isFull() const;
+    std::size_t selectWorker(const TaskHints& hints);
+    void push(MethodType&& method, const TaskHints& hints, Clock::rep enqueuedAt, std::size_t workerIndex);
+    void enqueue(MethodType&& method, const TaskHints& hints, Clock::rep enqueuedAt);
+    void notify(std::size_t workerIndex, std::size_t count);
+    bool take(std::size_t workerIndex, bool stealSingle, QueuedTask& task);
+    bool takeOrdinary(std::size_t workerIndex, bool stealSingle, QueuedTask& task);
+    bool takeUrgent(std::size_t workerIndex, QueuedTask& task);
+    bool takeOwnUrgent(std::size_t workerIndex, QueuedTask& task);
+    bool popDeadline(Worker& worker, QueuedTask& task);
+    bool isExpired(const QueuedTask& task) const;
+    bool hasWaitingTask(std::size_t workerIndex) const;
+    void onQueueFull();
+    void storeException(std::exception_ptr exception) noexcept;
 
     std::vector<std::unique_ptr<std::thread>> _threads;
+    // OPTIM the personal queues could be non-blocking FIFOs, they are guarded by the pool mutex (the priority queues have their own locks)
+    std::vector<std::unique_ptr<Worker>> _workers;
     std::mutex _threadWaitMtx;
-    std::condition_variable _threadWait;
-    std::queue<MethodType> _taskQueue;
+    std::condition_variable _queueNotFull;
+    RingQueue<QueuedTask> _taskQueue;
+    // Count of tasks in all queues
+    std::atomic<std::size_t> _queuedCount;
+    // Count of tasks in the priority queues of the workers
+    std::atomic<std::size_t> _deadlineCount;
+    // Worker receiving the next task with a deadline scheduled from outside of the pool
+    std::size_t _nextDeadlineWorker;
     std::size_t _threadCount;
-    bool _run;
+    std::size_t _capacity;
+    OverflowPolicy _policy;
+    std::atomic_bool _run;
+    std::atomic_bool _taskTracking;
+    std::atomic_bool _profiling;
+    ExpiredPolicy _expiredPolicy;
+    std::atomic<std::size_t> _expiredCount;
+
+    QueueFullHandler _queueFullHandler;
+    std::atomic<std::size_t> _queueFullCount;
+
+    // Exceptions of the tasks executed on the callers, see OverflowPolicy::RunOnCaller
+    ExceptionBuffer _callerFailures;
+    std::size_t _exceptionCapacity;
+    ExceptionHandler _exceptionHandler;
+
+    // Less than 2 if the coalescing is disabled
+    std::size_t _coalesceBatch;
+    Clock::duration _coalesceDelay;
+    // Count of the not empty buffers of the workers and count of the workers about to wait, see SimpleThreadPool::coalesce()
+    std::atomic<std::size_t> _coalescedBuffers;
+    std::atomic<std::size_t> _waitingWorkers;
 
-    std::mutex _exceptMtx;
-    ExceptContainerType _exceptions;
+    // 0 if the fiber mode is disabled
+    std::size_t _fiberStackSize;
 };
\ No newline at end of file
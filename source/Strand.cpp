@@ -0,0 +1,123 @@
+#include "Strand.h"
+
+#include <cassert>
+#include <exception>
+#include <thread>
+
+Strand::Strand(IThreadPool& thPool, std::size_t batchSize /* = DefaultBatchSize*/)
+    : _thPool(thPool)
+    , _batchSize{batchSize == 0 ? 1 : batchSize}
+    , _pending{0}
+{
+}
+
+void Strand::scheduleInner(MethodType&& method)
+{
+    _tasks.push(std::move(method));
+
+    // Only the producer making the strand non-empty schedules the drain, the drain itself keeps
+    // rescheduling as long as there are pending tasks
+    if (_pending.fetch_add(1, std::memory_order_acq_rel) == 0)
+    {
+        scheduleDrain();
+    }
+}
+
+Strand::ExceptContainerType Strand::popExceptions()
+{
+    std::lock_guard<std::mutex> lk(_exceptMtx);
+    return std::move(_exceptions);
+}
+
+void Strand::scheduleDrain() noexcept
+{
+    // The pending count is already non-zero, so nobody else will schedule the drain
+    while (true)
+    {
+        try
+        {
+            _thPool.schedule(&Strand::run, this);
+            return;
+        }
+        catch (...)
+        {
+        }
+
+        // The pool refused it, so the tasks are executed on the calling thread. Their exceptions are stored, the
+        // caller is not the one to report them to, its own task was already taken.
+        std::exception_ptr exception;
+        const bool pending = drain(exception);
+        if (exception)
+        {
+            try
+            {
+                std::lock_guard<std::mutex> lk(_exceptMtx);
+                _exceptions.push_back(std::move(exception));
+            }
+            catch (...)
+            {
+                // Out of memory, the exception is lost
+            }
+        }
+
+        if (!pending)
+            return;
+    }
+}
+
+void Strand::run()
+{
+    std::exception_ptr exception;
+    if (drain(exception))
+    {
+        // Let other tasks of the underlying pool run
+        scheduleDrain();
+    }
+
+    if (exception)
+        std::rethrow_exception(exception);
+}
+
+bool Strand::drain(std::exception_ptr& exception) noexcept
+{
+    for (std::size_t executed = 0; executed < _batchSize; ++executed)
+    {
+        auto task = popWait();
+
+        try
+        {
+            (*task)();
+        }
+        catch (...)
+        {
+            exception = std::current_exception();
+        }
+        task.reset();
+
+        if (_pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            // The strand is empty, next scheduled task will schedule a new drain
+            return false;
+        }
+
+        // The exception is reported before further tasks are executed
+        if (exception)
+            return true;
+    }
+
+    return true;
+}
+
+IThreadPool::MethodType Strand::popWait()
+{
+    MethodType task;
+
+    // The pending count is non-zero, so a task is in the queue or a producer is just linking it
+    while (!_tasks.pop(task))
+    {
+        std::this_thread::yield();
+    }
+
+    assert(task);
+    return task;
+}
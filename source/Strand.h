@@ -0,0 +1,55 @@
+#pragma once
+
+#include "IThreadPool.h"
+
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <vector>
+#include "mpsc_queue.h"
+
+/// Serial executor layered on another thread pool.
+/// The tasks scheduled on the strand are executed one at a time in the scheduling order, but on the threads of the
+/// underlying pool. No thread is dedicated to the strand and no lock is held while a task is executed.
+/// \note The strand can be used as the thread pool of ContinuationTask, the continuations are then executed in order.
+/// \note Exceptions of the tasks are re-thrown to the underlying pool after the strand bookkeeping is done.
+/// \note If the underlying pool refuses the drain, the tasks are executed on the scheduling thread and their exceptions
+/// are stored by the strand, see Strand::popExceptions().
+class Strand final : public IThreadPool
+{
+public:
+    using ExceptContainerType = std::vector<std::exception_ptr>;
+
+    static constexpr std::size_t DefaultBatchSize = 64;
+
+    /// Creates a new strand.
+    /// @param thPool underlying pool executing the tasks
+    /// @param batchSize maximal count of tasks executed in one task of the underlying pool, so other tasks of the
+    /// underlying pool are not starved
+    /// @note The @p thPool instance needs to stay alive as long as this instance is alive.
+    explicit Strand(IThreadPool& thPool, std::size_t batchSize = DefaultBatchSize);
+    /// @note The strand needs to stay alive till all of its tasks are executed.
+    ~Strand() = default;
+
+    Strand(const Strand&) = delete;
+    Strand& operator=(const Strand&) = delete;
+
+    /// \returns Stored exceptions of the tasks executed on the scheduling threads, as the underlying pool refused them.
+    ExceptContainerType popExceptions();
+
+private:
+    void scheduleInner(MethodType&& method) override;
+    void scheduleDrain() noexcept;
+    void run();
+    bool drain(std::exception_ptr& exception) noexcept;
+    MethodType popWait();
+
+    IThreadPool& _thPool;
+    const std::size_t _batchSize;
+    MpscQueue<MethodType> _tasks;
+    // Count of tasks pushed to the strand and not yet executed, the drain is scheduled on transition from 0
+    std::atomic<std::size_t> _pending;
+    std::mutex _exceptMtx;
+    ExceptContainerType _exceptions;
+};
@@ -0,0 +1,236 @@
+#include "allocation_counter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+namespace
+{
+    // Size of the block is stored in front of it, so the live bytes can be tracked also for unsized deletes
+    constexpr std::size_t headerSize{alignof(std::max_align_t) > sizeof(std::size_t) ? alignof(std::max_align_t) : sizeof(std::size_t)};
+
+    thread_local AllocationCounter::Snapshot threadCounter{0, 0, 0};
+    std::atomic<std::size_t> liveBytesCounter{0};
+    std::atomic<AllocationCounter::Hook> allocationHook{nullptr};
+
+    void onAllocation(std::size_t size) noexcept
+    {
+        ++threadCounter.allocations;
+        threadCounter.bytes += size;
+        liveBytesCounter.fetch_add(size, std::memory_order_relaxed);
+
+        if (auto hook = allocationHook.load(std::memory_order_acquire))
+        {
+            hook(size);
+        }
+    }
+
+    void onDeallocation(std::size_t size) noexcept
+    {
+        ++threadCounter.deallocations;
+        liveBytesCounter.fetch_sub(size, std::memory_order_relaxed);
+    }
+
+    void* allocate(std::size_t size) noexcept
+    {
+        auto* block = static_cast<unsigned char*>(std::malloc(size + headerSize));
+        if (block == nullptr)
+            return nullptr;
+
+        *reinterpret_cast<std::size_t*>(block) = size;
+        onAllocation(size);
+        return block + headerSize;
+    }
+
+    void deallocate(void* ptr) noexcept
+    {
+        if (ptr == nullptr)
+            return;
+
+        auto* block = static_cast<unsigned char*>(ptr) - headerSize;
+        onDeallocation(*reinterpret_cast<std::size_t*>(block));
+        std::free(block);
+    }
+
+    // The header is placed in front of the aligned block, a whole alignment unit is reserved for it
+    std::size_t alignedHeaderSize(std::size_t alignment) noexcept
+    {
+        return alignment > headerSize ? alignment : headerSize;
+    }
+
+    void* allocateAligned(std::size_t size, std::align_val_t align) noexcept
+    {
+        const auto alignment = static_cast<std::size_t>(align);
+        const auto header = alignedHeaderSize(alignment);
+        const auto total = (size + header + alignment - 1) / alignment * alignment;
+
+#ifdef _WIN32
+        auto* block = static_cast<unsigned char*>(_aligned_malloc(total, alignment));
+#else
+        auto* block = static_cast<unsigned char*>(std::aligned_alloc(alignment, total));
+#endif
+        if (block == nullptr)
+            return nullptr;
+
+        *reinterpret_cast<std::size_t*>(block + header - sizeof(std::size_t)) = size;
+        onAllocation(size);
+        return block + header;
+    }
+
+    void deallocateAligned(void* ptr, std::align_val_t align) noexcept
+    {
+        if (ptr == nullptr)
+            return;
+
+        auto* block = static_cast<unsigned char*>(ptr) - alignedHeaderSize(static_cast<std::size_t>(align));
+        onDeallocation(*reinterpret_cast<std::size_t*>(static_cast<unsigned char*>(ptr) - sizeof(std::size_t)));
+#ifdef _WIN32
+        _aligned_free(block);
+#else
+        std::free(block);
+#endif
+    }
+
+    void* allocateOrThrow(std::size_t size)
+    {
+        auto* ptr = allocate(size == 0 ? 1 : size);
+        if (ptr == nullptr)
+            throw std::bad_alloc();
+
+        return ptr;
+    }
+
+    void* allocateAlignedOrThrow(std::size_t size, std::align_val_t align)
+    {
+        auto* ptr = allocateAligned(size == 0 ? 1 : size, align);
+        if (ptr == nullptr)
+            throw std::bad_alloc();
+
+        return ptr;
+    }
+}
+
+AllocationCounter::Snapshot AllocationCounter::thread() noexcept
+{
+    return threadCounter;
+}
+
+std::size_t AllocationCounter::liveBytes() noexcept
+{
+    return liveBytesCounter.load(std::memory_order_relaxed);
+}
+
+AllocationCounter::Hook AllocationCounter::setHook(Hook hook) noexcept
+{
+    return allocationHook.exchange(hook, std::memory_order_acq_rel);
+}
+
+AllocationCounter::Scope::Scope() noexcept
+    : _start(threadCounter)
+{
+}
+
+AllocationCounter::Snapshot AllocationCounter::Scope::delta() const noexcept
+{
+    return {threadCounter.allocations - _start.allocations, threadCounter.deallocations - _start.deallocations, threadCounter.bytes - _start.bytes};
+}
+
+void* operator new(std::size_t size)
+{
+    return allocateOrThrow(size);
+}
+
+void* operator new[](std::size_t size)
+{
+    return allocateOrThrow(size);
+}
+
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept
+{
+    return allocate(size == 0 ? 1 : size);
+}
+
+void* operator new[](std::size_t size, const std::nothrow_t&) noexcept
+{
+    return allocate(size == 0 ? 1 : size);
+}
+
+void* operator new(std::size_t size, std::align_val_t align)
+{
+    return allocateAlignedOrThrow(size, align);
+}
+
+void* operator new[](std::size_t size, std::align_val_t align)
+{
+    return allocateAlignedOrThrow(size, align);
+}
+
+void* operator new(std::size_t size, std::align_val_t align, const std::nothrow_t&) noexcept
+{
+    return allocateAligned(size == 0 ? 1 : size, align);
+}
+
+void* operator new[](std::size_t size, std::align_val_t align, const std::nothrow_t&) noexcept
+{
+    return allocateAligned(size == 0 ? 1 : size, align);
+}
+
+void operator delete(void* ptr) noexcept
+{
+    deallocate(ptr);
+}
+
+void operator delete[](void* ptr) noexcept
+{
+    deallocate(ptr);
+}
+
+void operator delete(void* ptr, std::size_t) noexcept
+{
+    deallocate(ptr);
+}
+
+void operator delete[](void* ptr, std::size_t) noexcept
+{
+    deallocate(ptr);
+}
+
+void operator delete(void* ptr, const std::nothrow_t&) noexcept
+{
+    deallocate(ptr);
+}
+
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept
+{
+    deallocate(ptr);
+}
+
+void operator delete(void* ptr, std::align_val_t align) noexcept
+{
+    deallocateAligned(ptr, align);
+}
+
+void operator delete[](void* ptr, std::align_val_t align) noexcept
+{
+    deallocateAligned(ptr, align);
+}
+
+void operator delete(void* ptr, std::size_t, std::align_val_t align) noexcept
+{
+    deallocateAligned(ptr, align);
+}
+
+void operator delete[](void* ptr, std::size_t, std::align_val_t align) noexcept
+{
+    deallocateAligned(ptr, align);
+}
+
+void operator delete(void* ptr, std::align_val_t align, const std::nothrow_t&) noexcept
+{
+    deallocateAligned(ptr, align);
+}
+
+void operator delete[](void* ptr, std::align_val_t align, const std::nothrow_t&) noexcept
+{
+    deallocateAligned(ptr, align);
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstddef>
+
+/// Statistics of the heap allocations done through the global operator new/delete.
+/// The operators are replaced in allocation_counter.cpp, so every allocation of the binary is counted.
+class AllocationCounter final
+{
+public:
+    struct Snapshot
+    {
+        /// Count of allocations.
+        std::size_t allocations;
+        /// Count of deallocations.
+        std::size_t deallocations;
+        /// Sum of the allocated bytes.
+        std::size_t bytes;
+    };
+
+    /// Called on each allocation with its size, e.g. to break on an allocation in a hot path.
+    /// \note The hook is called from the operator new, so it must not allocate.
+    using Hook = void (*)(std::size_t size);
+
+    /// Counts the allocations of the calling thread from its construction, e.g. to check an allocation budget.
+    class Scope final
+    {
+    public:
+        Scope() noexcept;
+
+        /// @returns Allocations done by the calling thread since the construction.
+        Snapshot delta() const noexcept;
+
+    private:
+        Snapshot _start;
+    };
+
+    AllocationCounter() = delete;
+
+    /// @returns Allocations done by the calling thread since its start.
+    static Snapshot thread() noexcept;
+    /// @returns Bytes allocated and not yet freed by all threads.
+    static std::size_t liveBytes() noexcept;
+    /// Installs the @p hook called by all threads, nullptr removes it.
+    /// @returns The previous hook.
+    static Hook setHook(Hook hook) noexcept;
+};
@@ -0,0 +1,118 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+namespace chain_detail
+{
+    // Result of the steps from Index on called with Args, the type member is missing if the steps can't be called so.
+    // Then a chain called with wrong arguments is not callable for SFINAE checks, e.g. of std::function.
+    template <typename Enable, std::size_t Index, typename Tuple, typename... Args>
+    struct StepsResult
+    {
+    };
+
+    template <std::size_t Index, typename Tuple, typename Result, bool Last = Index + 1 == std::tuple_size_v<Tuple>, bool Void = std::is_void_v<Result>>
+    struct AfterStep : StepsResult<void, Index + 1, Tuple, Result>
+    {
+    };
+
+    template <std::size_t Index, typename Tuple, typename Result, bool Void>
+    struct AfterStep<Index, Tuple, Result, true, Void>
+    {
+        using type = Result;
+    };
+
+    template <std::size_t Index, typename Tuple, typename Result>
+    struct AfterStep<Index, Tuple, Result, false, true> : StepsResult<void, Index + 1, Tuple>
+    {
+    };
+
+    template <std::size_t Index, typename Tuple, typename... Args>
+    struct StepsResult<std::enable_if_t<std::is_invocable_v<std::tuple_element_t<Index, Tuple>&, Args...>>, Index, Tuple, Args...>
+        : AfterStep<Index, Tuple, std::invoke_result_t<std::tuple_element_t<Index, Tuple>&, Args...>>
+    {
+    };
+}
+
+/// Statically typed callable executing its steps one after another, the result of a step is moved into the next one.
+/// A step returning void is followed by a step without arguments.
+/// The whole chain is one object, scheduled e.g. as a single IThreadPool::schedule task, without any heap allocation or
+/// virtual call between the steps.
+/// \note A chain called without arguments and returning void is a ContinuationTask::TaskMethod, so it can be used
+/// as a ContinuationTask or as its continuation.
+template <typename... Steps>
+class Chain final
+{
+    static_assert(sizeof...(Steps) > 0, "a chain needs at least one step");
+
+public:
+    explicit Chain(std::tuple<Steps...>&& steps);
+
+    /// Executes the chain, @p args are given to the first step.
+    /// @returns Result of the last step.
+    template <typename... Args>
+    typename chain_detail::StepsResult<void, 0, std::tuple<Steps...>, Args...>::type operator()(Args&&... args);
+
+    /// @returns A new chain with the @p step appended.
+    template <typename Step>
+    Chain<Steps..., std::decay_t<Step>> then(Step&& step) &&;
+
+private:
+    template <std::size_t Index, typename... Args>
+    decltype(auto) invoke(Args&&... args);
+
+    std::tuple<Steps...> _steps;
+};
+
+/// Creates a chain executing the @p steps one after another.
+template <typename... Steps>
+Chain<std::decay_t<Steps>...> chain(Steps&&... steps)
+{
+    return Chain<std::decay_t<Steps>...>(std::tuple<std::decay_t<Steps>...>(std::forward<Steps>(steps)...));
+}
+
+template <typename... Steps>
+Chain<Steps...>::Chain(std::tuple<Steps...>&& steps)
+    : _steps(std::move(steps))
+{
+}
+
+template <typename... Steps>
+template <typename... Args>
+typename chain_detail::StepsResult<void, 0, std::tuple<Steps...>, Args...>::type Chain<Steps...>::operator()(Args&&... args)
+{
+    return invoke<0>(std::forward<Args>(args)...);
+}
+
+template <typename... Steps>
+template <typename Step>
+Chain<Steps..., std::decay_t<Step>> Chain<Steps...>::then(Step&& step) &&
+{
+    return Chain<Steps..., std::decay_t<Step>>(std::tuple_cat(std::move(_steps), std::tuple<std::decay_t<Step>>(std::forward<Step>(step))));
+}
+
+template <typename... Steps>
+template <std::size_t Index, typename... Args>
+decltype(auto) Chain<Steps...>::invoke(Args&&... args)
+{
+    auto& step = std::get<Index>(_steps);
+
+    if constexpr (Index + 1 == sizeof...(Steps))
+    {
+        return std::invoke(step, std::forward<Args>(args)...);
+    }
+    else if constexpr (std::is_void_v<std::invoke_result_t<decltype(step), Args...>>)
+    {
+        std::invoke(step, std::forward<Args>(args)...);
+        return invoke<Index + 1>();
+    }
+    else
+    {
+        // The temporary result is moved into the next step
+        return invoke<Index + 1>(std::invoke(step, std::forward<Args>(args)...));
+    }
+}
@@ -0,0 +1,307 @@
+/*
+* Not any company's property but Public-Domain
+* Do with source-code as you will. No requirement to keep this
+* header if need to use it/change it/ or do whatever with it
+*
+* Note that there is No guarantee that this code will work
+* and I take no responsibility for this code and any problems you
+* might get if using it.
+*
+* Code & platform dependent issues with it was originally
+* published at http://www.kjellkod.cc/threadsafecircularqueue
+* 2012-16-19  @author Kjell Hedstrom, hedstrom@kjellkod.cc */
+
+// Relaxed/acquire-release variant of memory_sequential_consistent::CircularFifo
+//
+// * the indexes are published with release stores and read with acquire loads, no full fences are needed
+// * the producer and consumer indexes are on separate cache lines, also separated from the array,
+//   so there is no false sharing between the producer and the consumer
+// * the producer keeps a cached copy of the head and the consumer a cached copy of the tail,
+//   the shared index of the other side is loaded only when the cached copy says the queue is full/empty
+// * batches can be written/read in place through reserve()/commit() and peek()/consume(),
+//   the index is published only once per batch
+
+#ifndef CIRCULARFIFO_ACQUIRE_RELEASE_H_
+#define CIRCULARFIFO_ACQUIRE_RELEASE_H_
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstddef>
+#include <vector>
+
+namespace memory_relaxed_acquire_release {
+template<typename Element, size_t Size>
+class CircularFifo{
+public:
+  enum { Capacity = Size+1 };
+
+  // Contiguous slots of the array
+  struct Span {
+    Element* data;
+    size_t size;
+  };
+
+  // Slots of a batch, the batch can wrap around the end of the array, so it is split into two spans
+  struct Range {
+    Span first;
+    Span second;
+
+    size_t size() const { return first.size + second.size; }
+  };
+
+  CircularFifo() : _tail(0), _cachedHead(0), _head(0), _cachedTail(0) {}
+  virtual ~CircularFifo() {}
+
+  bool push(const std::vector<Element>& items, typename std::vector<Element>::size_type& elementsAdded);
+  bool push(const Element& item);
+  bool push(Element&& item);
+  bool pop(Element& item);
+  size_t pop(Element* items, size_t maxCount);
+
+  // Producer only. Reserves at most maxCount free slots to be written in place, nothing is visible
+  // to the consumer till commit() is called
+  Range reserve(size_t maxCount);
+  // Producer only. Publishes the first count slots of the last reservation
+  void commit(size_t count);
+  // Consumer only. Gives at most maxCount oldest items to be read in place, the items stay in the queue
+  // till consume() is called
+  Range peek(size_t maxCount);
+  // Consumer only. Removes the first count items of the last peek
+  void consume(size_t count);
+
+  bool wasEmpty() const;
+  bool wasFull() const;
+  bool isLockFree() const;
+
+private:
+  static constexpr size_t CacheLineSize = 64;
+
+  size_t increment(size_t idx) const;
+  size_t advance(size_t idx, size_t count) const;
+  bool hasSpace(size_t next_tail);
+  bool hasItem(size_t current_head);
+  size_t freeSlots(size_t current_tail, size_t required);
+  size_t usedSlots(size_t current_head, size_t required);
+  Range range(size_t idx, size_t count);
+
+  // producer cache line
+  alignas(CacheLineSize) std::atomic<size_t> _tail;  // tail(input) index
+  size_t _cachedHead;  // producer's copy of _head
+
+  // consumer cache line
+  alignas(CacheLineSize) std::atomic<size_t> _head;  // head(output) index
+  size_t _cachedTail;  // consumer's copy of _tail
+
+  alignas(CacheLineSize) Element _array[Capacity];
+};
+
+// Push a vector as one batch, the tail is published only once
+template<typename Element, size_t Size>
+bool CircularFifo<Element, Size>::push(const std::vector<Element>& items, typename std::vector<Element>::size_type& elementsAdded)
+{
+  const auto slots = reserve(items.size());
+  const auto firstEnd = items.begin() + slots.first.size;
+  std::copy(items.begin(), firstEnd, slots.first.data);
+  std::copy(firstEnd, firstEnd + slots.second.size, slots.second.data);
+  commit(slots.size());
+
+  elementsAdded = slots.size();
+  return elementsAdded == items.size();  // false for full queue
+}
+
+// Push on tail. Tail is only changed by producer and can be safely loaded using memory_order_relaxed
+//         head is updated by consumer and must be loaded using at least memory_order_acquire
+template<typename Element, size_t Size>
+bool CircularFifo<Element, Size>::push(const Element& item)
+{
+  const auto current_tail = _tail.load(std::memory_order_relaxed);
+  const auto next_tail = increment(current_tail);
+  if(hasSpace(next_tail))
+  {
+    _array[current_tail] = item;
+    _tail.store(next_tail, std::memory_order_release);
+    return true;
+  }
+
+  return false;  // full queue
+}
+
+template<typename Element, size_t Size>
+bool CircularFifo<Element, Size>::push(Element&& item)
+{
+  const auto current_tail = _tail.load(std::memory_order_relaxed);
+  const auto next_tail = increment(current_tail);
+  if(hasSpace(next_tail))
+  {
+    _array[current_tail] = std::move(item);
+    _tail.store(next_tail, std::memory_order_release);
+    return true;
+  }
+
+  return false;  // full queue
+}
+
+// Pop by Consumer can only update the head (load with relaxed, store with release)
+//     the tail must be accessed with at least acquire
+template<typename Element, size_t Size>
+bool CircularFifo<Element, Size>::pop(Element& item)
+{
+  const auto current_head = _head.load(std::memory_order_relaxed);
+  if(!hasItem(current_head))
+    return false;   // empty queue
+
+  item = std::move(_array[current_head]);
+  // Ugly but this will call the destructor of the popped object
+  // and provide a valid object to be destructed when the _array
+  // destructor will be called
+  _array[current_head] = Element();
+  _head.store(increment(current_head), std::memory_order_release);
+  return true;
+}
+
+// Pop a batch, the head is published only once
+template<typename Element, size_t Size>
+size_t CircularFifo<Element, Size>::pop(Element* items, size_t maxCount)
+{
+  const auto slots = peek(maxCount);
+  auto out = std::move(slots.first.data, slots.first.data + slots.first.size, items);
+  std::move(slots.second.data, slots.second.data + slots.second.size, out);
+  consume(slots.size());
+  return slots.size();
+}
+
+template<typename Element, size_t Size>
+typename CircularFifo<Element, Size>::Range CircularFifo<Element, Size>::reserve(size_t maxCount)
+{
+  const auto current_tail = _tail.load(std::memory_order_relaxed);
+  return range(current_tail, std::min(maxCount, freeSlots(current_tail, maxCount)));
+}
+
+template<typename Element, size_t Size>
+void CircularFifo<Element, Size>::commit(size_t count)
+{
+  const auto current_tail = _tail.load(std::memory_order_relaxed);
+  assert(count <= freeSlots(current_tail, count));
+  _tail.store(advance(current_tail, count), std::memory_order_release);
+}
+
+template<typename Element, size_t Size>
+typename CircularFifo<Element, Size>::Range CircularFifo<Element, Size>::peek(size_t maxCount)
+{
+  const auto current_head = _head.load(std::memory_order_relaxed);
+  return range(current_head, std::min(maxCount, usedSlots(current_head, maxCount)));
+}
+
+template<typename Element, size_t Size>
+void CircularFifo<Element, Size>::consume(size_t count)
+{
+  const auto current_head = _head.load(std::memory_order_relaxed);
+  assert(count <= usedSlots(current_head, count));
+
+  // Same as for pop(), the consumed objects are destructed
+  auto idx = current_head;
+  for (size_t consumed = 0; consumed < count; ++consumed, idx = increment(idx))
+  {
+    _array[idx] = Element();
+  }
+  _head.store(idx, std::memory_order_release);
+}
+
+// snapshot with acceptance of that this comparison function is not atomic
+// (*) Used by clients or test, since pop() avoid double load overhead by not
+// using wasEmpty()
+template<typename Element, size_t Size>
+bool CircularFifo<Element, Size>::wasEmpty() const
+{
+  return (_head.load(std::memory_order_acquire) == _tail.load(std::memory_order_acquire));
+}
+
+// snapshot with acceptance that this comparison is not atomic
+// (*) Used by clients or test, since push() avoid double load overhead by not
+// using wasFull()
+template<typename Element, size_t Size>
+bool CircularFifo<Element, Size>::wasFull() const
+{
+  const auto next_tail = increment(_tail.load(std::memory_order_acquire));
+  return (next_tail == _head.load(std::memory_order_acquire));
+}
+
+
+template<typename Element, size_t Size>
+bool CircularFifo<Element, Size>::isLockFree() const
+{
+  return (_tail.is_lock_free() && _head.is_lock_free());
+}
+
+template<typename Element, size_t Size>
+size_t CircularFifo<Element, Size>::increment(size_t idx) const
+{
+  return (idx + 1) % Capacity;
+}
+
+template<typename Element, size_t Size>
+size_t CircularFifo<Element, Size>::advance(size_t idx, size_t count) const
+{
+  return (idx + count) % Capacity;
+}
+
+// Producer only. The shared head is loaded only when the cached one says the queue is full
+template<typename Element, size_t Size>
+bool CircularFifo<Element, Size>::hasSpace(size_t next_tail)
+{
+  if(next_tail != _cachedHead)
+    return true;
+
+  _cachedHead = _head.load(std::memory_order_acquire);
+  return next_tail != _cachedHead;
+}
+
+// Consumer only. The shared tail is loaded only when the cached one says the queue is empty
+template<typename Element, size_t Size>
+bool CircularFifo<Element, Size>::hasItem(size_t current_head)
+{
+  if(current_head != _cachedTail)
+    return true;
+
+  _cachedTail = _tail.load(std::memory_order_acquire);
+  return current_head != _cachedTail;
+}
+
+// Producer only. The shared head is loaded only when the cached one does not give enough free slots
+template<typename Element, size_t Size>
+size_t CircularFifo<Element, Size>::freeSlots(size_t current_tail, size_t required)
+{
+  auto slots = (_cachedHead + Capacity - current_tail - 1) % Capacity;
+  if(slots < required)
+  {
+    _cachedHead = _head.load(std::memory_order_acquire);
+    slots = (_cachedHead + Capacity - current_tail - 1) % Capacity;
+  }
+
+  return slots;
+}
+
+// Consumer only. The shared tail is loaded only when the cached one does not give enough items
+template<typename Element, size_t Size>
+size_t CircularFifo<Element, Size>::usedSlots(size_t current_head, size_t required)
+{
+  auto slots = (_cachedTail + Capacity - current_head) % Capacity;
+  if(slots < required)
+  {
+    _cachedTail = _tail.load(std::memory_order_acquire);
+    slots = (_cachedTail + Capacity - current_head) % Capacity;
+  }
+
+  return slots;
+}
+
+template<typename Element, size_t Size>
+typename CircularFifo<Element, Size>::Range CircularFifo<Element, Size>::range(size_t idx, size_t count)
+{
+  const auto firstSize = std::min(count, Capacity - idx);
+  return Range{Span{_array + idx, firstSize}, Span{_array, count - firstSize}};
+}
+
+} // memory_relaxed_acquire_release
+#endif /* CIRCULARFIFO_ACQUIRE_RELEASE_H_ */
@@ -1,249 +1,1178 @@
 #include "continuation_task.h"
 
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
 #include <exception>
 #include <mutex>
-#include <queue>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 #include "canceled_exception.h"
 #include "cancellation_source.h"
+#include "fiber.h"
+#include "small_object_pool.h"
 
 namespace
 {
-    class PromiseMethod
+    CancellationToken getDummyToken()
     {
-    public:
-        PromiseMethod();
-        explicit PromiseMethod(ContinuationTask::TaskMethod&& method);
-
-        void operator()() noexcept;
-        ContinuationTask::Future get_future();
-        void cancel();
+        static CancellationSource source;
 
-    private:
-        ContinuationTask::TaskMethod _method;
-        ContinuationTask::Promise _promise;
-    };
+        return source.get_token();
+    }
 
-    PromiseMethod::PromiseMethod()
+    std::exception_ptr canceled()
     {
-        _promise.set_value();
+        return std::make_exception_ptr(CanceledException());
     }
 
-    PromiseMethod::PromiseMethod(ContinuationTask::TaskMethod&& method)
-        : _method(std::move(method))
+    bool sameHints(const TaskHints& left, const TaskHints& right) noexcept
     {
+        return left.affinity == right.affinity && left.tag == right.tag && left.deadline == right.deadline;
     }
 
-    void PromiseMethod::operator()() noexcept
+    // Executes the tasks on the completing thread, used by the continuations only waking a waiting fiber
+    class InlinePool final : public IThreadPool
     {
-        try
+    protected:
+        void scheduleInner(MethodType&& method) override
         {
-            // TODO this works only when the return type is void
-            _method();
-            _promise.set_value();
+            (*method)();
         }
-        catch (...)
-        {
-            _promise.set_exception(std::current_exception());
-        }
-    }
+    };
 
-    ContinuationTask::Future PromiseMethod::get_future()
-    {
-        return _promise.get_future();
-    }
+    // Flags of the task state
+    constexpr std::uint8_t completedFlag{1};
+    constexpr std::uint8_t trackedFlag{2};
+    constexpr std::uint8_t releasedFlag{4};
 
-    void PromiseMethod::cancel()
+    // Release moments of the tracked tasks, kept aside as only a few tasks are tracked
+    struct ReleaseStamps
     {
-        try
-        {
-            throw CanceledException();
-        }
-        catch (...)
-        {
-            _promise.set_exception(std::current_exception());
-        }
-    }
+        std::mutex mtx;
+        std::unordered_map<const void*, std::chrono::steady_clock::time_point> stamps;
+    };
 
-    CancellationToken getDummyToken()
+    ReleaseStamps& releaseStamps()
     {
-        static CancellationSource source;
+        static ReleaseStamps stamps;
 
-        return source.get_token();
+        return stamps;
     }
+
+    // Count of tasks given to a pool at once
+    constexpr std::size_t batchSize{64};
+    // Wider fan-outs are released in parallel, the second half by a task of its own
+    constexpr std::size_t splitThreshold{1024};
 }
 
+// The state of a task is kept small, a deep or wide graph of pending continuations costs one allocation per task:
+// - the children are an intrusive lock-free stack, the stack is closed by a sentinel once the task is completed
+// - a child does not reference its parent, the parent owns its children only till it is completed
+// - the promise and the future are allocated only when the future is requested
 class ContinuationTask::Impl final
 {
-private:
-    using MethodContainer = std::queue<std::shared_ptr<Impl>>;
-
 public:
-    Impl(IThreadPool& thPool, CancellationToken&& cancellation);
-    Impl(IThreadPool& thPool, TaskMethod&& method, CancellationToken&& cancellation);
-    Impl(std::shared_ptr<Impl> parent, TaskMethod&& method);
+    /// Owning reference of a task.
+    class Ref final
+    {
+    public:
+        explicit Ref(Impl& impl) noexcept;
+        Ref(const Ref& other) noexcept;
+        Ref(Ref&& other) noexcept;
+        Ref& operator=(const Ref&) = delete;
+        ~Ref();
+
+        Impl* operator->() const noexcept;
+
+    private:
+        Impl* _impl;
+    };
 
-    static void scheduleNow(std::shared_ptr<ContinuationTask::Impl> task);
+    /// Tasks ready to be scheduled linked by _sibling, the list holds a reference of each.
+    class ReadyList final
+    {
+    public:
+        ReadyList() noexcept;
+        ReadyList(ReadyList&& other) noexcept;
+        ReadyList& operator=(ReadyList&& other) = delete;
+        /// Releases the not scheduled tasks, e.g. when a release task is destroyed by a stopped pool.
+        ~ReadyList();
 
-    ContinuationTask continue_with(std::shared_ptr<Impl> parent, TaskMethod&& method);
-    void schedule(std::shared_ptr<Impl>& task);
+        bool empty() const noexcept;
+        std::size_t size() const noexcept;
+        Impl* front() const noexcept;
+        /// The caller takes over the reference.
+        Impl* pop_front() noexcept;
+        /// Takes over the reference.
+        void push_front(Impl* task) noexcept;
+        void prepend(ReadyList&& other) noexcept;
+        /// @returns The second half of the list.
+        ReadyList split() noexcept;
+
+    private:
+        Impl* _head;
+        Impl* _tail;
+        std::size_t _size;
+    };
+
+    /// Creates a completed task, the cancellation is relevant only for children.
+    Impl(IThreadPool& thPool, const CancellationToken& cancellation);
+    Impl(IThreadPool& thPool, TaskMethod&& method, const CancellationToken& cancellation);
+    ~Impl();
+
+    Impl(const Impl&) = delete;
+    Impl& operator=(const Impl&) = delete;
+
+    // A task is created for every continuation, its memory is recycled
+    static void* operator new(std::size_t size);
+    static void operator delete(void* ptr, std::size_t size) noexcept;
+
+    void acquire() noexcept;
+    void release() noexcept;
+
+    static void scheduleNow(Impl& task);
+    static void start(Impl& task);
+
+    void defer();
+    void setHints(const TaskHints& hints) noexcept;
+    bool trackRelease() noexcept;
+    /// The task is considered released without passing the pool, e.g. the task completed explicitly.
+    void setReleased() noexcept;
+    std::chrono::steady_clock::time_point releasedAt() const noexcept;
+
+    ContinuationTask continue_with(TaskMethod&& method);
+    ContinuationTask continue_with(IThreadPool& thPool, TaskMethod&& method);
+    ContinuationTask continue_with(const TaskHints& hints, TaskMethod&& method);
+    ContinuationTask continue_with(OutcomeTaskMethod&& method);
+    ContinuationTask continue_with(IThreadPool& thPool, OutcomeTaskMethod&& method);
+    ContinuationTask continue_reading(ResultSlot* input, ResultSlot* result, TaskMethod&& method);
+    /// Takes over the reference of the @p result, the slot lives as long as the task.
+    void adoptResult(ResultSlot* result) noexcept;
+    void complete(std::exception_ptr exception);
     Future& get_future();
+    bool is_ready() const noexcept;
+    std::exception_ptr outcome() const noexcept;
+    /// Wakes the @p fiber once the task is completed, whatever the outcome and the cancellation.
+    void wakeOnCompletion(Fiber& fiber);
 
 private:
-    static void threadMethod(std::shared_ptr<ContinuationTask::Impl> task) noexcept;
-
-    IThreadPool& _thPool;
-    std::shared_ptr<Impl> _parent;
-    PromiseMethod _method;
-    MethodContainer _childs;
-    std::mutex _scheduleLock;
-    Future _future;
+    struct FutureState
+    {
+        FutureState();
+
+        Promise promise;
+        Future future;
+    };
+
+    /// Execution of a task by a pool, the pool holds a reference of the task till the execution finishes.
+    class Run final : public mbind
+    {
+    public:
+        explicit Run(Impl& task) noexcept;
+
+        void operator()() override;
+        /// The task is completed with CanceledException, e.g. when the pool drops it after its deadline.
+        void drop() noexcept override;
+
+    private:
+        Ref _task;
+    };
+
+    static Impl* closedChilds();
+    static FutureState* completedFuture();
+
+    static void threadMethod(Ref task) noexcept;
+    static void releaseMethod(ReadyList ready) noexcept;
+    static std::exception_ptr submit(Impl& task) noexcept;
+    static void submitAll(ReadyList ready) noexcept;
+    static void submitBatch(ReadyList& ready) noexcept;
+    static void spawnRelease(ReadyList ready) noexcept;
+    ContinuationTask adopt(Impl* child);
+    ReadyList publish(std::exception_ptr exception) noexcept;
+    void fulfill(Promise& promise) const;
+
+    std::atomic<std::uint32_t> _references;
+    // completedFlag guards against a second completion of a pending task, for the release flags see trackRelease()
+    std::atomic<std::uint8_t> _state;
+    // The task belongs to a deferred chain which was not started yet, the chain is accessed only by the building thread
+    bool _deferred;
+    // The task is scheduled by its parent
+    bool _continuation;
+    // The task is executed also when its parent fails, it receives the parent outcome
+    bool _receivesOutcome;
+    IThreadPool* _thPool;
+    TaskHints _hints;
+    TaskMethod _method;
+    // Not scheduled children linked by _sibling in LIFO order, each holds a reference, closedChilds() once completed
+    std::atomic<Impl*> _childs;
+    Impl* _sibling;
+    // Outcome of the parent till the task is executed, then outcome of the task valid once the children are closed
+    std::exception_ptr _exception;
+    // Null till requested, completedFuture() if the task was completed before
+    std::atomic<FutureState*> _future;
     CancellationToken _cancellation;
+    // Written by the method, null for tasks without a result
+    ResultSlot* _result;
+    // Slot of the parent read by the method, released once the task is completed
+    ResultSlot* _input;
 };
 
-ContinuationTask::Impl::Impl(IThreadPool& thPool, CancellationToken&& cancellation)
-    : _thPool(thPool)
-    , _parent()
+ContinuationTask::Impl::Ref::Ref(Impl& impl) noexcept
+    : _impl(&impl)
+{
+    _impl->acquire();
+}
+
+ContinuationTask::Impl::Ref::Ref(const Ref& other) noexcept
+    : _impl(other._impl)
+{
+    if (_impl != nullptr)
+        _impl->acquire();
+}
+
+ContinuationTask::Impl::Ref::Ref(Ref&& other) noexcept
+    : _impl(std::exchange(other._impl, nullptr))
+{
+}
+
+ContinuationTask::Impl::Ref::~Ref()
+{
+    if (_impl != nullptr)
+        _impl->release();
+}
+
+ContinuationTask::Impl* ContinuationTask::Impl::Ref::operator->() const noexcept
+{
+    return _impl;
+}
+
+ContinuationTask::Impl::ReadyList::ReadyList() noexcept
+    : _head(nullptr)
+    , _tail(nullptr)
+    , _size{0}
+{
+}
+
+ContinuationTask::Impl::ReadyList::ReadyList(ReadyList&& other) noexcept
+    : _head(std::exchange(other._head, nullptr))
+    , _tail(std::exchange(other._tail, nullptr))
+    , _size{std::exchange(other._size, 0)}
+{
+}
+
+ContinuationTask::Impl::ReadyList::~ReadyList()
+{
+    while (!empty())
+    {
+        pop_front()->release();
+    }
+}
+
+bool ContinuationTask::Impl::ReadyList::empty() const noexcept
+{
+    return _head == nullptr;
+}
+
+std::size_t ContinuationTask::Impl::ReadyList::size() const noexcept
+{
+    return _size;
+}
+
+ContinuationTask::Impl* ContinuationTask::Impl::ReadyList::front() const noexcept
+{
+    return _head;
+}
+
+ContinuationTask::Impl* ContinuationTask::Impl::ReadyList::pop_front() noexcept
+{
+    auto* task = _head;
+    _head = task->_sibling;
+    if (_head == nullptr)
+    {
+        _tail = nullptr;
+    }
+    --_size;
+
+    task->_sibling = nullptr;
+    return task;
+}
+
+void ContinuationTask::Impl::ReadyList::push_front(Impl* task) noexcept
+{
+    task->_sibling = _head;
+    if (_tail == nullptr)
+    {
+        _tail = task;
+    }
+    _head = task;
+    ++_size;
+}
+
+void ContinuationTask::Impl::ReadyList::prepend(ReadyList&& other) noexcept
+{
+    if (other.empty())
+        return;
+
+    other._tail->_sibling = _head;
+    if (_tail == nullptr)
+    {
+        _tail = other._tail;
+    }
+    _head = std::exchange(other._head, nullptr);
+    _size += std::exchange(other._size, 0);
+    other._tail = nullptr;
+}
+
+ContinuationTask::Impl::ReadyList ContinuationTask::Impl::ReadyList::split() noexcept
+{
+    ReadyList half;
+    if (_size < 2)
+        return half;
+
+    const auto kept = _size / 2;
+    auto* last = _head;
+    for (std::size_t idx = 1; idx < kept; ++idx)
+    {
+        last = last->_sibling;
+    }
+
+    half._head = last->_sibling;
+    half._tail = _tail;
+    half._size = _size - kept;
+    last->_sibling = nullptr;
+    _tail = last;
+    _size = kept;
+    return half;
+}
+
+ContinuationTask::Impl::Run::Run(Impl& task) noexcept
+    : _task(task)
+{
+}
+
+void ContinuationTask::Impl::Run::operator()()
+{
+    threadMethod(std::move(_task));
+}
+
+void ContinuationTask::Impl::Run::drop() noexcept
+{
+    submitAll(_task->publish(canceled()));
+}
+
+ContinuationTask::Impl::FutureState::FutureState()
+    : promise()
+    , future(promise.get_future())
+{
+}
+
+ContinuationTask::Impl::Impl(IThreadPool& thPool, const CancellationToken& cancellation)
+    : _references{1}
+    , _state{completedFlag}
+    , _deferred{false}
+    , _continuation{false}
+    , _receivesOutcome{false}
+    , _thPool(&thPool)
+    , _hints()
     , _method()
-    , _future(_method.get_future())
-    , _cancellation(cancellation)  // relevant only for children
+    , _childs{closedChilds()}
+    , _sibling(nullptr)
+    , _exception()
+    , _future{completedFuture()}
+    , _cancellation(cancellation)
+    , _result(nullptr)
+    , _input(nullptr)
 {
 }
 
-ContinuationTask::Impl::Impl(IThreadPool& thPool, TaskMethod&& method, CancellationToken&& cancellation)
-    : _thPool(thPool)
-    , _parent()
+ContinuationTask::Impl::Impl(IThreadPool& thPool, TaskMethod&& method, const CancellationToken& cancellation)
+    : _references{1}
+    , _state{0}
+    , _deferred{false}
+    , _continuation{false}
+    , _receivesOutcome{false}
+    , _thPool(&thPool)
+    , _hints()
     , _method(std::move(method))
-    , _future(_method.get_future())
+    , _childs{nullptr}
+    , _sibling(nullptr)
+    , _exception()
+    , _future{nullptr}
     , _cancellation(cancellation)
+    , _result(nullptr)
+    , _input(nullptr)
 {
 }
 
-ContinuationTask::Impl::Impl(std::shared_ptr<Impl> parent, TaskMethod&& method)
-    : _thPool(parent->_thPool)
-    , _parent(std::move(parent))
-    , _method(std::move(method))
-    , _future(_method.get_future())
-    , _cancellation(_parent->_cancellation)
+void* ContinuationTask::Impl::operator new(std::size_t size)
+{
+    return SmallObjectPool::allocate(size);
+}
+
+void ContinuationTask::Impl::operator delete(void* ptr, std::size_t size) noexcept
 {
+    SmallObjectPool::deallocate(ptr, size);
 }
 
-ContinuationTask ContinuationTask::Impl::continue_with(std::shared_ptr<Impl> parent, TaskMethod&& method)
+ContinuationTask::Impl::~Impl()
 {
-    auto childImpl = std::make_shared<Impl>(std::move(parent), std::move(method));
-    ContinuationTask child(childImpl);
+    if (_state.load(std::memory_order_relaxed) & trackedFlag)
     {
-        std::lock_guard<std::mutex> lk(_scheduleLock);
-        schedule(childImpl);
+        auto& releases = releaseStamps();
+        std::lock_guard<std::mutex> lk(releases.mtx);
+        releases.stamps.erase(this);
     }
 
-    return child;
+    auto* state = _future.load(std::memory_order_relaxed);
+    if (state != nullptr && state != completedFuture())
+    {
+        delete state;
+    }
+
+    if (_result != nullptr)
+        _result->release();
+    if (_input != nullptr)
+        _input->release();
+
+    // Children of a never executed task (e.g. destroyed by a stopped pool or a not started deferred chain)
+    // are released iteratively, a recursion would overflow the stack on long chains
+    auto* pending = _childs.exchange(closedChilds(), std::memory_order_acquire);
+    if (pending == closedChilds())
+        return;
+
+    while (pending != nullptr)
+    {
+        auto* node = pending;
+        pending = node->_sibling;
+
+        if (node->_references.fetch_sub(1, std::memory_order_acq_rel) != 1)
+            continue;
+
+        auto* childs = node->_childs.exchange(closedChilds(), std::memory_order_acquire);
+        if (childs != closedChilds())
+        {
+            while (childs != nullptr)
+            {
+                auto* child = childs;
+                childs = child->_sibling;
+                child->_sibling = pending;
+                pending = child;
+            }
+        }
+
+        delete node;
+    }
 }
 
-void ContinuationTask::Impl::schedule(std::shared_ptr<Impl>& task)
+void ContinuationTask::Impl::acquire() noexcept
 {
-    if (get_future().wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+    _references.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ContinuationTask::Impl::release() noexcept
+{
+    if (_references.fetch_sub(1, std::memory_order_acq_rel) == 1)
     {
-        scheduleNow(task);
+        delete this;
     }
-    else
+}
+
+ContinuationTask::Impl* ContinuationTask::Impl::closedChilds()
+{
+    // Only compared, never dereferenced
+    return reinterpret_cast<Impl*>(std::uintptr_t{1});
+}
+
+ContinuationTask::Impl::FutureState* ContinuationTask::Impl::completedFuture()
+{
+    // Only compared, never dereferenced
+    return reinterpret_cast<FutureState*>(std::uintptr_t{1});
+}
+
+ContinuationTask ContinuationTask::Impl::continue_with(TaskMethod&& method)
+{
+    return continue_with(*_thPool, std::move(method));
+}
+
+ContinuationTask ContinuationTask::Impl::continue_with(const TaskHints& hints, TaskMethod&& method)
+{
+    auto* child = new Impl(*_thPool, std::move(method), _cancellation);
+    child->setHints(hints);
+    return adopt(child);
+}
+
+ContinuationTask ContinuationTask::Impl::continue_with(OutcomeTaskMethod&& method)
+{
+    return continue_with(*_thPool, std::move(method));
+}
+
+ContinuationTask ContinuationTask::Impl::continue_with(IThreadPool& thPool, OutcomeTaskMethod&& method)
+{
+    // The parent outcome is handed over in the _exception of the child, it is taken before the child runs
+    auto* child = new Impl(thPool, TaskMethod(), _cancellation);
+    child->_method = [method = std::move(method), outcome = &child->_exception]() { method(std::move(*outcome)); };
+    child->_receivesOutcome = true;
+    return adopt(child);
+}
+
+ContinuationTask ContinuationTask::Impl::continue_with(IThreadPool& thPool, TaskMethod&& method)
+{
+    return adopt(new Impl(thPool, std::move(method), _cancellation));
+}
+
+ContinuationTask ContinuationTask::Impl::continue_reading(ResultSlot* input, ResultSlot* result, TaskMethod&& method)
+{
+    Impl* child;
+    try
+    {
+        child = new Impl(*_thPool, std::move(method), _cancellation);
+    }
+    catch (...)
+    {
+        if (result != nullptr)
+            result->release();
+        throw;
+    }
+
+    // The parent may be gone before the child runs, the child keeps only the slot it reads
+    if (input != nullptr)
+    {
+        input->acquire();
+        child->_input = input;
+    }
+    child->adoptResult(result);
+    return adopt(child);
+}
+
+void ContinuationTask::Impl::adoptResult(ResultSlot* result) noexcept
+{
+    _result = result;
+}
+
+ContinuationTask ContinuationTask::Impl::adopt(Impl* child)
+{
+    child->_continuation = true;
+    child->_deferred = _deferred;
+    ContinuationTask task(child);
+
+    // The reference held by the parent
+    child->acquire();
+    if (_deferred)
     {
-        _childs.push(task);
+        // Nothing is running, so the child can be added without synchronization
+        child->_sibling = _childs.load(std::memory_order_relaxed);
+        _childs.store(child, std::memory_order_relaxed);
+        return task;
     }
+
+    auto* head = _childs.load(std::memory_order_acquire);
+    do
+    {
+        if (head == closedChilds())
+        {
+            // The parent is completed, the reference is given to the list of ready tasks
+            child->_exception = _exception;
+            ReadyList ready;
+            ready.push_front(child);
+            submitAll(std::move(ready));
+            return task;
+        }
+
+        child->_sibling = head;
+    } while (!_childs.compare_exchange_weak(head, child, std::memory_order_release, std::memory_order_acquire));
+
+    return task;
+}
+
+void ContinuationTask::Impl::complete(std::exception_ptr exception)
+{
+    if (_state.fetch_or(completedFlag, std::memory_order_relaxed) & completedFlag)
+        throw std::future_error(std::future_errc::promise_already_satisfied);
+
+    submitAll(publish(std::move(exception)));
 }
 
 ContinuationTask::Future& ContinuationTask::Impl::get_future()
 {
-    return _future;
+    auto* state = _future.load(std::memory_order_acquire);
+    if (state != nullptr && state != completedFuture())
+        return state->future;
+
+    auto created = std::make_unique<FutureState>();
+    if (state == nullptr)
+    {
+        if (_future.compare_exchange_strong(state, created.get(), std::memory_order_acq_rel, std::memory_order_acquire))
+            return created.release()->future;
+
+        // Requested concurrently by another thread
+        if (state != completedFuture())
+            return state->future;
+    }
+
+    // The task is already completed, the new promise is fulfilled before it is published
+    fulfill(created->promise);
+    if (_future.compare_exchange_strong(state, created.get(), std::memory_order_acq_rel, std::memory_order_acquire))
+        return created.release()->future;
+
+    return state->future;
 }
 
-void ContinuationTask::Impl::scheduleNow(std::shared_ptr<ContinuationTask::Impl> task)
+bool ContinuationTask::Impl::is_ready() const noexcept
 {
+    return _childs.load(std::memory_order_acquire) == closedChilds();
+}
+
+std::exception_ptr ContinuationTask::Impl::outcome() const noexcept
+{
+    return _exception;
+}
+
+void ContinuationTask::Impl::wakeOnCompletion(Fiber& fiber)
+{
+    static InlinePool inlinePool;
+
+    // The waking only queues the fiber to its thread, it is not worth a round trip through a pool
+    auto* child = new Impl(inlinePool, [&fiber]() { fiber.wake(); }, _dummyToken);
+    child->_receivesOutcome = true;
+    adopt(child);
+}
+
+void ContinuationTask::Impl::scheduleNow(Impl& task)
+{
+    // The reference is given to the list of ready tasks
+    task.acquire();
+    ReadyList ready;
+    ready.push_front(&task);
+    submitAll(std::move(ready));
+}
+
+void ContinuationTask::Impl::start(Impl& task)
+{
+    // Children of a deferred task are started by their parent, started here they would run twice
+    if (!task._deferred || task._continuation)
+        return;
+
+    // The whole chain leaves the deferred state before anything is running, from now on it is synchronized
+    std::vector<Impl*> chain{&task};
+    while (!chain.empty())
+    {
+        auto* node = chain.back();
+        chain.pop_back();
+
+        node->_deferred = false;
+        for (auto* child = node->_childs.load(std::memory_order_relaxed); child != nullptr; child = child->_sibling)
+        {
+            chain.push_back(child);
+        }
+    }
+
+    scheduleNow(task);
+}
+
+void ContinuationTask::Impl::setHints(const TaskHints& hints) noexcept
+{
+    _hints = hints;
+}
+
+bool ContinuationTask::Impl::trackRelease() noexcept
+{
+    auto state = _state.load(std::memory_order_relaxed);
+    do
+    {
+        if (state & releasedFlag)
+            return false;
+    } while (!_state.compare_exchange_weak(state, state | trackedFlag, std::memory_order_relaxed));
+
+    return true;
+}
+
+void ContinuationTask::Impl::setReleased() noexcept
+{
+    _state.fetch_or(releasedFlag, std::memory_order_relaxed);
+}
+
+std::chrono::steady_clock::time_point ContinuationTask::Impl::releasedAt() const noexcept
+{
+    if ((_state.load(std::memory_order_relaxed) & (trackedFlag | releasedFlag)) != (trackedFlag | releasedFlag))
+        return std::chrono::steady_clock::time_point();
+
+    // The releasing thread may not have recorded the moment yet
+    auto& releases = releaseStamps();
+    std::lock_guard<std::mutex> lk(releases.mtx);
+    const auto stamp = releases.stamps.find(this);
+    return stamp != releases.stamps.end() ? stamp->second : std::chrono::steady_clock::time_point();
+}
+
+void ContinuationTask::Impl::defer()
+{
+    _deferred = true;
+}
+
+void ContinuationTask::Impl::threadMethod(Ref task) noexcept
+{
+    std::exception_ptr exception;
     if (task->_cancellation.is_canceled())
     {
-        task->_method.cancel();
+        exception = canceled();
     }
     else
     {
-        auto& thPool = task->_thPool;
-        // Someone needs to hold the task instance till the threadMethod finishes
-        // so the shared_ptr<Impl> is given as argument
-        thPool.schedule(&ContinuationTask::Impl::threadMethod, std::move(task));
+        // The captures of the method do not live as long as the task
+        auto method = std::move(task->_method);
+        task->_method = nullptr;
+        try
+        {
+            // TODO this works only when the return type is void
+            // A task receiving the outcome takes the parent's exception, other tasks run only after a successful parent
+            method();
+        }
+        catch (...)
+        {
+            exception = std::current_exception();
+        }
     }
+
+    submitAll(task->publish(std::move(exception)));
+}
+
+void ContinuationTask::Impl::releaseMethod(ReadyList ready) noexcept
+{
+    submitAll(std::move(ready));
 }
 
-void ContinuationTask::Impl::threadMethod(std::shared_ptr<ContinuationTask::Impl> task) noexcept
+std::exception_ptr ContinuationTask::Impl::submit(Impl& task) noexcept
 {
+    if (task._cancellation.is_canceled())
+        return canceled();
+
     try
     {
-        auto method = std::move(*task)._method;
+        // The pool holds a reference till the threadMethod finishes,
+        // it could refuse the task (e.g. QueueFullException) and destroy the argument.
+        IThreadPool::MethodType method(new Run(task));
+        task._thPool->schedule_batch(&method, 1, task._hints);
+        return nullptr;
+    }
+    catch (...)
+    {
+        return std::current_exception();
+    }
+}
 
-        // TODO will provide a result of the previous task, if the parent is canceled, than an exception will be stored as the future result
-        task->_parent.reset();
+void ContinuationTask::Impl::submitAll(ReadyList ready) noexcept
+{
+    while (!ready.empty())
+    {
+        if (ready.size() > splitThreshold)
+        {
+            // Released before the first half is submitted, so an idle worker picks it up meanwhile
+            spawnRelease(ready.split());
+        }
+
+        submitBatch(ready);
+    }
+}
+
+void ContinuationTask::Impl::submitBatch(ReadyList& ready) noexcept
+{
+    // Tasks which cannot be scheduled are completed here, their children are processed by the loop of submitAll
+    // instead of a recursion, so a canceled long chain does not overflow the stack
+    std::array<IThreadPool::MethodType, batchSize> methods;
+    std::array<Impl*, batchSize> tasks;
+    std::size_t count{0};
+    IThreadPool* thPool = nullptr;
+    TaskHints hints;
+
+    // A batch is formed by the leading tasks of the same pool and hints, the pool applies the hints to the whole batch
+    while (count < batchSize && !ready.empty()
+           && (thPool == nullptr || (ready.front()->_thPool == thPool && sameHints(ready.front()->_hints, hints))))
+    {
+        auto* task = ready.pop_front();
+        // Every released task passes here, whether it is executed or only completed
+        if ((task->_state.fetch_or(releasedFlag, std::memory_order_relaxed) & (trackedFlag | releasedFlag)) == trackedFlag)
+        {
+            auto& releases = releaseStamps();
+            const auto now = std::chrono::steady_clock::now();
+            std::lock_guard<std::mutex> lk(releases.mtx);
+            releases.stamps[task] = now;
+        }
 
-        if (task->_cancellation.is_canceled())
+        std::exception_ptr failure;
+        if (task->_exception && !task->_receivesOutcome)
         {
-            method.cancel();
+            // The parent failed, the failure is propagated without executing the task
+            failure = std::move(task->_exception);
+        }
+        else if (task->_cancellation.is_canceled())
+        {
+            failure = canceled();
         }
         else
         {
-            method();
+            try
+            {
+                // The pool holds a reference till the threadMethod finishes
+                methods[count].reset(new Run(*task));
+                tasks[count] = task;
+                thPool = task->_thPool;
+                hints = task->_hints;
+                ++count;
+                continue;
+            }
+            catch (...)
+            {
+                failure = std::current_exception();
+            }
         }
 
+        // The task will never be executed, the reason is reported through its future
+        ready.prepend(task->publish(std::move(failure)));
+        task->release();
+    }
+
+    if (count == 0)
+        return;
+
+    try
+    {
+        thPool->schedule_batch(methods.data(), count, hints);
+    }
+    catch (...)
+    {
+        // The first not taken task is the refused one, the rest was not tried and is submitted one by one
+        const auto refusal = std::current_exception();
+        bool refused{false};
+        for (std::size_t idx = 0; idx < count; ++idx)
         {
-            std::lock_guard<std::mutex> lk(task->_scheduleLock);
-            while (!task->_childs.empty())
+            if (!methods[idx])
+                continue;
+
+            methods[idx].reset();
+            auto failure = refused ? submit(*tasks[idx]) : refusal;
+            refused = true;
+            if (failure)
             {
-                task->scheduleNow(std::move(task->_childs.front()));
-                task->_childs.pop();
+                ready.prepend(tasks[idx]->publish(std::move(failure)));
             }
         }
     }
+
+    // The references of the ready list
+    for (std::size_t idx = 0; idx < count; ++idx)
+    {
+        tasks[idx]->release();
+    }
+}
+
+void ContinuationTask::Impl::spawnRelease(ReadyList ready) noexcept
+{
+    auto& thPool = *ready.front()->_thPool;
+    IThreadPool::MethodType method;
+    try
+    {
+        method = Bind::bind(&ContinuationTask::Impl::releaseMethod, std::move(ready));
+        thPool.schedule_batch(&method, 1);
+    }
     catch (...)
     {
-        // TODO
-        // What if the exception belongs to the future, i.e. is of std::future_error type?
-        // Moreover the promise value could be already set, so it is illegal to set also the exception
+        // A refused release task is executed on the caller, the tasks are then refused one by one
+        if (method)
+        {
+            (*method)();
+        }
+        else
+        {
+            submitAll(std::move(ready));
+        }
+    }
+}
+
+ContinuationTask::Impl::ReadyList ContinuationTask::Impl::publish(std::exception_ptr exception) noexcept
+{
+    _exception = std::move(exception);
+    if (_input != nullptr)
+    {
+        // The method has already been executed or never will be
+        std::exchange(_input, nullptr)->release();
+    }
+
+    auto* state = _future.load(std::memory_order_acquire);
+    while (state == nullptr
+           && !_future.compare_exchange_weak(state, completedFuture(), std::memory_order_acq_rel, std::memory_order_acquire))
+    {
+    }
+    if (state != nullptr)
+    {
+        fulfill(state->promise);
+    }
+
+    // The whole stack is detached at once, the children are released in FIFO order, the order in which they were added
+    auto* childs = _childs.exchange(closedChilds(), std::memory_order_acq_rel);
+    ReadyList ready;
+    while (childs != nullptr)
+    {
+        auto* child = childs;
+        childs = child->_sibling;
+        child->_exception = _exception;
+        ready.push_front(child);
+    }
 
-        // TODO handle exceptions -> does a possible exception belong to the
-        // methods promise?
-        //
-        //_promise.set_exception(std::current_exception());
+    return ready;
+}
+
+void ContinuationTask::Impl::fulfill(Promise& promise) const
+{
+    if (_exception)
+    {
+        promise.set_exception(_exception);
+    }
+    else
+    {
+        promise.set_value();
     }
 }
 
 CancellationToken ContinuationTask::_dummyToken = getDummyToken();
 
+ContinuationTask::ResultSlot::ResultSlot() noexcept
+    : _references{1}
+{
+}
+
+void* ContinuationTask::ResultSlot::operator new(std::size_t size)
+{
+    return SmallObjectPool::allocate(size);
+}
+
+void ContinuationTask::ResultSlot::operator delete(void* ptr, std::size_t size) noexcept
+{
+    SmallObjectPool::deallocate(ptr, size);
+}
+
+void ContinuationTask::ResultSlot::acquire() noexcept
+{
+    _references.fetch_add(1, std::memory_order_relaxed);
+}
+
+void ContinuationTask::ResultSlot::release() noexcept
+{
+    if (_references.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        delete this;
+    }
+}
+
 ContinuationTask::ContinuationTask(IThreadPool& thPool, CancellationToken cancellation /* = _dummyToken*/)
-    : _pImpl(std::make_shared<Impl>(thPool, std::move(cancellation)))
+    : _pImpl(new Impl(thPool, cancellation))
 {
 }
 
 ContinuationTask::ContinuationTask(IThreadPool& thPool, TaskMethod&& method, CancellationToken cancellation /* = _dummyToken*/)
-    : _pImpl(std::make_shared<Impl>(thPool, std::move(method), std::move(cancellation)))
+    : _pImpl(new Impl(thPool, std::move(method), cancellation))
 {
-    // OPEN or inherit Impl class from std::enable_shared_from_this
-    Impl::scheduleNow(_pImpl);
+    Impl::scheduleNow(*_pImpl);
+}
+
+ContinuationTask::ContinuationTask(IThreadPool& thPool, const TaskHints& hints, TaskMethod&& method, CancellationToken cancellation /* = _dummyToken*/)
+    : _pImpl(new Impl(thPool, std::move(method), cancellation))
+{
+    _pImpl->setHints(hints);
+    Impl::scheduleNow(*_pImpl);
 }
 
 ContinuationTask::ContinuationTask(IThreadPool& thPool, CancelableTaskMethod&& method, CancellationToken cancellation /* = _dummyToken*/)
-    : _pImpl(std::make_shared<Impl>(thPool, std::bind(std::move(method), cancellation), std::move(cancellation)))
+    : _pImpl(new Impl(thPool, std::bind(std::move(method), cancellation), cancellation))
 {
-    // OPEN or inherit Impl class from std::enable_shared_from_this
-    Impl::scheduleNow(_pImpl);
+    Impl::scheduleNow(*_pImpl);
 }
 
-ContinuationTask::ContinuationTask(std::shared_ptr<Impl> sharedState)
-    : _pImpl(std::move(sharedState))
+ContinuationTask::ContinuationTask(IThreadPool& thPool, TaskMethod&& method, ResultSlot* result, CancellationToken cancellation)
+    : _pImpl(nullptr)
+{
+    try
+    {
+        _pImpl = new Impl(thPool, std::move(method), cancellation);
+    }
+    catch (...)
+    {
+        result->release();
+        throw;
+    }
+
+    _pImpl->adoptResult(result);
+    Impl::scheduleNow(*_pImpl);
+}
+
+ContinuationTask::ContinuationTask(Impl* impl) noexcept
+    : _pImpl(impl)
 {
     // Scheduling will be done by the caller
 }
 
+ContinuationTask::ContinuationTask(const ContinuationTask& other) noexcept
+    : _pImpl(other._pImpl)
+{
+    if (_pImpl != nullptr)
+        _pImpl->acquire();
+}
+
+ContinuationTask::ContinuationTask(ContinuationTask&& other) noexcept
+    : _pImpl(std::exchange(other._pImpl, nullptr))
+{
+}
+
+ContinuationTask& ContinuationTask::operator=(const ContinuationTask& other) noexcept
+{
+    if (other._pImpl != nullptr)
+        other._pImpl->acquire();
+    if (_pImpl != nullptr)
+        _pImpl->release();
+    _pImpl = other._pImpl;
+    return *this;
+}
+
+ContinuationTask& ContinuationTask::operator=(ContinuationTask&& other) noexcept
+{
+    if (this != &other)
+    {
+        if (_pImpl != nullptr)
+            _pImpl->release();
+        _pImpl = std::exchange(other._pImpl, nullptr);
+    }
+    return *this;
+}
+
+ContinuationTask::~ContinuationTask()
+{
+    if (_pImpl != nullptr)
+        _pImpl->release();
+}
+
+ContinuationTask ContinuationTask::deferred(IThreadPool& thPool, TaskMethod&& method, CancellationToken cancellation /* = _dummyToken*/)
+{
+    auto* impl = new Impl(thPool, std::move(method), cancellation);
+    impl->defer();
+    return ContinuationTask(impl);
+}
+
+ContinuationTask ContinuationTask::deferred(IThreadPool& thPool, CancelableTaskMethod&& method, CancellationToken cancellation /* = _dummyToken*/)
+{
+    return deferred(thPool, TaskMethod(std::bind(std::move(method), cancellation)), std::move(cancellation));
+}
+
+void ContinuationTask::start()
+{
+    Impl::start(*_pImpl);
+}
+
+ContinuationTask ContinuationTask::pending(IThreadPool& thPool, CancellationToken cancellation)
+{
+    // The method is never executed, the task is completed by ContinuationTask::complete
+    auto* impl = new Impl(thPool, TaskMethod(), cancellation);
+    // It waits for its completion from the start, as a released task
+    impl->setReleased();
+    return ContinuationTask(impl);
+}
+
+void ContinuationTask::complete(std::exception_ptr exception)
+{
+    _pImpl->complete(std::move(exception));
+}
+
+ContinuationTask ContinuationTask::continue_reading(ResultSlot* input, ResultSlot* result, TaskMethod&& method)
+{
+    return _pImpl->continue_reading(input, result, std::move(method));
+}
+
+std::exception_ptr ContinuationTask::outcome() const noexcept
+{
+    return _pImpl->outcome();
+}
+
 ContinuationTask ContinuationTask::continue_with(TaskMethod&& method)
 {
-    return _pImpl->continue_with(_pImpl, std::move(method));
+    return _pImpl->continue_with(std::move(method));
+}
+
+ContinuationTask ContinuationTask::continue_with(IThreadPool& thPool, TaskMethod&& method)
+{
+    return _pImpl->continue_with(thPool, std::move(method));
+}
+
+ContinuationTask ContinuationTask::continue_with(const TaskHints& hints, TaskMethod&& method)
+{
+    return _pImpl->continue_with(hints, std::move(method));
+}
+
+ContinuationTask ContinuationTask::continue_with(OutcomeTaskMethod&& method)
+{
+    return _pImpl->continue_with(std::move(method));
+}
+
+ContinuationTask ContinuationTask::continue_with(IThreadPool& thPool, OutcomeTaskMethod&& method)
+{
+    return _pImpl->continue_with(thPool, std::move(method));
 }
 
 ContinuationTask::Future& ContinuationTask::get_future()
 {
     return _pImpl->get_future();
 }
+
+bool ContinuationTask::is_ready() const noexcept
+{
+    return _pImpl->is_ready();
+}
+
+bool ContinuationTask::track_release() const noexcept
+{
+    return _pImpl->trackRelease();
+}
+
+std::chrono::steady_clock::time_point ContinuationTask::released_at() const noexcept
+{
+    return _pImpl->releasedAt();
+}
+
+void ContinuationTask::wait() const
+{
+    if (!is_ready())
+    {
+        // The awaited task could be held back by this thread, e.g. coalesced by its pool
+        IThreadPool::before_blocking();
+    }
+
+    // A fiber handling an exception is not switched, the thread keeps the handled exceptions of all its fibers
+    if (!is_ready() && Fiber::current() != nullptr && !std::current_exception())
+    {
+        struct Waiting
+        {
+            Impl* task;
+            Fiber* fiber;
+        } waiting{_pImpl, Fiber::current()};
+
+        // The fiber is registered once it is switched out, so the completion cannot resume it before
+        Fiber::suspend(
+            [](void* argument) {
+                auto& waiting = *static_cast<Waiting*>(argument);
+                try
+                {
+                    waiting.task->wakeOnCompletion(*waiting.fiber);
+                }
+                catch (...)
+                {
+                    // Not registered, the fiber continues right away and blocks its thread below
+                    waiting.fiber->wake();
+                }
+            },
+            &waiting);
+    }
+
+    if (!is_ready())
+    {
+        _pImpl->get_future().wait();
+    }
+}
@@ -1,5 +1,7 @@
 #pragma once
 
+#include <atomic>
+#include <cstdint>
 #include <future>
 #include <memory>
 #include "IThreadPool.h"
@@ -7,15 +9,43 @@
 
 class ContinuationTask final
 {
+    friend class TaskCompletionSource;
+    template <typename T>
+    friend class ValueTask;
+
 private:
     class Impl;
 
 public:
     using TaskMethod = std::function<void()>;
     using CancelableTaskMethod = std::function<TaskMethod::result_type(CancellationToken)>;
+    /// Continuation receiving the outcome of its parent, null when the parent succeeded.
+    using OutcomeTaskMethod = std::function<TaskMethod::result_type(std::exception_ptr)>;
     using Future = std::future<TaskMethod::result_type>;
     using Promise = std::promise<TaskMethod::result_type>;
 
+    /// Result of a task written once by the task and then only read, see ValueTask.
+    /// The slot is reference counted apart from the tasks, so a reading child does not keep its parent alive.
+    class ResultSlot
+    {
+    public:
+        ResultSlot() noexcept;
+        virtual ~ResultSlot() = default;
+
+        ResultSlot(const ResultSlot&) = delete;
+        ResultSlot& operator=(const ResultSlot&) = delete;
+
+        // A slot is created for every task with a result, its memory is recycled
+        static void* operator new(std::size_t size);
+        static void operator delete(void* ptr, std::size_t size) noexcept;
+
+        void acquire() noexcept;
+        void release() noexcept;
+
+    private:
+        std::atomic<std::uint32_t> _references;
+    };
+
     /**
      * Creates a new instance with a fulfilled future.
      * @param thPool thread pool to be used for task scheduling
@@ -32,9 +62,21 @@ public:
      * @param cancellation token for canceling this task
      * @note The @p thPool instance needs to stay alive as long as this instance and all instances created by the
      * ContinuationTask::continue_with(TaskMethod&&) method are alive.
+     * @note If the @p thPool refuses the task (e.g. with QueueFullException) the exception is stored in the future.
      */
     ContinuationTask(IThreadPool& thPool, TaskMethod&& method, CancellationToken cancellation = _dummyToken);
 
+    /**
+     * Creates a new instance placed by the @p hints.
+     * @param thPool thread pool to be used for task scheduling
+     * @param hints placement of the task, e.g. its deadline or its tag
+     * @param method task to be executed on the thread pool
+     * @param cancellation token for canceling this task
+     * @note The hints are not inherited by the continuations, see ContinuationTask::continue_with(const TaskHints&, TaskMethod&&).
+     * @see ContinuationTask::ContinuationTask(IThreadPool&, TaskMethod&&, CancellationToken)
+     */
+    ContinuationTask(IThreadPool& thPool, const TaskHints& hints, TaskMethod&& method, CancellationToken cancellation = _dummyToken);
+
     /**
      * Creates a new instance.
      * @param thPool thread pool to be used for task scheduling
@@ -42,27 +84,144 @@ public:
      * @param cancellation token for canceling this task
      * @note The @p thPool instance needs to stay alive as long as this instance and all instances created by the
      * ContinuationTask::continue_with(TaskMethod&&) method are alive.
+     * @note If the @p thPool refuses the task (e.g. with QueueFullException) the exception is stored in the future.
      */
     ContinuationTask(IThreadPool& thPool, CancelableTaskMethod&& method, CancellationToken cancellation = _dummyToken);
 
+    /**
+     * Creates a new instance which is not scheduled till ContinuationTask::start() is called.
+     * Continuations of a not started deferred task are deferred too. A whole chain can be built without any
+     * synchronization and it is submitted by a single ContinuationTask::start() call on its root.
+     * @param thPool thread pool to be used for task scheduling
+     * @param method task to be executed on the thread pool
+     * @param cancellation token for canceling this task
+     * @note The chain needs to be built and started by one thread, after the start it behaves as a not deferred one.
+     * @note The @p thPool instance needs to stay alive as long as this instance and all instances created by the
+     * ContinuationTask::continue_with(TaskMethod&&) method are alive.
+     */
+    static ContinuationTask deferred(IThreadPool& thPool, TaskMethod&& method, CancellationToken cancellation = _dummyToken);
+
+    /**
+     * Creates a new instance which is not scheduled till ContinuationTask::start() is called.
+     * @see ContinuationTask::deferred(IThreadPool&, TaskMethod&&, CancellationToken)
+     */
+    static ContinuationTask deferred(IThreadPool& thPool, CancelableTaskMethod&& method, CancellationToken cancellation = _dummyToken);
+
+    ContinuationTask(const ContinuationTask& other) noexcept;
+    ContinuationTask(ContinuationTask&& other) noexcept;
+    ContinuationTask& operator=(const ContinuationTask& other) noexcept;
+    ContinuationTask& operator=(ContinuationTask&& other) noexcept;
+    ~ContinuationTask();
+
 private:
-    ContinuationTask(std::shared_ptr<Impl> sharedState);
+    /// Adopts one reference of the @p impl.
+    explicit ContinuationTask(Impl* impl) noexcept;
+
+    /// Creates a task which is completed by ContinuationTask::complete(std::exception_ptr) instead of a method.
+    static ContinuationTask pending(IThreadPool& thPool, CancellationToken cancellation);
+    /// Completes a task created by ContinuationTask::pending, @p exception is null for a successful completion.
+    void complete(std::exception_ptr exception);
+
+    /// Creates a task writing the @p result, the task adopts one reference of the @p result.
+    ContinuationTask(IThreadPool& thPool, TaskMethod&& method, ResultSlot* result, CancellationToken cancellation);
+    /**
+     * Schedules a new task reading the @p input of this task after the task is finished.
+     * @param input slot written by this task or null, the new task holds a reference of it till it is completed
+     * @param result slot written by the new task or null, the new task adopts one reference of it
+     * @see ContinuationTask::continue_with(TaskMethod&&)
+     */
+    ContinuationTask continue_reading(ResultSlot* input, ResultSlot* result, TaskMethod&& method);
+    /// @returns The exception of the completed task, null if it succeeded.
+    std::exception_ptr outcome() const noexcept;
 
 public:
     /**
      * Schedules a new task for execution after the task represented by this instance is finished.
      * @param method task to be executed on the thread pool
      * @returns A new continuation instance representing the new task.
+     * @note If the task represented by this instance fails or is canceled, the new task is not executed and its future
+     * stores the same exception. The failure propagates through the whole chain without using the thread pool.
+     * @note If the thread pool refuses the task (e.g. with QueueFullException) the exception is stored in the future.
      */
     ContinuationTask continue_with(TaskMethod&& method);
 
+    /**
+     * Schedules a new task for execution after the task represented by this instance is finished, successfully or not.
+     * @param method task to be executed on the thread pool, it receives the exception of this task or null on success
+     * @returns A new continuation instance representing the new task.
+     * @note The new task fails only if the @p method throws, it can e.g. rethrow the received exception.
+     * @note If the thread pool refuses the task (e.g. with QueueFullException) the exception is stored in the future.
+     */
+    ContinuationTask continue_with(OutcomeTaskMethod&& method);
+
+    /**
+     * Schedules a new task for execution on another thread pool after the task represented by this instance is finished.
+     * @param thPool thread pool to be used for the new task, continuations of the new task inherit it
+     * @param method task to be executed on the @p thPool
+     * @returns A new continuation instance representing the new task.
+     * @note The @p thPool instance needs to stay alive as long as the new instance and all instances created by its
+     * ContinuationTask::continue_with(TaskMethod&&) method are alive.
+     * @note If the thread pool refuses the task (e.g. with QueueFullException) the exception is stored in the future.
+     */
+    ContinuationTask continue_with(IThreadPool& thPool, TaskMethod&& method);
+
+    /**
+     * Schedules a new task for execution after the task represented by this instance is finished.
+     * @param hints placement of the new task, e.g. the affinity key of the data it works on or its deadline
+     * @param method task to be executed on the thread pool
+     * @returns A new continuation instance representing the new task.
+     * @note Without hints a pool with workers keeps the continuation on the worker completing this task.
+     * @see ContinuationTask::continue_with(TaskMethod&&)
+     */
+    ContinuationTask continue_with(const TaskHints& hints, TaskMethod&& method);
+
+    /**
+     * Schedules a new task for execution on another thread pool after the task represented by this instance is finished,
+     * successfully or not.
+     * @see ContinuationTask::continue_with(IThreadPool&, TaskMethod&&)
+     * @see ContinuationTask::continue_with(OutcomeTaskMethod&&)
+     */
+    ContinuationTask continue_with(IThreadPool& thPool, OutcomeTaskMethod&& method);
+
+    /**
+     * Schedules a task created by ContinuationTask::deferred and the whole chain built on it.
+     * @note Has no effect for tasks which are not deferred or are already started.
+     * @note Needs to be called on the root of the chain, the continuations are started by their parent, calling it on
+     * a continuation has no effect.
+     */
+    void start();
+
     /**
      * @returns A future that will be fulfilled by the task.
      */
     Future& get_future();
 
+    /**
+     * @returns true if the task is completed, unlike ContinuationTask::get_future() it does not allocate.
+     */
+    bool is_ready() const noexcept;
+
+    /**
+     * Records the moment the task is released to its pool from now on, i.e. when its parent completes or when it is
+     * started, see ContinuationTask::released_at(). Used for diagnostics, e.g. by a Watchdog.
+     * @returns false if the task was already released, the moment is then unknown.
+     */
+    bool track_release() const noexcept;
+    /// @returns The moment the tracked task was released to its pool, the clock epoch if it is not released yet.
+    std::chrono::steady_clock::time_point released_at() const noexcept;
+
+    /**
+     * Blocks till the task is completed. On a fiber (e.g. a task of SimpleThreadPool in the fiber mode) only the fiber
+     * is suspended, its thread executes other tasks meanwhile.
+     * @note Within a catch handler the fiber is not suspended, the wait blocks its thread (see Fiber::suspend()).
+     * @note Unlike the future it does not report the outcome, see ContinuationTask::get_future().
+     * @note Waiting for a deferred task which is not started blocks forever.
+     */
+    void wait() const;
+
 private:
     static CancellationToken _dummyToken;
 
-    std::shared_ptr<Impl> _pImpl;
+    // Intrusively reference counted, the whole state of a task is a single allocation
+    Impl* _pImpl;
 };
\ No newline at end of file
@@ -0,0 +1,203 @@
+#include "fiber.h"
+
+#include <cassert>
+#include <system_error>
+#include <utility>
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <cerrno>
+#include <ucontext.h>
+#endif
+
+namespace
+{
+    thread_local Fiber* currentFiber = nullptr;
+
+#ifdef _WIN32
+    // The thread needs to be a fiber itself to switch to the other fibers, it is converted back when it exits
+    struct ThreadFiber
+    {
+        ~ThreadFiber()
+        {
+            if (converted)
+            {
+                ConvertFiberToThread();
+            }
+        }
+
+        void* get()
+        {
+            if (IsThreadAFiber())
+                return GetCurrentFiber();
+
+            void* fiber = ConvertThreadToFiber(nullptr);
+            if (fiber == nullptr)
+                throw std::system_error(static_cast<int>(GetLastError()), std::system_category(), "ConvertThreadToFiber");
+
+            converted = true;
+            return fiber;
+        }
+
+        bool converted{false};
+    };
+
+    thread_local ThreadFiber threadFiber;
+#endif
+}
+
+struct Fiber::Context
+{
+#ifdef _WIN32
+    void* fiber{nullptr};
+    void* caller{nullptr};
+#else
+    std::unique_ptr<char[]> stack;
+    ucontext_t fiber;
+    ucontext_t caller;
+#endif
+};
+
+Fiber::Fiber(std::size_t stackSize, Function wake, void* argument)
+    : _context(std::make_unique<Context>())
+    , _wake(wake)
+    , _wakeArgument(argument)
+    , _function(nullptr)
+    , _argument(nullptr)
+    , _suspended(nullptr)
+    , _suspendedArgument(nullptr)
+    , _finished{true}
+{
+#ifdef _WIN32
+    _context->fiber = CreateFiber(stackSize, &Fiber::entry, this);
+    if (_context->fiber == nullptr)
+        throw std::system_error(static_cast<int>(GetLastError()), std::system_category(), "CreateFiber");
+#else
+    _context->stack.reset(new char[stackSize]);
+    if (getcontext(&_context->fiber) != 0)
+        throw std::system_error(errno, std::generic_category(), "getcontext");
+
+    _context->fiber.uc_stack.ss_sp = _context->stack.get();
+    _context->fiber.uc_stack.ss_size = stackSize;
+    _context->fiber.uc_link = nullptr;
+    // The entry finds the fiber by currentFiber, the arguments of makecontext are only ints
+    makecontext(&_context->fiber, &Fiber::entry, 0);
+#endif
+}
+
+Fiber::~Fiber()
+{
+#ifdef _WIN32
+    DeleteFiber(_context->fiber);
+#endif
+}
+
+void Fiber::start(Function function, void* argument)
+{
+    assert(_finished);
+    _function = function;
+    _argument = argument;
+    _finished = false;
+    try
+    {
+        switchIn();
+    }
+    catch (...)
+    {
+        // The thread could not be converted to a fiber, the function did not start
+        _finished = true;
+        throw;
+    }
+}
+
+void Fiber::resume()
+{
+    assert(!_finished);
+    switchIn();
+}
+
+bool Fiber::finished() const noexcept
+{
+    return _finished;
+}
+
+void Fiber::wake()
+{
+    _wake(_wakeArgument);
+}
+
+Fiber* Fiber::current() noexcept
+{
+    return currentFiber;
+}
+
+void Fiber::suspend(Function suspended, void* argument)
+{
+    auto* fiber = currentFiber;
+    assert(fiber != nullptr);
+    fiber->_suspended = suspended;
+    fiber->_suspendedArgument = argument;
+    fiber->switchOut();
+}
+
+#ifdef _WIN32
+void __stdcall Fiber::entry(void* fiber) noexcept
+{
+    static_cast<Fiber*>(fiber)->loop();
+}
+#else
+void Fiber::entry() noexcept
+{
+    currentFiber->loop();
+}
+#endif
+
+void Fiber::loop() noexcept
+{
+    // The context is never left by returning, a finished fiber waits here for the next function
+    while (true)
+    {
+        _function(_argument);
+        _finished = true;
+        switchOut();
+    }
+}
+
+void Fiber::switchIn()
+{
+    // A fiber can start other fibers, it is the current one again once they switch out
+    auto* previous = std::exchange(currentFiber, this);
+#ifdef _WIN32
+    try
+    {
+        _context->caller = threadFiber.get();
+    }
+    catch (...)
+    {
+        currentFiber = previous;
+        throw;
+    }
+    SwitchToFiber(_context->fiber);
+#else
+    swapcontext(&_context->caller, &_context->fiber);
+#endif
+    currentFiber = previous;
+
+    if (auto suspended = std::exchange(_suspended, nullptr))
+    {
+        suspended(_suspendedArgument);
+    }
+}
+
+void Fiber::switchOut() noexcept
+{
+#ifdef _WIN32
+    SwitchToFiber(_context->caller);
+#else
+    swapcontext(&_context->fiber, &_context->caller);
+#endif
+}
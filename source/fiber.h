@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <memory>
+
+/// User-mode execution context with its own stack, switched to and from by its owning thread without the OS
+/// scheduler. A function running on the fiber can suspend it, e.g. to wait for a task, and the thread continues with
+/// other work till the fiber is woken and resumed.
+/// The fiber is reusable, once its function returns it can start another one on the same stack.
+/// \note Implemented by ucontext on POSIX and by the fiber API on Windows.
+/// \note A fiber is resumed by the thread which started it, so the thread local state of the function stays valid.
+class Fiber final
+{
+public:
+    using Function = void (*)(void* argument);
+
+    /**
+     * @param stackSize size of the stack in bytes
+     * @param wake called by Fiber::wake() with the @p argument to get the suspended fiber resumed by its thread
+     * @throws std::system_error if the context cannot be created
+     * @note The stack is not guarded, a function overflowing it corrupts other memory.
+     */
+    Fiber(std::size_t stackSize, Function wake, void* argument);
+    /// \note Destroying a suspended fiber frees its stack without unwinding the suspended function.
+    ~Fiber();
+
+    Fiber(const Fiber&) = delete;
+    Fiber& operator=(const Fiber&) = delete;
+
+    /// Runs the @p function with the @p argument on the fiber till it returns or suspends the fiber.
+    /// \note The fiber must be finished, the @p function must not throw.
+    /// @throws std::system_error if the calling thread cannot switch to fibers, the @p function is not started
+    void start(Function function, void* argument);
+    /// Continues the suspended fiber till its function returns or suspends the fiber again.
+    void resume();
+    /// @returns true if the function of the fiber returned, the fiber can start another one.
+    bool finished() const noexcept;
+    /// Requests the resumption of the suspended fiber by the wake function given to the constructor.
+    void wake();
+
+    /// @returns The fiber running on the calling thread, null if the thread is not running a fiber.
+    static Fiber* current() noexcept;
+    /**
+     * Switches from the current fiber back to the thread which started or resumed it.
+     * @param suspended called with the @p argument by that thread once the fiber is switched out, e.g. to register the
+     * Fiber::wake() of the fiber, so the fiber cannot be woken before it is suspended. It must not throw.
+     * @note Must not be called within a catch handler, the handled exception of the thread is not switched.
+     */
+    static void suspend(Function suspended, void* argument);
+
+private:
+    struct Context;
+
+#ifdef _WIN32
+    static void __stdcall entry(void* fiber) noexcept;
+#else
+    static void entry() noexcept;
+#endif
+    void loop() noexcept;
+    void switchIn();
+    void switchOut() noexcept;
+
+    std::unique_ptr<Context> _context;
+    Function _wake;
+    void* _wakeArgument;
+    Function _function;
+    void* _argument;
+    Function _suspended;
+    void* _suspendedArgument;
+    bool _finished;
+};
@@ -0,0 +1,317 @@
+#include "load_generator.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <condition_variable>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <thread>
+#include "continuation_task.h"
+#include "queue_full_exception.h"
+
+namespace
+{
+    using Clock = LoadGenerator::Clock;
+
+    // Marks the latency of a rejected request
+    constexpr Clock::duration notCompleted{Clock::duration::min()};
+
+    void spin(Clock::duration work)
+    {
+        const auto until = Clock::now() + work;
+        while (Clock::now() < until)
+        {
+        }
+    }
+
+    Clock::duration seconds(double value)
+    {
+        return std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(value));
+    }
+
+    // Executes the bookkeeping continuations on the thread completing their parent, so they cannot be refused
+    class InlineExecutor final : public IThreadPool
+    {
+    protected:
+        void scheduleInner(MethodType&& method) override
+        {
+            (*method)();
+        }
+    };
+
+    InlineExecutor inlineExecutor;
+}
+
+struct LoadGenerator::Run
+{
+    explicit Run(std::size_t requestCount)
+        : latencies(requestCount, notCompleted)
+        , pendingTasks(new std::atomic<std::size_t>[requestCount])
+        , refusedTasks(new std::atomic<bool>[requestCount])
+        , remaining{requestCount}
+    {
+    }
+
+    void complete(std::size_t request, Clock::duration latency)
+    {
+        latencies[request] = latency;
+        finish();
+    }
+
+    void reject()
+    {
+        rejected.fetch_add(1, std::memory_order_relaxed);
+        finish();
+    }
+
+    void finish()
+    {
+        if (remaining.fetch_sub(1, std::memory_order_acq_rel) == 1)
+        {
+            // Notified under the lock, the waiting LoadGenerator::run can destroy the instance right after
+            std::lock_guard<std::mutex> lk(mtx);
+            done = true;
+            finished.notify_one();
+        }
+    }
+
+    Clock::time_point start;
+    std::vector<Clock::duration> latencies;
+    // Count of the not finished parallel tasks of each Shape::FanOut request
+    std::unique_ptr<std::atomic<std::size_t>[]> pendingTasks;
+    // Shape::FanOut request with a refused task
+    std::unique_ptr<std::atomic<bool>[]> refusedTasks;
+    std::atomic<std::size_t> remaining;
+    std::atomic<std::size_t> rejected{0};
+    std::mutex mtx;
+    std::condition_variable finished;
+    bool done{false};
+};
+
+LoadGenerator::LoadGenerator(const Config& config)
+    : _config(config)
+{
+    std::mt19937_64 random(_config.seed);
+
+    _arrivals.reserve(_config.requestCount);
+    if (_config.rate <= 0.0)
+    {
+        _arrivals.assign(_config.requestCount, Clock::duration::zero());
+    }
+    else if (_config.arrival == Arrival::Poisson)
+    {
+        std::exponential_distribution<double> gap(_config.rate);
+        double arrival{0.0};
+        for (std::size_t idx = 0; idx < _config.requestCount; ++idx)
+        {
+            _arrivals.push_back(seconds(arrival));
+            arrival += gap(random);
+        }
+    }
+    else
+    {
+        const std::size_t burstSize = std::max<std::size_t>(_config.burstSize, 1);
+        const double period = static_cast<double>(burstSize) / _config.rate;
+        for (std::size_t idx = 0; idx < _config.requestCount; ++idx)
+        {
+            _arrivals.push_back(seconds(period * static_cast<double>(idx / burstSize)));
+        }
+    }
+
+    const double meanWork = std::chrono::duration<double>(_config.meanWork).count();
+    std::uniform_real_distribution<double> uniform(0.0, 2.0 * meanWork);
+    std::exponential_distribution<double> exponential(meanWork > 0.0 ? 1.0 / meanWork : 1.0);
+    const std::size_t taskCount = _config.requestCount * tasksPerRequest();
+    _work.reserve(taskCount);
+    for (std::size_t idx = 0; idx < taskCount; ++idx)
+    {
+        switch (_config.work)
+        {
+            case Work::Fixed:
+                _work.push_back(_config.meanWork);
+                break;
+            case Work::Uniform:
+                _work.push_back(seconds(uniform(random)));
+                break;
+            case Work::Exponential:
+                _work.push_back(meanWork > 0.0 ? seconds(exponential(random)) : Clock::duration::zero());
+                break;
+        }
+    }
+}
+
+LoadGenerator::Report LoadGenerator::run(IThreadPool& pool) const
+{
+    Run run(_config.requestCount);
+    if (_config.requestCount == 0)
+        return summarize({}, Clock::duration::zero());
+
+    run.start = Clock::now();
+    for (std::size_t request = 0; request < _config.requestCount; ++request)
+    {
+        // A submitter late with the request does not wait, the latency is still measured from the intended arrival
+        const auto arrival = run.start + _arrivals[request];
+        if (arrival - Clock::now() > std::chrono::milliseconds(1))
+        {
+            std::this_thread::sleep_until(arrival - std::chrono::milliseconds(1));
+        }
+        while (Clock::now() < arrival)
+        {
+            std::this_thread::yield();
+        }
+
+        submit(pool, run, request);
+    }
+
+    IThreadPool::before_blocking();
+    {
+        std::unique_lock<std::mutex> lk(run.mtx);
+        run.finished.wait(lk, [&run]() { return run.done; });
+    }
+
+    // The completion of the last request is its arrival plus its latency
+    Clock::duration elapsed{Clock::duration::zero()};
+    std::vector<Clock::duration> latencies;
+    latencies.reserve(_config.requestCount);
+    for (std::size_t request = 0; request < _config.requestCount; ++request)
+    {
+        if (run.latencies[request] == notCompleted)
+            continue;
+
+        latencies.push_back(run.latencies[request]);
+        elapsed = std::max(elapsed, _arrivals[request] + run.latencies[request]);
+    }
+
+    auto report = summarize(std::move(latencies), elapsed);
+    report.rejected = run.rejected.load();
+    return report;
+}
+
+LoadGenerator::Report LoadGenerator::summarize(std::vector<Clock::duration> latencies, Clock::duration elapsed)
+{
+    Report report{latencies.size(), 0, {}, {}, {}, {}, elapsed, 0.0};
+    if (latencies.empty())
+        return report;
+
+    std::sort(latencies.begin(), latencies.end());
+    const auto percentile = [&latencies](double fraction) {
+        const auto rank = static_cast<std::size_t>(std::ceil(fraction * static_cast<double>(latencies.size())));
+        return latencies[std::max<std::size_t>(rank, 1) - 1];
+    };
+    report.p50 = percentile(0.5);
+    report.p99 = percentile(0.99);
+    report.p999 = percentile(0.999);
+    report.max = latencies.back();
+    if (elapsed > Clock::duration::zero())
+    {
+        report.throughput = static_cast<double>(latencies.size()) / std::chrono::duration<double>(elapsed).count();
+    }
+    return report;
+}
+
+const std::vector<LoadGenerator::Clock::duration>& LoadGenerator::arrivals() const noexcept
+{
+    return _arrivals;
+}
+
+std::size_t LoadGenerator::tasksPerRequest() const noexcept
+{
+    const std::size_t shapeSize = std::max<std::size_t>(_config.shapeSize, 1);
+    switch (_config.shape)
+    {
+        case Shape::Chain:
+            return shapeSize;
+        case Shape::FanOut:
+            return shapeSize + 1;
+        default:
+            return 1;
+    }
+}
+
+void LoadGenerator::submit(IThreadPool& pool, Run& run, std::size_t request) const
+{
+    const std::size_t taskCount = tasksPerRequest();
+    const Clock::duration* work = &_work[request * taskCount];
+    const auto arrival = run.start + _arrivals[request];
+    const auto complete = [&run, request, arrival]() { run.complete(request, Clock::now() - arrival); };
+
+    switch (_config.shape)
+    {
+        case Shape::Single:
+            try
+            {
+                pool.schedule([work, complete]() {
+                    spin(*work);
+                    complete();
+                });
+            }
+            catch (const QueueFullException&)
+            {
+                run.reject();
+            }
+            break;
+
+        case Shape::Chain:
+        {
+            const auto step = [work, taskCount, complete](std::size_t idx) {
+                return ContinuationTask::TaskMethod([work, taskCount, complete, idx]() {
+                    spin(work[idx]);
+                    if (idx + 1 == taskCount)
+                    {
+                        complete();
+                    }
+                });
+            };
+            // The whole chain is built before its root is submitted, as a caller knowing the graph would do
+            auto root = ContinuationTask::deferred(pool, step(0));
+            auto last = root;
+            for (std::size_t idx = 1; idx < taskCount; ++idx)
+            {
+                last = last.continue_with(step(idx));
+            }
+            // A refused task skips the rest of the chain, its failure reaches the end
+            last.continue_with(inlineExecutor, [&run](std::exception_ptr outcome) {
+                if (outcome)
+                {
+                    run.reject();
+                }
+            });
+            root.start();
+            break;
+        }
+
+        case Shape::FanOut:
+        {
+            run.pendingTasks[request].store(taskCount - 1, std::memory_order_relaxed);
+            run.refusedTasks[request].store(false, std::memory_order_relaxed);
+            auto root = ContinuationTask::deferred(pool, [work]() { spin(work[0]); });
+            for (std::size_t idx = 1; idx < taskCount; ++idx)
+            {
+                // A refused root skips all parallel tasks, so each of them reports its own outcome
+                root.continue_with([work, idx]() { spin(work[idx]); })
+                    .continue_with(inlineExecutor, [&run, request, complete](std::exception_ptr outcome) {
+                        if (outcome)
+                        {
+                            run.refusedTasks[request].store(true, std::memory_order_relaxed);
+                        }
+                        if (run.pendingTasks[request].fetch_sub(1, std::memory_order_acq_rel) == 1)
+                        {
+                            if (run.refusedTasks[request].load(std::memory_order_relaxed))
+                            {
+                                run.reject();
+                            }
+                            else
+                            {
+                                complete();
+                            }
+                        }
+                    });
+            }
+            root.start();
+            break;
+        }
+    }
+}
@@ -0,0 +1,98 @@
+#pragma once
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+#include "IThreadPool.h"
+
+/// Open loop load for comparing thread pools, e.g. SimpleThreadPool with different options, on the same machine.
+/// The requests arrive by a precomputed schedule regardless of how fast the pool completes them, and the latency of
+/// a request is measured from its intended arrival to the completion of its last task. A submitter held up by a
+/// slow pool therefore does not hide the queueing delay of the requests it was late with (coordinated omission).
+/// \note The pool needs to execute the tasks on its own threads, the tasks of the ManualExecutor are never run.
+class LoadGenerator final
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    enum class Arrival
+    {
+        /// Exponentially distributed gaps between the requests.
+        Poisson,
+        /// Config::burstSize requests at once, the bursts are evenly spaced to keep Config::rate.
+        Bursty
+    };
+
+    enum class Work
+    {
+        Fixed,
+        /// Uniformly distributed in [0, 2 * Config::meanWork].
+        Uniform,
+        Exponential
+    };
+
+    enum class Shape
+    {
+        /// One task scheduled directly on the IThreadPool.
+        Single,
+        /// ContinuationTask followed by Config::shapeSize - 1 continuations, each waiting for the previous one.
+        Chain,
+        /// ContinuationTask with Config::shapeSize continuations running in parallel, the last one completes the request.
+        FanOut
+    };
+
+    struct Config
+    {
+        Arrival arrival{Arrival::Poisson};
+        /// Mean count of requests per second, 0 submits all requests at once to measure the saturated throughput.
+        double rate{1000.0};
+        std::size_t burstSize{1};
+        Work work{Work::Fixed};
+        /// Mean time a task spins for.
+        Clock::duration meanWork{std::chrono::microseconds(10)};
+        Shape shape{Shape::Single};
+        std::size_t shapeSize{1};
+        std::size_t requestCount{10000};
+        std::uint64_t seed{1};
+    };
+
+    struct Report
+    {
+        /// Count of the completed requests.
+        std::size_t completed;
+        /// Count of the requests with a task refused by the pool (e.g. with QueueFullException).
+        std::size_t rejected;
+        Clock::duration p50;
+        Clock::duration p99;
+        Clock::duration p999;
+        Clock::duration max;
+        /// Time from the first intended arrival to the last completion.
+        Clock::duration elapsed;
+        /// Completed requests per second.
+        double throughput;
+    };
+
+    explicit LoadGenerator(const Config& config);
+
+    /// Submits the requests by the schedule and blocks till all of them are completed or rejected.
+    /// \note A request of Shape::Chain or Shape::FanOut is rejected once all of its tasks are executed or skipped.
+    Report run(IThreadPool& pool) const;
+
+    /// @returns Percentiles (nearest rank) of the @p latencies, and the throughput of the latencies count in @p elapsed.
+    static Report summarize(std::vector<Clock::duration> latencies, Clock::duration elapsed);
+
+    /// @returns Intended arrivals of the requests, relative to the start of the run.
+    const std::vector<Clock::duration>& arrivals() const noexcept;
+
+private:
+    struct Run;
+
+    std::size_t tasksPerRequest() const noexcept;
+    void submit(IThreadPool& pool, Run& run, std::size_t request) const;
+
+    const Config _config;
+    std::vector<Clock::duration> _arrivals;
+    // Spin time of every task, tasksPerRequest() entries for each request
+    std::vector<Clock::duration> _work;
+};
@@ -3,12 +3,20 @@
 #include <cassert>
 #include <memory>
 #include <tuple>
+#include "small_object_pool.h"
 
 class mbind
 {
 public:
     virtual ~mbind() = default;
     virtual void operator()() = 0;
+    /// Called instead of the execution when a pool drops the method, e.g. past its deadline.
+    /// \note The default implementation does nothing, the method is just destroyed.
+    virtual void drop() noexcept;
+
+    // The methods are short living and created for every scheduled task, their memory is recycled
+    static void* operator new(std::size_t size);
+    static void operator delete(void* ptr, std::size_t size) noexcept;
 };
 
 class Bind;
@@ -42,6 +50,20 @@ public:
     static std::unique_ptr<mbind> bind(Function&& function, Args&&... args);
 };
 
+inline void mbind::drop() noexcept
+{
+}
+
+inline void* mbind::operator new(std::size_t size)
+{
+    return SmallObjectPool::allocate(size);
+}
+
+inline void mbind::operator delete(void* ptr, std::size_t size) noexcept
+{
+    SmallObjectPool::deallocate(ptr, size);
+}
+
 template <typename Function, typename... Args>
 fbind<Function, Args...>::fbind(Function&& function, Args&&... args)
     : _executed{false}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <utility>
+
+/// Unbounded lock-free multiple producers single consumer FIFO queue.
+/// Based on the non-intrusive MPSC node-based queue by Dmitry Vyukov, http://www.1024cores.net
+/// \note The push method is wait-free. A pop could fail while a concurrent push is in progress even if the
+/// queue already contains items pushed later by another producer, i.e. the consumer needs to retry if it knows
+/// there are items in the queue.
+template <typename T>
+class MpscQueue final
+{
+public:
+    MpscQueue();
+    ~MpscQueue();
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    /// Can be called from any thread.
+    void push(T&& item);
+    /// Can be called only from the consumer thread.
+    bool pop(T& item);
+    /// Snapshot, can be called only from the consumer thread.
+    bool wasEmpty() const;
+
+private:
+    struct Node
+    {
+        Node();
+        explicit Node(T&& item);
+
+        std::atomic<Node*> next;
+        T item;
+    };
+
+    static constexpr std::size_t CacheLineSize = 64;
+
+    // Producers and the consumer are working on different ends, so the ends are kept on separate cache lines
+    alignas(CacheLineSize) std::atomic<Node*> _head;  // producers side
+    alignas(CacheLineSize) Node* _tail;               // consumer side
+};
+
+template <typename T>
+MpscQueue<T>::Node::Node()
+    : next{nullptr}
+    , item()
+{
+}
+
+template <typename T>
+MpscQueue<T>::Node::Node(T&& item)
+    : next{nullptr}
+    , item(std::move(item))
+{
+}
+
+template <typename T>
+MpscQueue<T>::MpscQueue()
+    : _head{new Node()}
+    , _tail{_head.load(std::memory_order_relaxed)}
+{
+}
+
+template <typename T>
+MpscQueue<T>::~MpscQueue()
+{
+    while (_tail != nullptr)
+    {
+        Node* next = _tail->next.load(std::memory_order_relaxed);
+        delete _tail;
+        _tail = next;
+    }
+}
+
+template <typename T>
+void MpscQueue<T>::push(T&& item)
+{
+    Node* node = new Node(std::move(item));
+    Node* prev = _head.exchange(node, std::memory_order_acq_rel);
+    // Between the exchange and the store the list is not connected, see the note of the class
+    prev->next.store(node, std::memory_order_release);
+}
+
+template <typename T>
+bool MpscQueue<T>::pop(T& item)
+{
+    Node* tail = _tail;
+    Node* next = tail->next.load(std::memory_order_acquire);
+    if (next == nullptr)
+        return false;
+
+    // The next node becomes the new stub node, so its item is moved out
+    item = std::move(next->item);
+    _tail = next;
+    delete tail;
+    return true;
+}
+
+template <typename T>
+bool MpscQueue<T>::wasEmpty() const
+{
+    return _tail->next.load(std::memory_order_acquire) == nullptr;
+}
@@ -0,0 +1,148 @@
+#include "pipeline.h"
+
+pipeline_detail::Shared::Shared(IThreadPool& thPool)
+    : _thPool(thPool)
+    , _inFlight{0}
+    , _runs{0}
+{
+}
+
+IThreadPool& pipeline_detail::Shared::thPool() const noexcept
+{
+    return _thPool;
+}
+
+void pipeline_detail::Shared::entered() noexcept
+{
+    _inFlight.fetch_add(1, std::memory_order_relaxed);
+}
+
+void pipeline_detail::Shared::left(std::size_t count) noexcept
+{
+    if (_inFlight.fetch_sub(count, std::memory_order_acq_rel) == count)
+    {
+        notifyIdle();
+    }
+}
+
+void pipeline_detail::Shared::runScheduled() noexcept
+{
+    _runs.fetch_add(1, std::memory_order_relaxed);
+}
+
+void pipeline_detail::Shared::runFinished() noexcept
+{
+    if (_runs.fetch_sub(1, std::memory_order_acq_rel) == 1)
+    {
+        notifyIdle();
+    }
+}
+
+void pipeline_detail::Shared::failed(std::exception_ptr exception)
+{
+    std::lock_guard<std::mutex> lk(_exceptMtx);
+    _exceptions.push_back(std::move(exception));
+}
+
+void pipeline_detail::Shared::wait()
+{
+    // The runs of the lanes could be held back by this thread
+    IThreadPool::before_blocking();
+    std::unique_lock<std::mutex> lk(_idleMtx);
+    _idle.wait(lk, [&] { return _inFlight.load(std::memory_order_acquire) == 0 && _runs.load(std::memory_order_acquire) == 0; });
+}
+
+pipeline_detail::Shared::ExceptContainerType pipeline_detail::Shared::exceptions() const
+{
+    std::lock_guard<std::mutex> lk(_exceptMtx);
+    return _exceptions;
+}
+
+void pipeline_detail::Shared::notifyIdle() noexcept
+{
+    // Notified under the lock, so the waiter can't destroy the pipeline before the notification is done
+    std::lock_guard<std::mutex> lk(_idleMtx);
+    _idle.notify_all();
+}
+
+pipeline_detail::Producer::Producer() noexcept
+    : _blocked{false}
+{
+}
+
+void pipeline_detail::Producer::unblock() noexcept
+{
+    // Pairs with the fence in block, either the producer sees the freed slot or this thread sees it blocked
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (_blocked.load(std::memory_order_relaxed) && _blocked.exchange(false, std::memory_order_acq_rel))
+    {
+        onUnblocked();
+    }
+}
+
+void pipeline_detail::Producer::block() noexcept
+{
+    _blocked.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+bool pipeline_detail::Producer::isBlocked() const noexcept
+{
+    return _blocked.load(std::memory_order_acquire);
+}
+
+pipeline_detail::Lane::Lane(Shared& shared) noexcept
+    : _shared(shared)
+    , _signals{0}
+{
+}
+
+void pipeline_detail::Lane::signal() noexcept
+{
+    // Only the signal making the lane active schedules it, the run then keeps going till it has seen all signals
+    if (_signals.fetch_add(1, std::memory_order_acq_rel) == 0)
+    {
+        scheduleRun();
+    }
+}
+
+void pipeline_detail::Lane::onUnblocked() noexcept
+{
+    signal();
+}
+
+void pipeline_detail::Lane::scheduleRun() noexcept
+{
+    _shared.runScheduled();
+    try
+    {
+        _shared.thPool().schedule(&Lane::run, this);
+    }
+    catch (...)
+    {
+        // The pool refused the run, the lane is processed on the calling thread as by Strand
+        run();
+    }
+}
+
+void pipeline_detail::Lane::run() noexcept
+{
+    auto observed = _signals.load(std::memory_order_acquire);
+    while (true)
+    {
+        if (process())
+        {
+            // Let other tasks of the pool run, the signals are not consumed so nobody else schedules the lane
+            scheduleRun();
+            break;
+        }
+
+        const auto remaining = _signals.fetch_sub(observed, std::memory_order_acq_rel) - observed;
+        if (remaining == 0)
+            break;
+
+        observed = remaining;
+    }
+
+    _shared.runFinished();
+}
@@ -0,0 +1,780 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include "IThreadPool.h"
+#include "circularfifo/circularfifo_memory_relaxed_acquire_release.h"
+
+/// Order of the messages leaving a parallel pipeline stage.
+enum class StageOrder
+{
+    /// The messages leave in the order they entered, a slow message holds back the following ones.
+    Preserved,
+    /// The messages leave as soon as they are processed.
+    Any
+};
+
+namespace pipeline_detail
+{
+    /// Maximal count of messages processed by a lane in one task of the thread pool.
+    constexpr std::size_t BatchSize = 64;
+
+    /// Slot of a ring. A skipped slot carries no message, it keeps the place of a message failed by a stage, so the
+    /// stages collecting parallel lanes in order do not wait for it.
+    template <typename T>
+    struct Slot
+    {
+        T message;
+        bool skipped{false};
+    };
+
+    template <typename T, std::size_t Size>
+    using Ring = memory_relaxed_acquire_release::CircularFifo<Slot<T>, Size>;
+
+    /// Owned part of a pipeline.
+    class Part
+    {
+    public:
+        virtual ~Part() = default;
+    };
+
+    /// State shared by all stages of a pipeline.
+    class Shared final
+    {
+    public:
+        using ExceptContainerType = std::vector<std::exception_ptr>;
+
+        explicit Shared(IThreadPool& thPool);
+
+        IThreadPool& thPool() const noexcept;
+
+        /// A message entered the pipeline.
+        void entered() noexcept;
+        /// @p count messages left the pipeline (processed or dropped by a failed stage).
+        void left(std::size_t count) noexcept;
+        void runScheduled() noexcept;
+        /// Needs to be the last access of a run to the pipeline, the pipeline can be destroyed afterwards.
+        void runFinished() noexcept;
+        void failed(std::exception_ptr exception);
+
+        /// Blocks till all messages left the pipeline and no lane is running.
+        void wait();
+        ExceptContainerType exceptions() const;
+
+    private:
+        void notifyIdle() noexcept;
+
+        IThreadPool& _thPool;
+        std::atomic<std::size_t> _inFlight;
+        std::atomic<std::size_t> _runs;
+        std::mutex _idleMtx;
+        std::condition_variable _idle;
+        mutable std::mutex _exceptMtx;
+        ExceptContainerType _exceptions;
+    };
+
+    /// Writer to rings which can stop when the rings are full, it is woken up by the readers.
+    class Producer : public Part
+    {
+    public:
+        Producer() noexcept;
+
+        /// Called by a reader after it freed a slot, wakes the producer if it stopped on a full ring.
+        void unblock() noexcept;
+
+    protected:
+        /// Marks the producer as stopped, a write after this call is retried or the producer is woken up.
+        void block() noexcept;
+        bool isBlocked() const noexcept;
+        virtual void onUnblocked() noexcept = 0;
+
+    private:
+        std::atomic_bool _blocked;
+    };
+
+    /// Processing of messages executed on the thread pool, at most one task of a lane is executed at a time.
+    class Lane : public Producer
+    {
+    public:
+        explicit Lane(Shared& shared) noexcept;
+
+        /// Schedules the lane if it is not running, a running lane checks its rings again.
+        void signal() noexcept;
+
+    protected:
+        /// Processes at most BatchSize messages.
+        /// @returns true if the batch was exhausted, there are likely more messages to process.
+        virtual bool process() noexcept = 0;
+        void onUnblocked() noexcept override;
+
+        Shared& _shared;
+
+    private:
+        void scheduleRun() noexcept;
+        void run() noexcept;
+
+        // Count of signals not yet seen by a run, the lane is scheduled on transition from 0
+        std::atomic<std::size_t> _signals;
+    };
+
+    template <typename T, std::size_t Size>
+    class Rings final : public Part
+    {
+    public:
+        explicit Rings(std::size_t count);
+
+        Ring<T, Size>& operator[](std::size_t index);
+        std::size_t size() const noexcept;
+
+    private:
+        std::vector<std::unique_ptr<Ring<T, Size>>> _rings;
+    };
+
+    /// Writes messages of one producer to one ring or distributes them to more rings.
+    template <typename T, std::size_t Size>
+    class Writer final
+    {
+    public:
+        Writer();
+
+        void connect(Ring<T, Size>& ring, Lane& consumer);
+        /// @param order Preserved for a strict round-robin, Any for the first ring with a free slot
+        void setOrder(StageOrder order) noexcept;
+
+        /// @param skipped the slot only keeps the place of a failed message, the @p message is not passed on
+        /// @returns false if the rings are full, the @p message is then left untouched.
+        bool tryPush(T& message, bool skipped = false) noexcept;
+
+    private:
+        std::vector<Ring<T, Size>*> _rings;
+        std::vector<Lane*> _consumers;
+        StageOrder _order;
+        std::size_t _cursor;
+    };
+
+    /// Reads messages of one consumer from one ring or collects them from more rings.
+    template <typename T, std::size_t Size>
+    class Reader final
+    {
+    public:
+        Reader();
+
+        void connect(Ring<T, Size>& ring, Producer& producer);
+        /// @param order Preserved for a strict round-robin, Any for the first ring with a message
+        void setOrder(StageOrder order) noexcept;
+
+        /// @param skipped set if the slot only keeps the place of a failed message, the @p message is then not valid
+        bool tryPop(T& message, bool& skipped) noexcept;
+
+    private:
+        std::vector<Ring<T, Size>*> _rings;
+        std::vector<Producer*> _producers;
+        StageOrder _order;
+        std::size_t _cursor;
+    };
+
+    /// Producer of the first stage, the messages are pushed by the owner of the pipeline.
+    template <typename T, std::size_t Size>
+    class Source final : public Producer
+    {
+    public:
+        explicit Source(Shared& shared);
+
+        Writer<T, Size>& output() noexcept;
+
+        bool tryPush(T& message);
+        void push(T& message);
+
+    private:
+        void onUnblocked() noexcept override;
+
+        Shared& _shared;
+        Writer<T, Size> _output;
+        std::mutex _mtx;
+        std::condition_variable _space;
+    };
+
+    template <typename Output, std::size_t Size>
+    using OutputWriter = std::conditional_t<std::is_void_v<Output>, std::nullptr_t, Writer<Output, Size>>;
+
+    /// One lane of a stage, a serial stage has one lane, a parallel stage has one lane per worker.
+    template <typename Input, typename Output, typename Function, std::size_t Size>
+    class StageLane final : public Lane
+    {
+    public:
+        StageLane(Shared& shared, Function&& function);
+
+        Reader<Input, Size>& input() noexcept;
+        OutputWriter<Output, Size>& output() noexcept;
+
+    private:
+        bool process() noexcept override;
+        bool flush() noexcept;
+
+        Function _function;
+        Reader<Input, Size> _input;
+        OutputWriter<Output, Size> _output;
+        Input _message;
+        // Result which did not fit into the full output rings
+        std::optional<std::conditional_t<std::is_void_v<Output>, char, Output>> _held;
+        // The held result is a skipped slot
+        bool _heldSkipped;
+    };
+}
+
+template <typename Input, typename Current, std::size_t RingSize>
+class PipelineBuilder;
+
+/**
+ * Stream of messages processed by a sequence of stages running on a thread pool, see PipelineBuilder.
+ * The stages are connected by bounded lock-free rings, a stage stops when its output rings are full and continues
+ * when the next stage frees a slot, so the backpressure propagates up to Pipeline::push().
+ * @note After a warm-up the messages pass through without any allocation, a message is moved from stage to stage.
+ * @note The messages are pushed by one thread at a time.
+ */
+template <typename Input, std::size_t RingSize>
+class Pipeline final
+{
+public:
+    using ExceptContainerType = pipeline_detail::Shared::ExceptContainerType;
+
+    Pipeline(Pipeline&&) noexcept = default;
+    Pipeline& operator=(Pipeline&&) = delete;
+    /// Waits till all pushed messages are processed.
+    ~Pipeline();
+
+    /// Pushes the @p message if the input ring of the first stage has a free slot.
+    /// @returns false if the @p message was not pushed, it is then left untouched.
+    bool try_push(Input&& message);
+    /// Pushes the @p message, blocks while the input ring of the first stage is full.
+    /// @note Must not be called from the pool running the pipeline, its worker could block the pipeline.
+    void push(Input&& message);
+    /// Blocks till all pushed messages are processed.
+    void wait();
+
+    /// @returns Exceptions of the stages, the messages failed by a stage are dropped, the following ones keep their order.
+    ExceptContainerType exceptions() const;
+
+private:
+    template <typename, typename, std::size_t>
+    friend class PipelineBuilder;
+
+    Pipeline(std::unique_ptr<pipeline_detail::Shared>&& shared, std::vector<std::unique_ptr<pipeline_detail::Part>>&& parts,
+             pipeline_detail::Source<Input, RingSize>& source);
+
+    std::unique_ptr<pipeline_detail::Shared> _shared;
+    // The parts refer the shared state, so they are destroyed first
+    std::vector<std::unique_ptr<pipeline_detail::Part>> _parts;
+    pipeline_detail::Source<Input, RingSize>* _source;
+};
+
+/**
+ * Builds a Pipeline stage by stage, a stage is a callable receiving a message of the previous stage by value and
+ * returning a message of the next stage. The last stage returns void.
+ * @note The messages are stored in rings of @p RingSize slots, so they need to be default constructible and movable.
+ * @note Adjacent parallel stages need the same count of workers and the same StageOrder, the messages stay in the lane
+ * they were distributed to.
+ */
+template <typename Input, typename Current, std::size_t RingSize>
+class PipelineBuilder final
+{
+public:
+    /// @note The @p thPool instance needs to stay alive as long as the built pipeline is alive.
+    explicit PipelineBuilder(IThreadPool& thPool);
+
+    /// Appends a stage processing one message at a time in order.
+    template <typename Function>
+    PipelineBuilder<Input, std::invoke_result_t<std::decay_t<Function>&, Current>, RingSize> serial(Function&& function) &&;
+    /// Appends a stage processing messages by @p workers lanes at once, each of them has its copy of the @p function.
+    /// @throws std::invalid_argument if the stage can't be connected to the previous parallel stage
+    template <typename Function>
+    PipelineBuilder<Input, std::invoke_result_t<std::decay_t<Function>&, Current>, RingSize> parallel(std::size_t workers, Function&& function,
+                                                                                                      StageOrder order = StageOrder::Preserved) &&;
+
+    Pipeline<Input, RingSize> build() &&;
+
+private:
+    template <typename, typename, std::size_t>
+    friend class PipelineBuilder;
+
+    /// Appends a stage with a lane for each of the @p functions.
+    template <typename Function>
+    PipelineBuilder<Input, std::invoke_result_t<Function&, Current>, RingSize> append(std::vector<Function>&& functions, StageOrder order);
+
+    PipelineBuilder() = default;
+
+    std::unique_ptr<pipeline_detail::Shared> _shared;
+    std::vector<std::unique_ptr<pipeline_detail::Part>> _parts;
+    pipeline_detail::Source<Input, RingSize>* _source;
+    // Lanes of the last stage (or the source) and their writers, connected once the next stage is known
+    std::vector<pipeline_detail::Producer*> _producers;
+    std::vector<pipeline_detail::OutputWriter<Current, RingSize>*> _writers;
+    StageOrder _order;
+};
+
+/// Starts building a pipeline processing messages of the @p Input type.
+template <typename Input, std::size_t RingSize = 256>
+PipelineBuilder<Input, Input, RingSize> pipeline(IThreadPool& thPool)
+{
+    return PipelineBuilder<Input, Input, RingSize>(thPool);
+}
+
+template <typename T, std::size_t Size>
+pipeline_detail::Rings<T, Size>::Rings(std::size_t count)
+    : _rings()
+{
+    for (std::size_t index = 0; index < count; ++index)
+    {
+        _rings.push_back(std::make_unique<Ring<T, Size>>());
+    }
+}
+
+template <typename T, std::size_t Size>
+pipeline_detail::Ring<T, Size>& pipeline_detail::Rings<T, Size>::operator[](std::size_t index)
+{
+    return *_rings[index];
+}
+
+template <typename T, std::size_t Size>
+std::size_t pipeline_detail::Rings<T, Size>::size() const noexcept
+{
+    return _rings.size();
+}
+
+template <typename T, std::size_t Size>
+pipeline_detail::Writer<T, Size>::Writer()
+    : _rings()
+    , _consumers()
+    , _order{StageOrder::Preserved}
+    , _cursor{0}
+{
+}
+
+template <typename T, std::size_t Size>
+void pipeline_detail::Writer<T, Size>::connect(Ring<T, Size>& ring, Lane& consumer)
+{
+    _rings.push_back(&ring);
+    _consumers.push_back(&consumer);
+}
+
+template <typename T, std::size_t Size>
+void pipeline_detail::Writer<T, Size>::setOrder(StageOrder order) noexcept
+{
+    _order = order;
+}
+
+template <typename T, std::size_t Size>
+bool pipeline_detail::Writer<T, Size>::tryPush(T& message, bool skipped /* = false*/) noexcept
+{
+    for (std::size_t attempt = 0; attempt < _rings.size(); ++attempt)
+    {
+        const auto index = _cursor;
+        _cursor = (_cursor + 1) % _rings.size();
+
+        // Written in place, the message is moved only if there is a free slot
+        const auto slots = _rings[index]->reserve(1);
+        if (slots.size() != 0)
+        {
+            auto& slot = *slots.first.data;
+            if (!skipped)
+            {
+                slot.message = std::move(message);
+            }
+            slot.skipped = skipped;
+            _rings[index]->commit(1);
+            _consumers[index]->signal();
+            return true;
+        }
+
+        if (_order == StageOrder::Preserved)
+        {
+            // The same ring is tried next time, the readers expect the messages in the round-robin order
+            _cursor = index;
+            return false;
+        }
+    }
+
+    return false;
+}
+
+template <typename T, std::size_t Size>
+pipeline_detail::Reader<T, Size>::Reader()
+    : _rings()
+    , _producers()
+    , _order{StageOrder::Preserved}
+    , _cursor{0}
+{
+}
+
+template <typename T, std::size_t Size>
+void pipeline_detail::Reader<T, Size>::connect(Ring<T, Size>& ring, Producer& producer)
+{
+    _rings.push_back(&ring);
+    _producers.push_back(&producer);
+}
+
+template <typename T, std::size_t Size>
+void pipeline_detail::Reader<T, Size>::setOrder(StageOrder order) noexcept
+{
+    _order = order;
+}
+
+template <typename T, std::size_t Size>
+bool pipeline_detail::Reader<T, Size>::tryPop(T& message, bool& skipped) noexcept
+{
+    for (std::size_t attempt = 0; attempt < _rings.size(); ++attempt)
+    {
+        const auto index = _cursor;
+        _cursor = (_cursor + 1) % _rings.size();
+
+        const auto slots = _rings[index]->peek(1);
+        if (slots.size() != 0)
+        {
+            auto& slot = *slots.first.data;
+            skipped = slot.skipped;
+            if (!skipped)
+            {
+                message = std::move(slot.message);
+            }
+            _rings[index]->consume(1);
+            _producers[index]->unblock();
+            return true;
+        }
+
+        if (_order == StageOrder::Preserved)
+        {
+            // The next message in order is still being processed in this ring's lane
+            _cursor = index;
+            return false;
+        }
+    }
+
+    return false;
+}
+
+template <typename T, std::size_t Size>
+pipeline_detail::Source<T, Size>::Source(Shared& shared)
+    : _shared(shared)
+    , _output()
+    , _mtx()
+    , _space()
+{
+}
+
+template <typename T, std::size_t Size>
+pipeline_detail::Writer<T, Size>& pipeline_detail::Source<T, Size>::output() noexcept
+{
+    return _output;
+}
+
+template <typename T, std::size_t Size>
+bool pipeline_detail::Source<T, Size>::tryPush(T& message)
+{
+    // Counted before the push, the message can leave the pipeline before the push returns
+    _shared.entered();
+    if (_output.tryPush(message))
+        return true;
+
+    _shared.left(1);
+    return false;
+}
+
+template <typename T, std::size_t Size>
+void pipeline_detail::Source<T, Size>::push(T& message)
+{
+    _shared.entered();
+    while (!_output.tryPush(message))
+    {
+        block();
+        if (_output.tryPush(message))
+            return;
+
+        IThreadPool::before_blocking();
+        std::unique_lock<std::mutex> lk(_mtx);
+        _space.wait(lk, [&] { return !isBlocked(); });
+    }
+}
+
+template <typename T, std::size_t Size>
+void pipeline_detail::Source<T, Size>::onUnblocked() noexcept
+{
+    std::lock_guard<std::mutex> lk(_mtx);
+    _space.notify_all();
+}
+
+template <typename Input, typename Output, typename Function, std::size_t Size>
+pipeline_detail::StageLane<Input, Output, Function, Size>::StageLane(Shared& shared, Function&& function)
+    : Lane(shared)
+    , _function(std::move(function))
+    , _input()
+    , _output()
+    , _message()
+    , _held()
+    , _heldSkipped{false}
+{
+}
+
+template <typename Input, typename Output, typename Function, std::size_t Size>
+pipeline_detail::Reader<Input, Size>& pipeline_detail::StageLane<Input, Output, Function, Size>::input() noexcept
+{
+    return _input;
+}
+
+template <typename Input, typename Output, typename Function, std::size_t Size>
+pipeline_detail::OutputWriter<Output, Size>& pipeline_detail::StageLane<Input, Output, Function, Size>::output() noexcept
+{
+    return _output;
+}
+
+template <typename Input, typename Output, typename Function, std::size_t Size>
+bool pipeline_detail::StageLane<Input, Output, Function, Size>::process() noexcept
+{
+    std::size_t left{0};
+    std::size_t processed{0};
+
+    for (; processed < BatchSize; ++processed)
+    {
+        if constexpr (!std::is_void_v<Output>)
+        {
+            if (_held && !flush())
+                break;
+        }
+
+        bool skipped{false};
+        if (!_input.tryPop(_message, skipped))
+            break;
+
+        if (skipped)
+        {
+            // Passed on in place of the message, a later stage may collect the lanes of a parallel stage in order
+            if constexpr (!std::is_void_v<Output>)
+            {
+                _held.emplace();
+                _heldSkipped = true;
+            }
+            continue;
+        }
+
+        try
+        {
+            if constexpr (std::is_void_v<Output>)
+            {
+                _function(std::move(_message));
+            }
+            else
+            {
+                _held.emplace(_function(std::move(_message)));
+            }
+        }
+        catch (...)
+        {
+            _shared.failed(std::current_exception());
+            ++left;
+            if constexpr (!std::is_void_v<Output>)
+            {
+                _held.emplace();
+                _heldSkipped = true;
+            }
+            continue;
+        }
+
+        if constexpr (std::is_void_v<Output>)
+        {
+            ++left;
+        }
+    }
+
+    if constexpr (!std::is_void_v<Output>)
+    {
+        // The last message of the batch is passed on before the lane yields
+        if (_held && !flush())
+        {
+            processed = 0;
+        }
+    }
+
+    if (left != 0)
+    {
+        _shared.left(left);
+    }
+
+    return processed == BatchSize;
+}
+
+template <typename Input, typename Output, typename Function, std::size_t Size>
+bool pipeline_detail::StageLane<Input, Output, Function, Size>::flush() noexcept
+{
+    if (!_output.tryPush(*_held, _heldSkipped))
+    {
+        // The consumer could have freed a slot before it saw the lane blocked
+        block();
+        if (!_output.tryPush(*_held, _heldSkipped))
+            return false;
+    }
+
+    _held.reset();
+    _heldSkipped = false;
+    return true;
+}
+
+template <typename Input, std::size_t RingSize>
+Pipeline<Input, RingSize>::Pipeline(std::unique_ptr<pipeline_detail::Shared>&& shared, std::vector<std::unique_ptr<pipeline_detail::Part>>&& parts,
+                                    pipeline_detail::Source<Input, RingSize>& source)
+    : _shared(std::move(shared))
+    , _parts(std::move(parts))
+    , _source(&source)
+{
+}
+
+template <typename Input, std::size_t RingSize>
+Pipeline<Input, RingSize>::~Pipeline()
+{
+    if (_shared)
+    {
+        _shared->wait();
+    }
+}
+
+template <typename Input, std::size_t RingSize>
+bool Pipeline<Input, RingSize>::try_push(Input&& message)
+{
+    return _source->tryPush(message);
+}
+
+template <typename Input, std::size_t RingSize>
+void Pipeline<Input, RingSize>::push(Input&& message)
+{
+    _source->push(message);
+}
+
+template <typename Input, std::size_t RingSize>
+void Pipeline<Input, RingSize>::wait()
+{
+    _shared->wait();
+}
+
+template <typename Input, std::size_t RingSize>
+typename Pipeline<Input, RingSize>::ExceptContainerType Pipeline<Input, RingSize>::exceptions() const
+{
+    return _shared->exceptions();
+}
+
+template <typename Input, typename Current, std::size_t RingSize>
+PipelineBuilder<Input, Current, RingSize>::PipelineBuilder(IThreadPool& thPool)
+    : _shared(std::make_unique<pipeline_detail::Shared>(thPool))
+    , _parts()
+    , _source(nullptr)
+    , _producers()
+    , _writers()
+    , _order{StageOrder::Preserved}
+{
+    static_assert(std::is_same_v<Input, Current>, "a pipeline is started without stages");
+
+    auto source = std::make_unique<pipeline_detail::Source<Input, RingSize>>(*_shared);
+    _source = source.get();
+    _producers.push_back(source.get());
+    _writers.push_back(&source->output());
+    _parts.push_back(std::move(source));
+}
+
+template <typename Input, typename Current, std::size_t RingSize>
+template <typename Function>
+PipelineBuilder<Input, std::invoke_result_t<std::decay_t<Function>&, Current>, RingSize> PipelineBuilder<Input, Current, RingSize>::serial(Function&& function) &&
+{
+    // Moved into the only lane, so a move-only function can be used
+    std::vector<std::decay_t<Function>> functions;
+    functions.emplace_back(std::forward<Function>(function));
+    return append(std::move(functions), StageOrder::Preserved);
+}
+
+template <typename Input, typename Current, std::size_t RingSize>
+template <typename Function>
+PipelineBuilder<Input, std::invoke_result_t<std::decay_t<Function>&, Current>, RingSize>
+PipelineBuilder<Input, Current, RingSize>::parallel(std::size_t workers, Function&& function, StageOrder order /* = StageOrder::Preserved*/) &&
+{
+    if (workers == 0)
+        throw std::invalid_argument("a parallel stage needs at least one worker");
+
+    std::vector<std::decay_t<Function>> functions;
+    for (std::size_t index = 0; index < workers; ++index)
+    {
+        functions.emplace_back(function);
+    }
+    return append(std::move(functions), order);
+}
+
+template <typename Input, typename Current, std::size_t RingSize>
+template <typename Function>
+PipelineBuilder<Input, std::invoke_result_t<Function&, Current>, RingSize> PipelineBuilder<Input, Current, RingSize>::append(std::vector<Function>&& functions,
+                                                                                                                          StageOrder order)
+{
+    static_assert(!std::is_void_v<Current>, "the pipeline already ends with a stage returning void");
+
+    using Output = std::invoke_result_t<Function&, Current>;
+    using Lane = pipeline_detail::StageLane<Current, Output, Function, RingSize>;
+
+    const auto workers = functions.size();
+    const auto producerCount = _producers.size();
+    if (producerCount > 1 && workers > 1 && (producerCount != workers || order != _order))
+        throw std::invalid_argument("adjacent parallel stages need the same count of workers and the same order");
+
+    // Messages of a parallel stage are distributed by the previous serial stage and collected by the next one
+    const auto ringCount = std::max(producerCount, workers);
+    if (producerCount == 1 && workers > 1)
+    {
+        _writers.front()->setOrder(order);
+    }
+
+    std::vector<Lane*> lanes;
+    PipelineBuilder<Input, Output, RingSize> next;
+    for (auto& function : functions)
+    {
+        auto lane = std::make_unique<Lane>(*_shared, std::move(function));
+        lanes.push_back(lane.get());
+        next._producers.push_back(lane.get());
+        if constexpr (!std::is_void_v<Output>)
+        {
+            next._writers.push_back(&lane->output());
+        }
+        _parts.push_back(std::move(lane));
+    }
+
+    auto rings = std::make_unique<pipeline_detail::Rings<Current, RingSize>>(ringCount);
+    for (std::size_t index = 0; index < ringCount; ++index)
+    {
+        const auto producer = producerCount == ringCount ? index : 0;
+        const auto consumer = workers == ringCount ? index : 0;
+        _writers[producer]->connect((*rings)[index], *lanes[consumer]);
+        lanes[consumer]->input().connect((*rings)[index], *_producers[producer]);
+    }
+    if (producerCount > 1 && workers == 1)
+    {
+        lanes.front()->input().setOrder(_order);
+    }
+    _parts.push_back(std::move(rings));
+
+    next._shared = std::move(_shared);
+    next._parts = std::move(_parts);
+    next._source = _source;
+    next._order = workers > 1 ? order : StageOrder::Preserved;
+
+    return next;
+}
+
+template <typename Input, typename Current, std::size_t RingSize>
+Pipeline<Input, RingSize> PipelineBuilder<Input, Current, RingSize>::build() &&
+{
+    static_assert(std::is_void_v<Current>, "the last stage of a pipeline needs to return void");
+
+    return Pipeline<Input, RingSize>(std::move(_shared), std::move(_parts), *_source);
+}
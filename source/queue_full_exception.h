@@ -0,0 +1,7 @@
+#pragma once
+
+#include <exception>
+
+class QueueFullException final : public std::exception
+{
+};
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <cassert>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+/// Unbounded FIFO queue stored in a circular buffer, not thread safe.
+/// The buffer grows by doubling and never shrinks, so a queue in a steady state does not allocate (unlike std::deque
+/// allocating and freeing its blocks as the items pass through).
+template <typename T>
+class RingQueue final
+{
+public:
+    RingQueue();
+
+    bool empty() const noexcept;
+    std::size_t size() const noexcept;
+
+    T& front();
+    void push_back(T&& item);
+    /// The slot of the removed item is reset to a default constructed value.
+    void pop_front();
+
+private:
+    static constexpr std::size_t InitialCapacity = 16;
+
+    void grow();
+
+    // Capacity is a power of two, so the indexes are masked
+    std::vector<T> _items;
+    std::size_t _head;
+    std::size_t _size;
+};
+
+template <typename T>
+RingQueue<T>::RingQueue()
+    : _items()
+    , _head{0}
+    , _size{0}
+{
+}
+
+template <typename T>
+bool RingQueue<T>::empty() const noexcept
+{
+    return _size == 0;
+}
+
+template <typename T>
+std::size_t RingQueue<T>::size() const noexcept
+{
+    return _size;
+}
+
+template <typename T>
+T& RingQueue<T>::front()
+{
+    assert(!empty());
+    return _items[_head];
+}
+
+template <typename T>
+void RingQueue<T>::push_back(T&& item)
+{
+    if (_size == _items.size())
+    {
+        grow();
+    }
+
+    _items[(_head + _size) & (_items.size() - 1)] = std::move(item);
+    ++_size;
+}
+
+template <typename T>
+void RingQueue<T>::pop_front()
+{
+    assert(!empty());
+    _items[_head] = T();
+    _head = (_head + 1) & (_items.size() - 1);
+    --_size;
+}
+
+template <typename T>
+void RingQueue<T>::grow()
+{
+    std::vector<T> items(_items.empty() ? InitialCapacity : 2 * _items.size());
+    for (std::size_t idx = 0; idx < _size; ++idx)
+    {
+        items[idx] = std::move(_items[(_head + idx) & (_items.size() - 1)]);
+    }
+
+    _items.swap(items);
+    _head = 0;
+}
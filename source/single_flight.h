@@ -0,0 +1,241 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <exception>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <utility>
+#include "task_completion_source.h"
+#include "value_task.h"
+
+/// Deduplicates concurrent computations of the same key, e.g. loads of the same shard. The requests for a key which is
+/// being computed receive the in-flight task, so the computation runs once and all requesters read its one result.
+/// Optionally the completed results are cached, bounded by a capacity with LRU eviction and by a time to live.
+/// The keys are spread over independently locked shards, so the lookups of different keys rarely contend.
+/// \note A failed or canceled computation is not cached, the next request computes the key again.
+template <typename Key, typename T, typename Hash = std::hash<Key>, typename KeyEqual = std::equal_to<Key>>
+class SingleFlight final
+{
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Stats
+    {
+        /// Count of started computations.
+        std::size_t computations;
+        /// Count of requests which received an in-flight computation.
+        std::size_t joined;
+        /// Count of requests which received a cached result.
+        std::size_t cacheHits;
+    };
+
+    /**
+     * @param thPool thread pool executing the computations
+     * @param cacheCapacity maximal count of cached results, 0 disables the cache, a key is then forgotten once computed
+     * @param timeToLive age of a cached result after which the key is computed again
+     * @param shardCount count of independently locked parts of the map, at most @p cacheCapacity if the cache is enabled
+     * @note The capacity is divided among the shards, each shard evicts its least recently used result. The count of
+     * cached results never exceeds @p cacheCapacity, but a shard may evict while the others have space left.
+     * @note The @p thPool instance needs to stay alive as long as this instance and the returned tasks are alive.
+     */
+    explicit SingleFlight(IThreadPool& thPool,
+                          std::size_t cacheCapacity = 0,
+                          Clock::duration timeToLive = Clock::duration::max(),
+                          std::size_t shardCount = 16);
+
+    /**
+     * @param key key of the requested value
+     * @param compute computation of the value, it returns T, executed on the thread pool only if the key is neither
+     * in flight nor cached
+     * @returns Task with the value of the @p key.
+     */
+    template <typename Function>
+    ValueTask<T> get(const Key& key, Function&& compute);
+
+    /// Forgets the @p key, the next request computes it again. A running computation is not stopped, its result is
+    /// not cached.
+    void invalidate(const Key& key);
+
+    Stats stats() const noexcept;
+
+private:
+    struct Entry
+    {
+        ValueTask<T> task;
+        // Distinguishes the computation from a later one of the same key, e.g. after an invalidation
+        std::uint64_t generation;
+        bool completed;
+        Clock::time_point expiresAt;
+        // Valid once completed
+        typename std::list<Key>::iterator lruPosition;
+    };
+
+    struct Shard
+    {
+        std::mutex mtx;
+        std::unordered_map<Key, Entry, Hash, KeyEqual> entries;
+        // Keys of the completed entries, the most recently used first
+        std::list<Key> lru;
+        std::uint64_t nextGeneration{0};
+        // Share of the cache capacity, the shares sum up to the capacity
+        std::size_t capacity{0};
+    };
+
+    // Shared with the completion continuations, which outlive the instance when it is destroyed during a computation
+    struct State
+    {
+        State(IThreadPool& thPool, std::size_t cacheCapacity, Clock::duration timeToLive, std::size_t shardCount);
+
+        Shard& shard(const Key& key);
+        void complete(const Key& key, std::uint64_t generation, std::exception_ptr outcome);
+
+        IThreadPool& thPool;
+        const Clock::duration timeToLive;
+        const std::size_t shardCount;
+        std::unique_ptr<Shard[]> shards;
+        Hash hash;
+        std::atomic<std::size_t> computations{0};
+        std::atomic<std::size_t> joined{0};
+        std::atomic<std::size_t> cacheHits{0};
+    };
+
+    std::shared_ptr<State> _state;
+};
+
+template <typename Key, typename T, typename Hash, typename KeyEqual>
+SingleFlight<Key, T, Hash, KeyEqual>::State::State(IThreadPool& thPool, std::size_t cacheCapacity, Clock::duration timeToLive, std::size_t shardCount)
+    : thPool(thPool)
+    , timeToLive(timeToLive)
+    // Each shard of an enabled cache holds at least one result
+    , shardCount(cacheCapacity != 0 && cacheCapacity < shardCount ? cacheCapacity : shardCount)
+    , shards(new Shard[this->shardCount])
+    , hash()
+{
+    for (std::size_t idx = 0; idx < this->shardCount; ++idx)
+    {
+        shards[idx].capacity = cacheCapacity / this->shardCount + (idx < cacheCapacity % this->shardCount ? 1 : 0);
+    }
+}
+
+template <typename Key, typename T, typename Hash, typename KeyEqual>
+typename SingleFlight<Key, T, Hash, KeyEqual>::Shard& SingleFlight<Key, T, Hash, KeyEqual>::State::shard(const Key& key)
+{
+    return shards[hash(key) % shardCount];
+}
+
+template <typename Key, typename T, typename Hash, typename KeyEqual>
+void SingleFlight<Key, T, Hash, KeyEqual>::State::complete(const Key& key, std::uint64_t generation, std::exception_ptr outcome)
+{
+    auto& owner = shard(key);
+    std::lock_guard<std::mutex> lk(owner.mtx);
+    auto found = owner.entries.find(key);
+    if (found == owner.entries.end() || found->second.generation != generation)
+        return;
+
+    if (outcome || owner.capacity == 0)
+    {
+        owner.entries.erase(found);
+        return;
+    }
+
+    auto& entry = found->second;
+    const auto now = Clock::now();
+    owner.lru.push_front(key);
+    entry.lruPosition = owner.lru.begin();
+    entry.completed = true;
+    entry.expiresAt = timeToLive < Clock::time_point::max() - now ? now + timeToLive : Clock::time_point::max();
+
+    if (owner.lru.size() > owner.capacity)
+    {
+        owner.entries.erase(owner.lru.back());
+        owner.lru.pop_back();
+    }
+}
+
+template <typename Key, typename T, typename Hash, typename KeyEqual>
+SingleFlight<Key, T, Hash, KeyEqual>::SingleFlight(IThreadPool& thPool,
+                                                   std::size_t cacheCapacity /* = 0*/,
+                                                   Clock::duration timeToLive /* = Clock::duration::max()*/,
+                                                   std::size_t shardCount /* = 16*/)
+    : _state(std::make_shared<State>(thPool, cacheCapacity, timeToLive, shardCount == 0 ? 1 : shardCount))
+{
+}
+
+template <typename Key, typename T, typename Hash, typename KeyEqual>
+template <typename Function>
+ValueTask<T> SingleFlight<Key, T, Hash, KeyEqual>::get(const Key& key, Function&& compute)
+{
+    auto& state = *_state;
+    auto& shard = state.shard(key);
+    std::unique_lock<std::mutex> lk(shard.mtx);
+
+    auto found = shard.entries.find(key);
+    if (found != shard.entries.end())
+    {
+        auto& entry = found->second;
+        if (!entry.completed)
+        {
+            state.joined.fetch_add(1, std::memory_order_relaxed);
+            return entry.task;
+        }
+
+        if (Clock::now() < entry.expiresAt)
+        {
+            shard.lru.splice(shard.lru.begin(), shard.lru, entry.lruPosition);
+            state.cacheHits.fetch_add(1, std::memory_order_relaxed);
+            return entry.task;
+        }
+
+        shard.lru.erase(entry.lruPosition);
+        shard.entries.erase(found);
+    }
+
+    // The computation is released by the gate after the lock, so a pool executing it on the caller does not run it
+    // (and the completion locking the shard) under the lock
+    TaskCompletionSource gate(state.thPool);
+    auto parent = gate.get_task();
+    ValueTask<T> task(parent, std::forward<Function>(compute));
+    const auto generation = shard.nextGeneration++;
+    ContinuationTask(task.task()).continue_with(ContinuationTask::OutcomeTaskMethod(
+        [weakState = std::weak_ptr<State>(_state), key, generation](std::exception_ptr outcome) {
+            if (auto state = weakState.lock())
+            {
+                state->complete(key, generation, std::move(outcome));
+            }
+        }));
+    shard.entries.emplace(key, Entry{task, generation, false, Clock::time_point(), {}});
+    state.computations.fetch_add(1, std::memory_order_relaxed);
+    lk.unlock();
+
+    gate.set_done();
+    return task;
+}
+
+template <typename Key, typename T, typename Hash, typename KeyEqual>
+void SingleFlight<Key, T, Hash, KeyEqual>::invalidate(const Key& key)
+{
+    auto& shard = _state->shard(key);
+    std::lock_guard<std::mutex> lk(shard.mtx);
+    auto found = shard.entries.find(key);
+    if (found == shard.entries.end())
+        return;
+
+    if (found->second.completed)
+    {
+        shard.lru.erase(found->second.lruPosition);
+    }
+    shard.entries.erase(found);
+}
+
+template <typename Key, typename T, typename Hash, typename KeyEqual>
+typename SingleFlight<Key, T, Hash, KeyEqual>::Stats SingleFlight<Key, T, Hash, KeyEqual>::stats() const noexcept
+{
+    return {_state->computations.load(std::memory_order_relaxed),
+            _state->joined.load(std::memory_order_relaxed),
+            _state->cacheHits.load(std::memory_order_relaxed)};
+}
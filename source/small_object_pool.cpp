@@ -0,0 +1,237 @@
+#include "small_object_pool.h"
+
+#include <cassert>
+#include <mutex>
+#include <new>
+
+namespace
+{
+    // Blocks of 64, 128, 256 and 512 bytes
+    constexpr std::size_t classCount{4};
+    constexpr std::size_t minClassSize{64};
+    // Count of blocks moved between a thread cache and the stash at once
+    constexpr std::size_t batchSize{32};
+    constexpr std::size_t cacheLimit{2 * batchSize};
+    // Count of free blocks of a class kept by the stash above the reserved ones, the rest is returned to the heap
+    constexpr std::size_t stashLimit{16 * batchSize};
+
+    struct FreeBlock
+    {
+        FreeBlock* next;
+        // Valid in the first block of a batch in the stash
+        FreeBlock* nextBatch;
+        std::size_t count;
+    };
+
+    static_assert(sizeof(FreeBlock) <= minClassSize, "a free block needs to fit into the smallest class");
+
+    std::size_t sizeClass(std::size_t size)
+    {
+        std::size_t index{0};
+        while ((minClassSize << index) < size)
+        {
+            ++index;
+        }
+
+        return index;
+    }
+
+    std::size_t classSize(std::size_t index)
+    {
+        return minClassSize << index;
+    }
+
+    class Stash final
+    {
+    public:
+        void put(std::size_t index, FreeBlock* batch, std::size_t count) noexcept
+        {
+            batch->count = count;
+            {
+                std::lock_guard<std::mutex> lk(_mtx);
+                if (_counts[index] + count <= stashLimit + _reserved[index])
+                {
+                    batch->nextBatch = _batches[index];
+                    _batches[index] = batch;
+                    _counts[index] += count;
+                    return;
+                }
+            }
+
+            // Above the watermark, so a past peak does not keep its memory
+            while (batch != nullptr)
+            {
+                auto* next = batch->next;
+                ::operator delete(batch);
+                batch = next;
+            }
+        }
+
+        FreeBlock* take(std::size_t index) noexcept
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            auto* batch = _batches[index];
+            if (batch != nullptr)
+            {
+                _batches[index] = batch->nextBatch;
+                _counts[index] -= batch->count;
+            }
+
+            return batch;
+        }
+
+        /// Raises the watermark of the class, so the reserved blocks are kept.
+        void reserve(std::size_t index, std::size_t count) noexcept
+        {
+            std::lock_guard<std::mutex> lk(_mtx);
+            _reserved[index] += count;
+        }
+
+    private:
+        std::mutex _mtx;
+        FreeBlock* _batches[classCount]{};
+        // Count of the blocks in _batches
+        std::size_t _counts[classCount]{};
+        std::size_t _reserved[classCount]{};
+    };
+
+    Stash& stash()
+    {
+        // Never destroyed, threads could free their blocks after the static objects are destroyed
+        static auto* instance = new Stash();
+        return *instance;
+    }
+
+    // Trivially destructible, so it can be used also by destructors of other thread local objects
+    struct ThreadCache
+    {
+        FreeBlock* heads[classCount];
+        std::size_t counts[classCount];
+        bool flushed;
+    };
+
+    thread_local ThreadCache cache{};
+
+    // Returns the cached blocks to the stash when the thread exits
+    struct CacheFlusher final
+    {
+        ~CacheFlusher()
+        {
+            for (std::size_t index = 0; index < classCount; ++index)
+            {
+                if (cache.heads[index] != nullptr)
+                {
+                    stash().put(index, cache.heads[index], cache.counts[index]);
+                    cache.heads[index] = nullptr;
+                    cache.counts[index] = 0;
+                }
+            }
+            cache.flushed = true;
+        }
+    };
+
+    thread_local CacheFlusher flusher;
+}
+
+void* SmallObjectPool::allocate(std::size_t size)
+{
+    if (size > MaxSize)
+        return ::operator new(size);
+
+    const auto index = sizeClass(size);
+    if (cache.heads[index] == nullptr)
+    {
+        // The flusher is registered by the first use of the cache on this thread
+        (void)&flusher;
+
+        auto* batch = cache.flushed ? nullptr : stash().take(index);
+        if (batch == nullptr)
+            return ::operator new(classSize(index));
+
+        cache.heads[index] = batch;
+        cache.counts[index] = batch->count;
+    }
+
+    auto* block = cache.heads[index];
+    cache.heads[index] = block->next;
+    --cache.counts[index];
+    return block;
+}
+
+void SmallObjectPool::deallocate(void* ptr, std::size_t size) noexcept
+{
+    if (ptr == nullptr)
+        return;
+
+    if (size > MaxSize)
+    {
+        ::operator delete(ptr);
+        return;
+    }
+
+    const auto index = sizeClass(size);
+    auto* block = static_cast<FreeBlock*>(ptr);
+    if (cache.flushed)
+    {
+        block->next = nullptr;
+        stash().put(index, block, 1);
+        return;
+    }
+
+    (void)&flusher;
+    block->next = cache.heads[index];
+    cache.heads[index] = block;
+    ++cache.counts[index];
+
+    if (cache.counts[index] > cacheLimit)
+    {
+        // A batch is spilled, so the blocks freed by a consumer thread get to the producer threads
+        auto* batch = cache.heads[index];
+        auto* last = batch;
+        for (std::size_t idx = 1; idx < batchSize; ++idx)
+        {
+            last = last->next;
+        }
+
+        cache.heads[index] = last->next;
+        cache.counts[index] -= batchSize;
+        last->next = nullptr;
+        stash().put(index, batch, batchSize);
+    }
+}
+
+void SmallObjectPool::reserve(std::size_t size, std::size_t count)
+{
+    if (size > MaxSize)
+        return;
+
+    const auto index = sizeClass(size);
+    stash().reserve(index, count);
+    while (count > 0)
+    {
+        const auto batchCount = count < batchSize ? count : batchSize;
+        FreeBlock* batch{nullptr};
+        std::size_t allocated{0};
+        try
+        {
+            for (; allocated < batchCount; ++allocated)
+            {
+                auto* block = static_cast<FreeBlock*>(::operator new(classSize(index)));
+                block->next = batch;
+                batch = block;
+            }
+        }
+        catch (...)
+        {
+            // The blocks allocated so far are kept
+            if (batch != nullptr)
+            {
+                stash().put(index, batch, allocated);
+            }
+            throw;
+        }
+
+        stash().put(index, batch, batchCount);
+        count -= batchCount;
+    }
+}
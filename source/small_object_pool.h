@@ -0,0 +1,25 @@
+#pragma once
+
+#include <cstddef>
+
+/// Recycles the memory of small short-living objects (e.g. the scheduled tasks), so the hot paths do not allocate
+/// after a warm-up.
+/// Each thread keeps a cache of free blocks per size class. The caches exchange batches of blocks through a shared
+/// stash, so the blocks freed by the consumer threads are reused by the producer threads.
+/// \note The stash keeps a limited count of free blocks per size class (plus the reserved ones), the blocks above the
+/// limit are returned to the heap. So the memory kept after a peak is bounded by the thread caches and the stash.
+class SmallObjectPool final
+{
+public:
+    /// The largest size served from the pool, larger blocks are allocated by the global operator new.
+    static constexpr std::size_t MaxSize{512};
+
+    SmallObjectPool() = delete;
+
+    static void* allocate(std::size_t size);
+    /// @param size the same size as given to SmallObjectPool::allocate
+    static void deallocate(void* ptr, std::size_t size) noexcept;
+    /// Allocates @p count blocks for objects of the @p size in advance, they are shared by all threads.
+    /// \note Without the reserve the threads allocate till their caches settle, which depends on the scheduling.
+    static void reserve(std::size_t size, std::size_t count);
+};
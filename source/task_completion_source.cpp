@@ -0,0 +1,24 @@
+#include "task_completion_source.h"
+
+#include <cassert>
+
+TaskCompletionSource::TaskCompletionSource(IThreadPool& thPool, CancellationToken cancellation /* = ContinuationTask::_dummyToken*/)
+    : _task(ContinuationTask::pending(thPool, std::move(cancellation)))
+{
+}
+
+ContinuationTask TaskCompletionSource::get_task() const
+{
+    return _task;
+}
+
+void TaskCompletionSource::set_done()
+{
+    _task.complete(nullptr);
+}
+
+void TaskCompletionSource::set_exception(std::exception_ptr exception)
+{
+    assert(exception);
+    _task.complete(std::move(exception));
+}
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <exception>
+#include "continuation_task.h"
+
+/// Producer side of a ContinuationTask which is completed explicitly instead of by executing a method, e.g. by an
+/// I/O event or by a group of other tasks.
+class TaskCompletionSource final
+{
+public:
+    /**
+     * @param thPool thread pool used for the continuations of the task
+     * @param cancellation token inherited by the continuations of the task
+     * @note The @p thPool instance needs to stay alive as long as the task and its continuations are alive.
+     */
+    explicit TaskCompletionSource(IThreadPool& thPool, CancellationToken cancellation = ContinuationTask::_dummyToken);
+
+    ContinuationTask get_task() const;
+
+    /// Completes the task successfully, its continuations are scheduled.
+    /// @throws std::future_error if the task is already completed
+    void set_done();
+    /// Completes the task with the @p exception, its continuations are scheduled.
+    /// @throws std::future_error if the task is already completed
+    void set_exception(std::exception_ptr exception);
+
+private:
+    ContinuationTask _task;
+};
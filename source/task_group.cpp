@@ -0,0 +1,143 @@
+#include "task_group.h"
+
+#include <cassert>
+#include <functional>
+#include "canceled_exception.h"
+
+TaskGroup::TaskGroup(IThreadPool& thPool, FailurePolicy policy /* = FailurePolicy::RunAll*/)
+    : _thPool(thPool)
+    , _policy{policy}
+    , _cancellation()
+    , _completion(thPool)
+    , _pending{1}
+    , _joined{false}
+    , _skipped{false}
+{
+}
+
+TaskGroup::~TaskGroup()
+{
+    // The tasks reference this instance, an already retrieved result means the group is finished
+    auto completion = join();
+    if (completion.get_future().valid())
+    {
+        // Suspends only the fiber when destroyed on a fiber
+        completion.wait();
+    }
+}
+
+void TaskGroup::spawn(TaskMethod&& method)
+{
+    // Either the group is not joined or a running task of the group is spawning, so the group can't complete meanwhile
+    assert(_pending.load(std::memory_order_relaxed) > 0);
+
+    _pending.fetch_add(1, std::memory_order_relaxed);
+    try
+    {
+        _thPool.schedule(&TaskGroup::run, this, std::move(method));
+    }
+    catch (...)
+    {
+        finish();
+        throw;
+    }
+}
+
+void TaskGroup::spawn(CancelableTaskMethod&& method)
+{
+    spawn(TaskMethod(std::bind(std::move(method), get_token())));
+}
+
+ContinuationTask TaskGroup::join()
+{
+    auto task = _completion.get_task();
+    if (!_joined.exchange(true, std::memory_order_relaxed))
+    {
+        finish();
+    }
+
+    return task;
+}
+
+void TaskGroup::wait()
+{
+    auto completion = join();
+    // Suspends only the fiber when waiting on a fiber
+    completion.wait();
+    completion.get_future().get();
+}
+
+void TaskGroup::cancel() noexcept
+{
+    _cancellation.cancel();
+}
+
+CancellationToken TaskGroup::get_token() const
+{
+    return _cancellation.get_token();
+}
+
+TaskGroup::ExceptContainerType TaskGroup::exceptions() const
+{
+    std::lock_guard<std::mutex> lk(_exceptMtx);
+    return _exceptions;
+}
+
+void TaskGroup::run(TaskMethod&& method) noexcept
+{
+    if (_cancellation.get_token().is_canceled())
+    {
+        _skipped.store(true, std::memory_order_relaxed);
+    }
+    else
+    {
+        try
+        {
+            method();
+        }
+        catch (...)
+        {
+            {
+                std::lock_guard<std::mutex> lk(_exceptMtx);
+                _exceptions.push_back(std::current_exception());
+            }
+
+            if (_policy == FailurePolicy::CancelOnFailure)
+            {
+                _cancellation.cancel();
+            }
+        }
+    }
+
+    finish();
+}
+
+void TaskGroup::finish() noexcept
+{
+    if (_pending.fetch_sub(1, std::memory_order_acq_rel) != 1)
+        return;
+
+    // The waiting thread could destroy the group as soon as the task is completed, so only a copy is used for it
+    auto completion = _completion;
+    std::exception_ptr exception;
+    {
+        std::lock_guard<std::mutex> lk(_exceptMtx);
+        if (!_exceptions.empty())
+        {
+            exception = _exceptions.front();
+        }
+    }
+    if (!exception && _skipped.load(std::memory_order_relaxed))
+    {
+        exception = std::make_exception_ptr(CanceledException());
+    }
+
+    if (exception)
+    {
+        completion.set_exception(std::move(exception));
+    }
+    else
+    {
+        completion.set_done();
+    }
+}
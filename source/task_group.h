@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <exception>
+#include <mutex>
+#include <vector>
+#include "IThreadPool.h"
+#include "cancellation_source.h"
+#include "continuation_task.h"
+#include "task_completion_source.h"
+
+/// Spawns independent tasks on a thread pool and joins them on a single atomic counter.
+/// The spawned tasks have no futures of their own, the whole group is completed by one task with one wake-up.
+/// \note Tasks can be spawned also by the spawned tasks, as long as they are running the group is not completed.
+class TaskGroup final
+{
+public:
+    using TaskMethod = ContinuationTask::TaskMethod;
+    using CancelableTaskMethod = ContinuationTask::CancelableTaskMethod;
+    using ExceptContainerType = std::vector<std::exception_ptr>;
+
+    /// Behavior of the group when one of its tasks throws.
+    enum class FailurePolicy
+    {
+        /// All tasks are executed, the exceptions are collected.
+        RunAll,
+        /// The group is canceled, the not yet started tasks are skipped.
+        CancelOnFailure
+    };
+
+    /**
+     * @param thPool thread pool to be used for the spawned tasks and for the continuations of the completion task
+     * @param policy behavior of the group when one of its tasks throws
+     * @note The @p thPool instance needs to stay alive as long as this instance and the completion task are alive.
+     */
+    explicit TaskGroup(IThreadPool& thPool, FailurePolicy policy = FailurePolicy::RunAll);
+    /// Joins the group and waits for its tasks, the exceptions are swallowed.
+    ~TaskGroup();
+
+    TaskGroup(const TaskGroup&) = delete;
+    TaskGroup& operator=(const TaskGroup&) = delete;
+
+    /// Schedules the @p method as a task of the group.
+    /// @note If the thread pool refuses the task (e.g. with QueueFullException) the exception is thrown to the caller.
+    void spawn(TaskMethod&& method);
+    /// Schedules the @p method as a task of the group, the method receives the token of the group.
+    void spawn(CancelableTaskMethod&& method);
+
+    /**
+     * Closes the group, only the spawned tasks can spawn other tasks afterwards.
+     * @returns A task completed when all tasks of the group are finished. Its future stores the first exception of
+     * the tasks, or CanceledException if the group was canceled and some tasks were skipped.
+     * @note Repeated calls return the same task.
+     */
+    ContinuationTask join();
+    /// Joins the group and blocks till all its tasks are finished, on a fiber only the fiber is suspended.
+    /// @throws The first exception of the tasks, @see TaskGroup::join()
+    void wait();
+
+    /// Not yet started tasks of the group are skipped.
+    void cancel() noexcept;
+    CancellationToken get_token() const;
+
+    /// @returns Exceptions of all failed tasks.
+    /// @note Complete only after the group is finished.
+    ExceptContainerType exceptions() const;
+
+private:
+    void run(TaskMethod&& method) noexcept;
+    void finish() noexcept;
+
+    IThreadPool& _thPool;
+    const FailurePolicy _policy;
+    CancellationSource _cancellation;
+    TaskCompletionSource _completion;
+    // Running and not yet started tasks plus one for the not joined group
+    std::atomic<std::size_t> _pending;
+    std::atomic_bool _joined;
+    std::atomic_bool _skipped;
+
+    mutable std::mutex _exceptMtx;
+    ExceptContainerType _exceptions;
+};
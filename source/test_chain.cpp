@@ -0,0 +1,80 @@
+#include <gtest\gtest.h>
+
+#include <future>
+#include <memory>
+#include <string>
+
+#include "ManualExecutor.h"
+#include "allocation_counter.h"
+#include "chain.h"
+#include "continuation_task.h"
+
+TEST(chainTest, resultsArePassedToNextStep)
+{
+    auto fused = chain([](int value) { return value + 1; }, [](int value) { return std::to_string(value); }, [](std::string text) { return text + "!"; });
+
+    ASSERT_EQ("42!", fused(41));
+}
+
+TEST(chainTest, voidStepIsFollowedByStepWithoutArguments)
+{
+    int state{0};
+    auto fused = chain([&]() { state = 1; }, [&]() { return state + 1; });
+
+    ASSERT_EQ(2, fused());
+}
+
+TEST(chainTest, resultsAreMovedNotCopied)
+{
+    // A move-only value can pass through the chain only if it is moved
+    auto fused = chain([]() { return std::make_unique<int>(1); },
+                       [](std::unique_ptr<int> value) {
+                           ++*value;
+                           return value;
+                       },
+                       [](std::unique_ptr<int> value) { return *value; });
+
+    ASSERT_EQ(2, fused());
+}
+
+TEST(chainTest, stepsAreAppendedByThen)
+{
+    auto fused = chain([](int value) { return value * 2; }).then([](int value) { return value + 1; }).then([](int value) { return value * 10; });
+
+    ASSERT_EQ(70, fused(3));
+}
+
+TEST(chainTest, executionDoesNotAllocate)
+{
+    auto fused = chain([](int value) { return value + 1; }, [](int value) { return value * 2; }, [](int value) { return value - 3; });
+
+    const auto allocations = AllocationCounter::thread().allocations;
+    const auto result = fused(1);
+    ASSERT_EQ(1, result);
+    ASSERT_EQ(allocations, AllocationCounter::thread().allocations);
+}
+
+TEST(chainTest, chainIsScheduledAsOneTask)
+{
+    ManualExecutor executor;
+    std::promise<int> result;
+
+    executor.schedule(chain([](int value) { return value + 1; }, [](int value) { return value * 2; }, [&](int value) { result.set_value(value); }), 4);
+
+    ASSERT_EQ(1u, executor.run_until_idle());
+    ASSERT_EQ(10, result.get_future().get());
+}
+
+TEST(chainTest, chainIsContinuation)
+{
+    ManualExecutor executor;
+    int result{0};
+
+    ContinuationTask task(executor, []() {});
+    auto next = task.continue_with(chain([]() { return 5; }, [](int value) { return value * 3; }, [&](int value) { result = value; }));
+
+    // The parent and the whole fused chain
+    ASSERT_EQ(2u, executor.run_until_idle());
+    ASSERT_EQ(15, result);
+    ASSERT_NO_THROW(next.get_future().get());
+}
@@ -0,0 +1,326 @@
+#include <gtest\gtest.h>
+
+#include <chrono>
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
+
+#include "circularfifo/circularfifo_memory_relaxed_acquire_release.h"
+#include "circularfifo/circularfifo_memory_sequential_consistent.h"
+
+namespace
+{
+    constexpr std::size_t fifoSize{64};
+
+    template <typename T>
+    class circularFifoTest : public ::testing::Test
+    {
+    };
+
+    using FifoTypes = ::testing::Types<memory_sequential_consistent::CircularFifo<int, fifoSize>,
+                                       memory_relaxed_acquire_release::CircularFifo<int, fifoSize>>;
+}
+
+TYPED_TEST_CASE(circularFifoTest, FifoTypes);
+
+TYPED_TEST(circularFifoTest, pushPopInOrder)
+{
+    auto fifo = std::make_unique<TypeParam>();
+    ASSERT_TRUE(fifo->wasEmpty());
+
+    for (int idx = 0; idx < static_cast<int>(fifoSize); ++idx)
+    {
+        ASSERT_TRUE(fifo->push(idx));
+    }
+    ASSERT_TRUE(fifo->wasFull());
+    ASSERT_FALSE(fifo->push(-1));
+
+    for (int idx = 0; idx < static_cast<int>(fifoSize); ++idx)
+    {
+        int item{-1};
+        ASSERT_TRUE(fifo->pop(item));
+        ASSERT_EQ(idx, item);
+    }
+    int item{-1};
+    ASSERT_FALSE(fifo->pop(item));
+    ASSERT_TRUE(fifo->wasEmpty());
+}
+
+TYPED_TEST(circularFifoTest, pushVectorStopsWhenFull)
+{
+    auto fifo = std::make_unique<TypeParam>();
+    std::vector<int> items(fifoSize + 10, 1);
+    std::vector<int>::size_type added{0};
+
+    ASSERT_FALSE(fifo->push(items, added));
+    ASSERT_EQ(fifoSize, added);
+}
+
+TYPED_TEST(circularFifoTest, producerConsumer)
+{
+    constexpr int itemCount{200000};
+    auto fifo = std::make_unique<TypeParam>();
+
+    std::thread producer([&]() {
+        for (int idx = 0; idx < itemCount; ++idx)
+        {
+            while (!fifo->push(idx))
+            {
+                std::this_thread::yield();
+            }
+        }
+    });
+
+    for (int expected = 0; expected < itemCount; ++expected)
+    {
+        int item{-1};
+        while (!fifo->pop(item))
+        {
+            std::this_thread::yield();
+        }
+        ASSERT_EQ(expected, item);
+    }
+
+    producer.join();
+    ASSERT_TRUE(fifo->wasEmpty());
+}
+
+namespace
+{
+    using BatchFifo = memory_relaxed_acquire_release::CircularFifo<int, fifoSize>;
+}
+
+TEST(circularFifoBatchTest, reserveWrapsAroundInTwoSpans)
+{
+    auto fifo = std::make_unique<BatchFifo>();
+    constexpr int offset{fifoSize - 4};
+
+    // Move the indexes near the end of the array
+    for (int idx = 0; idx < offset; ++idx)
+    {
+        ASSERT_TRUE(fifo->push(idx));
+        int item{-1};
+        ASSERT_TRUE(fifo->pop(item));
+    }
+
+    auto slots = fifo->reserve(10);
+    ASSERT_EQ(5u, slots.first.size) << "the array has Size + 1 slots";
+    ASSERT_EQ(5u, slots.second.size);
+
+    int value{0};
+    for (std::size_t idx = 0; idx < slots.first.size; ++idx)
+    {
+        slots.first.data[idx] = value++;
+    }
+    for (std::size_t idx = 0; idx < slots.second.size; ++idx)
+    {
+        slots.second.data[idx] = value++;
+    }
+    ASSERT_TRUE(fifo->wasEmpty()) << "reserved slots are not visible before commit";
+    fifo->commit(slots.size());
+
+    std::vector<int> items(20, -1);
+    ASSERT_EQ(10u, fifo->pop(items.data(), items.size()));
+    for (int idx = 0; idx < 10; ++idx)
+    {
+        ASSERT_EQ(idx, items[idx]);
+    }
+    ASSERT_TRUE(fifo->wasEmpty());
+}
+
+TEST(circularFifoBatchTest, reserveIsLimitedByFreeSlots)
+{
+    auto fifo = std::make_unique<BatchFifo>();
+
+    auto slots = fifo->reserve(fifoSize * 2);
+    ASSERT_EQ(fifoSize, slots.size());
+    fifo->commit(fifoSize - 1);
+
+    ASSERT_EQ(1u, fifo->reserve(fifoSize).size());
+    ASSERT_EQ(fifoSize - 1, fifo->peek(fifoSize * 2).size());
+}
+
+TEST(circularFifoBatchTest, peekKeepsItemsTillConsumed)
+{
+    auto fifo = std::make_unique<BatchFifo>();
+    for (int idx = 0; idx < 5; ++idx)
+    {
+        ASSERT_TRUE(fifo->push(idx));
+    }
+
+    auto items = fifo->peek(3);
+    ASSERT_EQ(3u, items.first.size);
+    ASSERT_EQ(0u, items.second.size);
+    ASSERT_EQ(0, items.first.data[0]);
+    ASSERT_EQ(2, items.first.data[2]);
+    // A second peek gives the same items
+    ASSERT_EQ(0, fifo->peek(1).first.data[0]);
+
+    fifo->consume(2);
+    int item{-1};
+    ASSERT_TRUE(fifo->pop(item));
+    ASSERT_EQ(2, item);
+}
+
+TEST(circularFifoBatchTest, batchProducerConsumer)
+{
+    constexpr int itemCount{200000};
+    constexpr std::size_t batchSize{7};
+    auto fifo = std::make_unique<BatchFifo>();
+
+    std::thread producer([&]() {
+        int next{0};
+        while (next < itemCount)
+        {
+            auto slots = fifo->reserve(std::min<std::size_t>(batchSize, itemCount - next));
+            if (slots.size() == 0)
+            {
+                std::this_thread::yield();
+                continue;
+            }
+
+            for (std::size_t idx = 0; idx < slots.first.size; ++idx)
+            {
+                slots.first.data[idx] = next++;
+            }
+            for (std::size_t idx = 0; idx < slots.second.size; ++idx)
+            {
+                slots.second.data[idx] = next++;
+            }
+            fifo->commit(slots.size());
+        }
+    });
+
+    int expected{0};
+    std::vector<int> items(batchSize * 2);
+    while (expected < itemCount)
+    {
+        const auto count = fifo->pop(items.data(), items.size());
+        if (count == 0)
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        for (std::size_t idx = 0; idx < count; ++idx)
+        {
+            ASSERT_EQ(expected++, items[idx]);
+        }
+    }
+
+    producer.join();
+    ASSERT_TRUE(fifo->wasEmpty());
+}
+
+namespace
+{
+    template <typename Fifo>
+    std::chrono::nanoseconds measureTransfer(std::uint64_t itemCount)
+    {
+        using Clock = std::chrono::high_resolution_clock;
+        auto fifo = std::make_unique<Fifo>();
+        std::uint64_t sum{0};
+
+        const auto start = Clock::now();
+        std::thread producer([&]() {
+            for (std::uint64_t idx = 0; idx < itemCount; ++idx)
+            {
+                while (!fifo->push(idx))
+                {
+                    std::this_thread::yield();
+                }
+            }
+        });
+
+        for (std::uint64_t received = 0; received < itemCount; ++received)
+        {
+            std::uint64_t item{0};
+            while (!fifo->pop(item))
+            {
+                std::this_thread::yield();
+            }
+            sum += item;
+        }
+        producer.join();
+        const auto duration = Clock::now() - start;
+
+        EXPECT_EQ(itemCount * (itemCount - 1) / 2, sum);
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(duration);
+    }
+
+    template <typename Fifo>
+    std::chrono::nanoseconds measureBatchTransfer(std::uint64_t itemCount, std::size_t batchSize)
+    {
+        using Clock = std::chrono::high_resolution_clock;
+        auto fifo = std::make_unique<Fifo>();
+        std::uint64_t sum{0};
+
+        const auto start = Clock::now();
+        std::thread producer([&]() {
+            std::uint64_t next{0};
+            while (next < itemCount)
+            {
+                auto slots = fifo->reserve(std::min<std::uint64_t>(batchSize, itemCount - next));
+                for (std::size_t idx = 0; idx < slots.first.size; ++idx)
+                {
+                    slots.first.data[idx] = next++;
+                }
+                for (std::size_t idx = 0; idx < slots.second.size; ++idx)
+                {
+                    slots.second.data[idx] = next++;
+                }
+                fifo->commit(slots.size());
+
+                if (slots.size() == 0)
+                {
+                    std::this_thread::yield();
+                }
+            }
+        });
+
+        std::uint64_t received{0};
+        while (received < itemCount)
+        {
+            auto items = fifo->peek(batchSize);
+            for (std::size_t idx = 0; idx < items.first.size; ++idx)
+            {
+                sum += items.first.data[idx];
+            }
+            for (std::size_t idx = 0; idx < items.second.size; ++idx)
+            {
+                sum += items.second.data[idx];
+            }
+            fifo->consume(items.size());
+            received += items.size();
+
+            if (items.size() == 0)
+            {
+                std::this_thread::yield();
+            }
+        }
+        producer.join();
+        const auto duration = Clock::now() - start;
+
+        EXPECT_EQ(itemCount * (itemCount - 1) / 2, sum);
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(duration);
+    }
+}
+
+// Not a real test, it reports the throughput of the variants. Results are meaningful only in release builds
+// on a machine with at least two free cores.
+TEST(circularFifoBenchmark, relaxedVersusSequentialConsistent)
+{
+    constexpr std::uint64_t itemCount{2000000};
+    constexpr std::size_t benchFifoSize{1024};
+
+    const auto sequential = measureTransfer<memory_sequential_consistent::CircularFifo<std::uint64_t, benchFifoSize>>(itemCount);
+    const auto relaxed = measureTransfer<memory_relaxed_acquire_release::CircularFifo<std::uint64_t, benchFifoSize>>(itemCount);
+    const auto batched = measureBatchTransfer<memory_relaxed_acquire_release::CircularFifo<std::uint64_t, benchFifoSize>>(itemCount, 64);
+
+    std::cout << "CircularFifo transfer of " << itemCount << " items: sequential consistent "
+              << static_cast<double>(sequential.count()) / itemCount << " ns/item, relaxed acquire/release "
+              << static_cast<double>(relaxed.count()) / itemCount << " ns/item, batches of 64 "
+              << static_cast<double>(batched.count()) / itemCount << " ns/item" << std::endl;
+}
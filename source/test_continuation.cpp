@@ -3,11 +3,16 @@
 #include <array>
 #include <atomic>
 #include <chrono>
+#include <stdexcept>
 
+#include "ManualExecutor.h"
 #include "SimpleThreadPool.h"
+#include "allocation_counter.h"
 #include "canceled_exception.h"
 #include "cancellation_source.h"
 #include "continuation_task.h"
+#include "queue_full_exception.h"
+#include "task_completion_source.h"
 
 TEST(continuationTest, basicAssumptions)
 {
@@ -272,4 +277,457 @@ TEST(continuationTest, cancelableTaskNotScheduled)
     thPool.stop();
 
     ASSERT_THROW(task.get_future().get(), CanceledException);
+}
+
+TEST(continuationTest, taskRefusedByFullPool)
+{
+    // The pool is not started, so the queue will not be emptied
+    SimpleThreadPool thPool(1, 1, SimpleThreadPool::OverflowPolicy::Reject);
+    std::atomic_bool childExecuted{false};
+
+    ContinuationTask first(thPool, []() {});
+    ContinuationTask refused(thPool, []() {});
+    auto child = refused.continue_with([&]() { childExecuted = true; });
+
+    ASSERT_THROW(refused.get_future().get(), QueueFullException);
+
+    // The child of the refused task is also refused by the full pool
+    ASSERT_THROW(child.get_future().get(), QueueFullException);
+    ASSERT_FALSE(childExecuted);
+}
+
+TEST(continuationTest, wideFanOutIsReleased)
+{
+    // Wide enough to be released in parallel by several release tasks
+    constexpr std::size_t childCount{10000};
+    SimpleThreadPool thPool(4);
+    thPool.start();
+    std::atomic<std::size_t> executed{0};
+
+    TaskCompletionSource source(thPool);
+    auto root = source.get_task();
+    std::vector<ContinuationTask> childs;
+    for (std::size_t idx = 0; idx < childCount; ++idx)
+    {
+        childs.push_back(root.continue_with([&]() { ++executed; }));
+    }
+
+    source.set_done();
+    for (auto& child : childs)
+    {
+        ASSERT_EQ(std::future_status::ready, child.get_future().wait_for(std::chrono::seconds(60)));
+    }
+    ASSERT_EQ(childCount, executed.load());
+}
+
+TEST(continuationTest, fanOutPartlyRefusedByFullPool)
+{
+    constexpr std::size_t capacity{10};
+    constexpr std::size_t childCount{100};
+    // The pool is not started, so the queue will not be emptied
+    SimpleThreadPool thPool(1, capacity, SimpleThreadPool::OverflowPolicy::Reject);
+
+    TaskCompletionSource source(thPool);
+    std::vector<ContinuationTask> childs;
+    for (std::size_t idx = 0; idx < childCount; ++idx)
+    {
+        childs.push_back(source.get_task().continue_with([]() {}));
+    }
+
+    source.set_done();
+    for (std::size_t idx = 0; idx < childCount; ++idx)
+    {
+        auto& future = childs[idx].get_future();
+        if (idx < capacity)
+        {
+            ASSERT_EQ(std::future_status::timeout, future.wait_for(std::chrono::seconds(0)));
+        }
+        else
+        {
+            ASSERT_THROW(future.get(), QueueFullException);
+        }
+    }
+}
+
+namespace
+{
+    std::thread::id getPoolThreadId(IThreadPool& thPool)
+    {
+        std::promise<std::thread::id> id;
+        thPool.schedule([&]() { id.set_value(std::this_thread::get_id()); });
+        return id.get_future().get();
+    }
+}
+
+TEST(continuationTest, continuationsHopBetweenPools)
+{
+    SimpleThreadPool cpuPool(1);
+    SimpleThreadPool ioPool(1);
+    cpuPool.start();
+    ioPool.start();
+    const auto cpuThread = getPoolThreadId(cpuPool);
+    const auto ioThread = getPoolThreadId(ioPool);
+
+    std::array<std::thread::id, 4> executedOn{};
+    ContinuationTask task(cpuPool, [&]() { executedOn[0] = std::this_thread::get_id(); });
+    auto io = task.continue_with(ioPool, [&]() { executedOn[1] = std::this_thread::get_id(); });
+    // The pool is inherited from the parent
+    auto ioChild = io.continue_with([&]() { executedOn[2] = std::this_thread::get_id(); });
+    auto cpu = ioChild.continue_with(cpuPool, [&]() { executedOn[3] = std::this_thread::get_id(); });
+
+    ASSERT_EQ(std::future_status::ready, cpu.get_future().wait_for(std::chrono::seconds(60)));
+    ASSERT_EQ(cpuThread, executedOn[0]);
+    ASSERT_EQ(ioThread, executedOn[1]);
+    ASSERT_EQ(ioThread, executedOn[2]);
+    ASSERT_EQ(cpuThread, executedOn[3]);
+}
+
+TEST(continuationTest, cancellationCrossesPools)
+{
+    CancellationSource cs;
+    SimpleThreadPool cpuPool(1);
+    SimpleThreadPool ioPool(1);
+    std::atomic_bool childExecuted{false};
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool release{false};
+
+    cpuPool.start();
+    ioPool.start();
+
+    ContinuationTask task(cpuPool, [&]() {
+        std::unique_lock<std::mutex> lk(mtx);
+        cv.wait(lk, [&]() { return release; });
+    }, cs.get_token());
+    auto child = task.continue_with(ioPool, [&]() { childExecuted = true; });
+
+    cs.cancel();
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        release = true;
+        cv.notify_one();
+    }
+
+    ASSERT_THROW(child.get_future().get(), CanceledException);
+    ASSERT_FALSE(childExecuted);
+}
+
+TEST(continuationTest, completionSourceReleasesContinuations)
+{
+    SimpleThreadPool thPool(1);
+    thPool.start();
+    TaskCompletionSource source(thPool);
+    std::atomic_bool childExecuted{false};
+
+    auto task = source.get_task();
+    auto child = task.continue_with([&]() { childExecuted = true; });
+
+    ASSERT_EQ(std::future_status::timeout, child.get_future().wait_for(std::chrono::milliseconds(50)));
+    ASSERT_FALSE(childExecuted);
+
+    source.set_done();
+    ASSERT_EQ(std::future_status::ready, child.get_future().wait_for(std::chrono::seconds(60)));
+    ASSERT_TRUE(childExecuted);
+    ASSERT_THROW(source.set_done(), std::future_error);
+}
+
+TEST(continuationTest, completionSourceException)
+{
+    SimpleThreadPool thPool(1);
+    TaskCompletionSource source(thPool);
+
+    source.set_exception(std::make_exception_ptr(CanceledException()));
+    ASSERT_THROW(source.get_task().get_future().get(), CanceledException);
+}
+
+TEST(continuationTest, deferredTaskIsNotScheduledTillStarted)
+{
+    SimpleThreadPool thPool(2);
+    thPool.start();
+    std::atomic_bool executed{false};
+
+    auto task = ContinuationTask::deferred(thPool, [&]() { executed = true; });
+    ASSERT_EQ(std::future_status::timeout, task.get_future().wait_for(std::chrono::milliseconds(50)));
+    ASSERT_FALSE(executed);
+
+    task.start();
+    ASSERT_EQ(std::future_status::ready, task.get_future().wait_for(std::chrono::seconds(60)));
+    ASSERT_TRUE(executed);
+
+    // Repeated start has no effect
+    task.start();
+}
+
+TEST(continuationTest, deferredChainIsSubmittedByStart)
+{
+    constexpr std::size_t chainLength{50};
+    SimpleThreadPool thPool(4);
+    thPool.start();
+    std::vector<std::size_t> order;
+    std::atomic<std::size_t> executed{0};
+
+    auto root = ContinuationTask::deferred(thPool, [&]() {
+        order.push_back(0);
+        ++executed;
+    });
+    auto task = root;
+    for (std::size_t idx = 1; idx < chainLength; ++idx)
+    {
+        task = task.continue_with([&, idx]() {
+            order.push_back(idx);
+            ++executed;
+        });
+    }
+    // A fan-out on the deferred root
+    std::vector<ContinuationTask> siblings;
+    for (std::size_t idx = 0; idx < 10; ++idx)
+    {
+        siblings.push_back(root.continue_with([&]() { ++executed; }));
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    ASSERT_EQ(0u, executed.load());
+
+    root.start();
+    ASSERT_EQ(std::future_status::ready, task.get_future().wait_for(std::chrono::seconds(60)));
+    for (auto& sibling : siblings)
+    {
+        ASSERT_EQ(std::future_status::ready, sibling.get_future().wait_for(std::chrono::seconds(60)));
+    }
+
+    ASSERT_EQ(chainLength + siblings.size(), executed.load());
+    for (std::size_t idx = 0; idx < chainLength; ++idx)
+    {
+        ASSERT_EQ(idx, order[idx]);
+    }
+
+    // After the start, the chain behaves as a not deferred one
+    std::atomic_bool lateExecuted{false};
+    auto late = task.continue_with([&]() { lateExecuted = true; });
+    ASSERT_EQ(std::future_status::ready, late.get_future().wait_for(std::chrono::seconds(60)));
+    ASSERT_TRUE(lateExecuted);
+}
+
+TEST(continuationTest, startOfDeferredContinuationHasNoEffect)
+{
+    SimpleThreadPool thPool(2);
+    thPool.start();
+    std::atomic<int> executed{0};
+
+    auto root = ContinuationTask::deferred(thPool, []() {});
+    auto child = root.continue_with([&]() { ++executed; });
+    child.start();
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    ASSERT_EQ(0, executed.load());
+
+    root.start();
+    ASSERT_EQ(std::future_status::ready, child.get_future().wait_for(std::chrono::seconds(60)));
+    // Give a second execution the chance to show up
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    ASSERT_EQ(1, executed.load());
+}
+
+TEST(continuationTest, movedFromTaskCanBeCopied)
+{
+    SimpleThreadPool thPool(1);
+    auto task = ContinuationTask::deferred(thPool, []() {});
+    auto moved = std::move(task);
+
+    // The moved-from task holds nothing, its copies neither
+    ContinuationTask copy(task);
+    ContinuationTask assigned = moved;
+    assigned = task;
+    task = moved;
+
+    ASSERT_FALSE(task.is_ready());
+    ASSERT_FALSE(moved.is_ready());
+}
+
+TEST(continuationTest, pendingContinuationsAreCompact)
+{
+    constexpr std::size_t chainLength{10000};
+    // One block of the 128 bytes size class of the SmallObjectPool (two cache lines) per continuation, a grown node
+    // moves to the next size class
+    constexpr std::size_t bytesPerContinuation{128};
+    // The pool allocates the blocks one by one, so there is no slab to fill, only the counter is shared with other threads
+    constexpr std::size_t slackBytes{4096};
+    SimpleThreadPool thPool(1);
+
+    // Not started, so the whole chain stays pending and no pool thread allocates meanwhile
+    auto root = ContinuationTask::deferred(thPool, []() {});
+    const auto liveBytes = AllocationCounter::liveBytes();
+    const auto allocations = AllocationCounter::thread().allocations;
+    {
+        auto task = root;
+        for (std::size_t idx = 0; idx < chainLength; ++idx)
+        {
+            task = task.continue_with([]() {});
+        }
+    }
+
+    // Blocks recycled by the small object pool are not allocated again
+    ASSERT_GE(chainLength, AllocationCounter::thread().allocations - allocations);
+    ASSERT_GE(chainLength * bytesPerContinuation + slackBytes, AllocationCounter::liveBytes() - liveBytes);
+}
+
+TEST(continuationTest, completedAncestorsAreReleased)
+{
+    constexpr std::size_t chainLength{10000};
+    // Only the tail, its future and what the pool keeps for its queue may stay allocated
+    constexpr std::size_t retainedBytes{4096};
+    SimpleThreadPool thPool(2);
+    thPool.start();
+    std::atomic<std::size_t> executed{0};
+
+    const auto runChain = [&]() {
+        ContinuationTask task(thPool, [&]() { ++executed; });
+        for (std::size_t idx = 1; idx < chainLength; ++idx)
+        {
+            task = task.continue_with([&]() { ++executed; });
+        }
+
+        return task.get_future().wait_for(std::chrono::seconds(60));
+    };
+
+    // The first chain fills the caches of the small object pool, whatever the tests run before
+    ASSERT_EQ(std::future_status::ready, runChain());
+    const auto liveBytes = AllocationCounter::liveBytes();
+    ASSERT_EQ(std::future_status::ready, runChain());
+    thPool.stop();
+
+    ASSERT_EQ(2 * chainLength, executed.load());
+    // The stopped workers return their caches, the live bytes can also drop
+    ASSERT_GE(liveBytes + retainedBytes, AllocationCounter::liveBytes());
+}
+
+TEST(continuationTest, failureSkipsContinuations)
+{
+    ManualExecutor executor;
+    std::atomic<std::size_t> executed{0};
+
+    ContinuationTask root(executor, []() { throw std::runtime_error("failure"); });
+    auto child = root.continue_with([&]() { ++executed; });
+    auto grandChild = child.continue_with([&]() { ++executed; });
+
+    // Only the root is executed, the failure is propagated without using the executor
+    ASSERT_EQ(1u, executor.run_until_idle());
+    ASSERT_EQ(0u, executed.load());
+    ASSERT_THROW(child.get_future().get(), std::runtime_error);
+    ASSERT_THROW(grandChild.get_future().get(), std::runtime_error);
+
+    // Continuations of the already failed task are completed immediately too
+    auto late = root.continue_with([&]() { ++executed; });
+    ASSERT_EQ(0u, executor.run_until_idle());
+    ASSERT_THROW(late.get_future().get(), std::runtime_error);
+}
+
+TEST(continuationTest, continuationReceivesOutcome)
+{
+    ManualExecutor executor;
+    std::exception_ptr failedOutcome;
+    std::exception_ptr succeededOutcome = std::make_exception_ptr(std::logic_error("not set"));
+
+    ContinuationTask failing(executor, []() { throw std::runtime_error("failure"); });
+    auto handler = failing.continue_with([&](std::exception_ptr outcome) { failedOutcome = outcome; });
+    auto next = handler.continue_with([&](std::exception_ptr outcome) { succeededOutcome = outcome; });
+
+    ASSERT_EQ(3u, executor.run_until_idle());
+    ASSERT_THROW(std::rethrow_exception(failedOutcome), std::runtime_error);
+    ASSERT_FALSE(succeededOutcome);
+    // The handled failure does not propagate further
+    ASSERT_NO_THROW(handler.get_future().get());
+    ASSERT_NO_THROW(next.get_future().get());
+}
+
+TEST(continuationTest, continuationsDoNotAllocateAfterWarmUp)
+{
+    constexpr std::size_t chainLength{100};
+    ManualExecutor executor;
+    std::size_t executed{0};
+
+    const auto runChain = [&]() {
+        ContinuationTask task(executor, [&]() { ++executed; });
+        for (std::size_t idx = 1; idx < chainLength; ++idx)
+        {
+            task = task.continue_with([&]() { ++executed; });
+        }
+        executor.run_until_idle();
+    };
+
+    // Fills the recycled tasks and the queue of the executor
+    runChain();
+
+    AllocationCounter::Scope scope;
+    runChain();
+    const auto allocations = scope.delta().allocations;
+
+    ASSERT_EQ(2 * chainLength, executed);
+    ASSERT_EQ(0u, allocations);
+}
+
+TEST(continuationTest, continuationTagsReachThePool)
+{
+    SimpleThreadPool thPool(2);
+    thPool.setProfiling(true);
+    TaskCompletionSource source(thPool);
+    std::vector<ContinuationTask> continuations;
+
+    // Released together by one completion, the differently tagged continuations are not given to the pool as one batch
+    auto parent = source.get_task();
+    continuations.push_back(parent.continue_with(TaskHints{TaskHints::noAffinity, "first"}, []() {}));
+    continuations.push_back(parent.continue_with(TaskHints{TaskHints::noAffinity, "second"}, []() {}));
+    continuations.push_back(parent.continue_with(TaskHints{TaskHints::noAffinity, "second"}, []() {}));
+    thPool.start();
+    source.set_done();
+    for (auto& continuation : continuations)
+    {
+        continuation.get_future().get();
+    }
+    thPool.stop();
+
+    const auto profile = thPool.profile();
+    ASSERT_EQ(2u, profile.size());
+    for (const auto& tag : profile)
+    {
+        ASSERT_EQ(std::string(tag.tag) == "first" ? 1u : 2u, tag.count) << tag.tag;
+    }
+}
+
+TEST(continuationTest, expiredTaskIsCanceled)
+{
+    SimpleThreadPool thPool(1);
+    thPool.setExpiredPolicy(SimpleThreadPool::ExpiredPolicy::Drop);
+    bool executed{false};
+    bool continued{false};
+
+    ContinuationTask task(thPool,
+                          TaskHints{TaskHints::noAffinity, nullptr, SimpleThreadPool::Clock::now() - std::chrono::milliseconds(1)},
+                          [&executed]() { executed = true; });
+    auto continuation = task.continue_with([&continued]() { continued = true; });
+    thPool.start();
+
+    ASSERT_THROW(continuation.get_future().get(), CanceledException);
+    ASSERT_THROW(task.get_future().get(), CanceledException);
+    thPool.stop();
+    ASSERT_FALSE(executed);
+    ASSERT_FALSE(continued);
+    ASSERT_EQ(1u, thPool.expiredCount());
+}
+
+TEST(continuationTest, waitBlocksOutsideOfFiber)
+{
+    SimpleThreadPool thPool(1);
+    thPool.start();
+    std::atomic<bool> executed{false};
+
+    ContinuationTask task(thPool, [&executed]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        executed = true;
+    });
+    task.wait();
+
+    ASSERT_TRUE(task.is_ready());
+    ASSERT_TRUE(executed);
+    thPool.stop();
 }
\ No newline at end of file
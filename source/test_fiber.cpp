@@ -0,0 +1,65 @@
+#include <gtest\gtest.h>
+
+#include <vector>
+
+#include "fiber.h"
+
+namespace
+{
+    struct Trace
+    {
+        std::vector<int> steps;
+        int wakeCount{0};
+        Fiber* seen{nullptr};
+    };
+
+    void wake(void* trace)
+    {
+        ++static_cast<Trace*>(trace)->wakeCount;
+    }
+}
+
+TEST(fiberTest, suspendedFiberIsResumed)
+{
+    Trace trace;
+    Fiber fiber(64 * 1024, &wake, &trace);
+
+    fiber.start(
+        [](void* argument) {
+            auto& trace = *static_cast<Trace*>(argument);
+            trace.steps.push_back(1);
+            Fiber::suspend([](void* argument) { static_cast<Trace*>(argument)->steps.push_back(2); }, &trace);
+            trace.steps.push_back(3);
+        },
+        &trace);
+
+    // The callback of the suspension runs on the thread after the switch
+    ASSERT_EQ((std::vector<int>{1, 2}), trace.steps);
+    ASSERT_FALSE(fiber.finished());
+
+    fiber.wake();
+    ASSERT_EQ(1, trace.wakeCount);
+
+    fiber.resume();
+    ASSERT_EQ((std::vector<int>{1, 2, 3}), trace.steps);
+    ASSERT_TRUE(fiber.finished());
+}
+
+TEST(fiberTest, finishedFiberIsReused)
+{
+    Trace trace;
+    Fiber fiber(64 * 1024, &wake, &trace);
+    const auto method = [](void* argument) {
+        auto& trace = *static_cast<Trace*>(argument);
+        trace.seen = Fiber::current();
+        trace.steps.push_back(static_cast<int>(trace.steps.size()));
+    };
+
+    fiber.start(method, &trace);
+    fiber.start(method, &trace);
+
+    ASSERT_TRUE(fiber.finished());
+    ASSERT_EQ((std::vector<int>{0, 1}), trace.steps);
+    ASSERT_EQ(&fiber, trace.seen);
+    ASSERT_EQ(nullptr, Fiber::current());
+}
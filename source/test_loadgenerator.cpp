@@ -0,0 +1,188 @@
+#include <gtest\gtest.h>
+
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "SimpleThreadPool.h"
+#include "load_generator.h"
+
+namespace
+{
+    using namespace std::chrono_literals;
+
+    // Executes the tasks on the submitting thread, so a slow task delays the submission of the next requests
+    class InlinePool final : public IThreadPool
+    {
+    protected:
+        void scheduleInner(MethodType&& method) override
+        {
+            (*method)();
+        }
+    };
+
+    double toMicroseconds(LoadGenerator::Clock::duration duration)
+    {
+        return std::chrono::duration<double, std::micro>(duration).count();
+    }
+
+    void print(const char* name, const LoadGenerator::Report& report)
+    {
+        std::cout << name << ": p50 " << toMicroseconds(report.p50) << " us, p99 " << toMicroseconds(report.p99)
+                  << " us, p99.9 " << toMicroseconds(report.p999) << " us, max " << toMicroseconds(report.max)
+                  << " us, " << report.throughput << " requests/s" << std::endl;
+    }
+}
+
+TEST(loadGeneratorTest, percentilesAreNearestRank)
+{
+    std::vector<LoadGenerator::Clock::duration> latencies;
+    for (int idx = 1; idx <= 1000; ++idx)
+    {
+        latencies.push_back(std::chrono::milliseconds(idx));
+    }
+    std::shuffle(latencies.begin(), latencies.end(), std::mt19937());
+
+    const auto report = LoadGenerator::summarize(latencies, 2s);
+
+    ASSERT_EQ(1000u, report.completed);
+    ASSERT_EQ(std::chrono::milliseconds(500), report.p50);
+    ASSERT_EQ(std::chrono::milliseconds(990), report.p99);
+    ASSERT_EQ(std::chrono::milliseconds(999), report.p999);
+    ASSERT_EQ(std::chrono::milliseconds(1000), report.max);
+    ASSERT_DOUBLE_EQ(500.0, report.throughput);
+}
+
+TEST(loadGeneratorTest, arrivalsKeepTheRate)
+{
+    LoadGenerator::Config config;
+    config.rate = 10000.0;
+    config.requestCount = 10000;
+    const LoadGenerator poisson(config);
+
+    // The sum of 10000 exponential gaps is within 5% of the mean with an overwhelming probability
+    const double last = std::chrono::duration<double>(poisson.arrivals().back()).count();
+    ASSERT_NEAR(1.0, last, 0.05);
+    ASSERT_TRUE(std::is_sorted(poisson.arrivals().begin(), poisson.arrivals().end()));
+
+    config.arrival = LoadGenerator::Arrival::Bursty;
+    config.rate = 1000.0;
+    config.burstSize = 10;
+    const LoadGenerator bursty(config);
+
+    ASSERT_EQ(bursty.arrivals()[0], bursty.arrivals()[9]);
+    ASSERT_EQ(std::chrono::milliseconds(10), bursty.arrivals()[10]);
+    ASSERT_EQ(std::chrono::milliseconds(20), bursty.arrivals()[29]);
+}
+
+TEST(loadGeneratorTest, latencyIncludesDelayOfLateSubmitter)
+{
+    LoadGenerator::Config config;
+    config.rate = 1000.0;
+    config.arrival = LoadGenerator::Arrival::Bursty;
+    config.meanWork = 2ms;
+    config.requestCount = 20;
+    InlinePool pool;
+
+    const auto report = LoadGenerator(config).run(pool);
+
+    // Each task takes 2 ms while a request arrives every 1 ms, the last one is submitted about 20 ms late. Measured
+    // from the submission every latency would be 2 ms.
+    ASSERT_EQ(20u, report.completed);
+    ASSERT_GE(report.p50, 8ms);
+    ASSERT_GE(report.max, 15ms);
+}
+
+TEST(loadGeneratorTest, continuationGraphsAreCompleted)
+{
+    SimpleThreadPool thPool(4);
+    thPool.start();
+
+    LoadGenerator::Config config;
+    config.rate = 0.0;
+    config.meanWork = 100us;
+    config.requestCount = 200;
+    config.shape = LoadGenerator::Shape::Chain;
+    config.shapeSize = 5;
+    const auto chains = LoadGenerator(config).run(thPool);
+
+    ASSERT_EQ(200u, chains.completed);
+    // The tasks of a chain run one after another
+    ASSERT_GE(chains.p50, 500us);
+
+    config.shape = LoadGenerator::Shape::FanOut;
+    config.work = LoadGenerator::Work::Exponential;
+    const auto fanOuts = LoadGenerator(config).run(thPool);
+
+    ASSERT_EQ(200u, fanOuts.completed);
+    ASSERT_GT(fanOuts.throughput, 0.0);
+    thPool.stop();
+}
+
+TEST(loadGeneratorTest, refusedContinuationGraphsAreRejected)
+{
+    SimpleThreadPool thPool(1, 1, SimpleThreadPool::OverflowPolicy::Reject);
+    thPool.start();
+
+    LoadGenerator::Config config;
+    config.rate = 0.0;
+    config.meanWork = 100us;
+    config.requestCount = 200;
+    config.shape = LoadGenerator::Shape::Chain;
+    config.shapeSize = 5;
+    // All requests at once overflow the pool, the run still ends
+    const auto chains = LoadGenerator(config).run(thPool);
+
+    ASSERT_GT(chains.rejected, 0u);
+    ASSERT_EQ(200u, chains.completed + chains.rejected);
+
+    config.shape = LoadGenerator::Shape::FanOut;
+    const auto fanOuts = LoadGenerator(config).run(thPool);
+
+    ASSERT_GT(fanOuts.rejected, 0u);
+    ASSERT_EQ(200u, fanOuts.completed + fanOuts.rejected);
+    thPool.stop();
+}
+
+// Not a real test, it reports the tail latency of the pool variants under the same load and their saturated throughput.
+// Disabled, it takes seconds; run it by --gtest_also_run_disabled_tests.
+// Results are meaningful only in release builds on a machine with at least four free cores.
+TEST(loadGeneratorBenchmark, DISABLED_simpleThreadPoolVariants)
+{
+    LoadGenerator::Config config;
+    config.rate = 20000.0;
+    config.work = LoadGenerator::Work::Exponential;
+    config.meanWork = 20us;
+    config.requestCount = 10000;
+    const LoadGenerator poisson(config);
+
+    config.arrival = LoadGenerator::Arrival::Bursty;
+    config.burstSize = 100;
+    const LoadGenerator bursty(config);
+
+    config.rate = 0.0;
+    const LoadGenerator saturating(config);
+
+    config.shape = LoadGenerator::Shape::Chain;
+    config.shapeSize = 4;
+    const LoadGenerator chains(config);
+
+    SimpleThreadPool plain(4);
+    plain.start();
+    print("SimpleThreadPool Poisson", poisson.run(plain));
+    print("SimpleThreadPool bursty", bursty.run(plain));
+    print("SimpleThreadPool saturated", saturating.run(plain));
+    print("SimpleThreadPool saturated chains", chains.run(plain));
+    plain.stop();
+
+    SimpleThreadPool coalescing(4);
+    coalescing.setCoalescing(16, 50us);
+    coalescing.start();
+    print("SimpleThreadPool coalescing Poisson", poisson.run(coalescing));
+    print("SimpleThreadPool coalescing bursty", bursty.run(coalescing));
+    print("SimpleThreadPool coalescing saturated", saturating.run(coalescing));
+    print("SimpleThreadPool coalescing saturated chains", chains.run(coalescing));
+    coalescing.stop();
+}
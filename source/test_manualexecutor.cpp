@@ -0,0 +1,143 @@
+#include <gtest\gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "ManualExecutor.h"
+#include "continuation_task.h"
+
+namespace
+{
+    class TestException : public std::exception
+    {
+    };
+}
+
+TEST(manualExecutorTest, tasksAreExecutedOnlyByRunMethods)
+{
+    ManualExecutor executor;
+    std::vector<int> executed;
+
+    for (int idx = 0; idx < 3; ++idx)
+    {
+        executor.schedule([&, idx]() { executed.push_back(idx); });
+    }
+    ASSERT_TRUE(executed.empty());
+
+    ASSERT_TRUE(executor.run_one());
+    ASSERT_EQ(1u, executed.size());
+
+    ASSERT_EQ(2u, executor.run_until_idle());
+    ASSERT_EQ((std::vector<int>{0, 1, 2}), executed);
+    ASSERT_FALSE(executor.run_one());
+}
+
+TEST(manualExecutorTest, tasksScheduledByTasksAreExecutedWhenRunningTillIdle)
+{
+    ManualExecutor executor;
+    int depth{0};
+
+    std::function<void()> recurse = [&]() {
+        if (++depth < 10)
+            executor.schedule([&]() { recurse(); });
+    };
+    executor.schedule([&]() { recurse(); });
+
+    ASSERT_EQ(10u, executor.run_until_idle());
+    ASSERT_EQ(10, depth);
+}
+
+TEST(manualExecutorTest, tasksFromOtherThreadsAreExecutedOnOwner)
+{
+    constexpr std::size_t producerCount{3};
+    constexpr std::size_t taskCount{1000};
+    ManualExecutor executor;
+    const auto owner = std::this_thread::get_id();
+    std::size_t executed{0};
+    bool onOwner{true};
+
+    std::vector<std::thread> producers;
+    for (std::size_t producer = 0; producer < producerCount; ++producer)
+    {
+        producers.emplace_back([&]() {
+            for (std::size_t idx = 0; idx < taskCount; ++idx)
+            {
+                executor.schedule([&]() {
+                    onOwner = onOwner && std::this_thread::get_id() == owner;
+                    ++executed;
+                });
+            }
+        });
+    }
+
+    using Clock = std::chrono::high_resolution_clock;
+    const auto start = Clock::now();
+    while (executed != producerCount * taskCount && (Clock::now() - start) <= std::chrono::seconds(60))
+    {
+        executor.run_for(std::chrono::milliseconds(10));
+    }
+
+    for (auto& producer : producers)
+    {
+        producer.join();
+    }
+
+    ASSERT_EQ(producerCount * taskCount, executed);
+    ASSERT_TRUE(onOwner);
+}
+
+TEST(manualExecutorTest, runForWakesUpOnNewTask)
+{
+    ManualExecutor executor;
+    std::atomic_bool executed{false};
+
+    std::thread producer([&]() {
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        executor.schedule([&]() { executed = true; });
+    });
+
+    const auto count = executor.run_for(std::chrono::milliseconds(500));
+    producer.join();
+
+    ASSERT_EQ(1u, count);
+    ASSERT_TRUE(executed);
+}
+
+TEST(manualExecutorTest, exceptionsArePropagatedToRunCaller)
+{
+    ManualExecutor executor;
+    bool secondExecuted{false};
+
+    executor.schedule([]() { throw TestException(); });
+    executor.schedule([&]() { secondExecuted = true; });
+
+    ASSERT_THROW(executor.run_until_idle(), TestException);
+    ASSERT_FALSE(secondExecuted);
+    ASSERT_EQ(1u, executor.run_until_idle());
+    ASSERT_TRUE(secondExecuted);
+}
+
+TEST(manualExecutorTest, continuationChainRunsOnOwnerThread)
+{
+    ManualExecutor executor;
+    const auto owner = std::this_thread::get_id();
+    std::vector<std::thread::id> executedOn;
+
+    ContinuationTask task(executor, [&]() { executedOn.push_back(std::this_thread::get_id()); });
+    for (int idx = 0; idx < 5; ++idx)
+    {
+        task = task.continue_with([&]() { executedOn.push_back(std::this_thread::get_id()); });
+    }
+
+    executor.run_until_idle();
+
+    ASSERT_EQ(std::future_status::ready, task.get_future().wait_for(std::chrono::seconds(0)));
+    ASSERT_EQ(6u, executedOn.size());
+    for (auto& id : executedOn)
+    {
+        ASSERT_EQ(owner, id);
+    }
+}
@@ -0,0 +1,272 @@
+#include <gtest\gtest.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <future>
+#include <memory>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "SimpleThreadPool.h"
+#include "allocation_counter.h"
+#include "pipeline.h"
+#include "small_object_pool.h"
+
+namespace
+{
+    std::atomic<std::size_t> hookedAllocations{0};
+
+    void countAllocation(std::size_t)
+    {
+        hookedAllocations.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+TEST(pipelineTest, serialStagesKeepOrder)
+{
+    constexpr int messageCount{10000};
+    SimpleThreadPool thPool(4);
+    thPool.start();
+    std::vector<std::string> received;
+
+    auto stream = pipeline<int>(thPool)
+                      .serial([](int value) { return value * 2; })
+                      .serial([](int value) { return std::to_string(value); })
+                      .serial([&](std::string text) { received.push_back(std::move(text)); })
+                      .build();
+
+    for (int idx = 0; idx < messageCount; ++idx)
+    {
+        stream.push(int{idx});
+    }
+    stream.wait();
+
+    ASSERT_EQ(static_cast<std::size_t>(messageCount), received.size());
+    for (int idx = 0; idx < messageCount; ++idx)
+    {
+        ASSERT_EQ(std::to_string(idx * 2), received[idx]);
+    }
+}
+
+TEST(pipelineTest, parallelStageRestoresOrder)
+{
+    constexpr int messageCount{2000};
+    SimpleThreadPool thPool(4);
+    thPool.start();
+    std::vector<int> received;
+
+    auto stream = pipeline<int>(thPool)
+                      .serial([](int value) { return value; })
+                      .parallel(4,
+                                [](int value) {
+                                    // Uneven processing times, the later messages would overtake the earlier ones
+                                    if (value % 7 == 0)
+                                    {
+                                        std::this_thread::sleep_for(std::chrono::microseconds(100));
+                                    }
+                                    return value + 1;
+                                })
+                      .serial([&](int value) { received.push_back(value); })
+                      .build();
+
+    for (int idx = 0; idx < messageCount; ++idx)
+    {
+        stream.push(int{idx});
+    }
+    stream.wait();
+
+    std::vector<int> expected(messageCount);
+    std::iota(expected.begin(), expected.end(), 1);
+    ASSERT_EQ(expected, received);
+}
+
+TEST(pipelineTest, unorderedParallelStagesProcessAll)
+{
+    constexpr int messageCount{2000};
+    SimpleThreadPool thPool(4);
+    thPool.start();
+    std::vector<int> received;
+
+    // The first parallel stage is distributed by the source, the messages stay in their lanes for the second one
+    auto stream = pipeline<int>(thPool)
+                      .parallel(3, [](int value) { return value * 3; }, StageOrder::Any)
+                      .parallel(3, [](int value) { return value + 1; }, StageOrder::Any)
+                      .serial([&](int value) { received.push_back(value); })
+                      .build();
+
+    for (int idx = 0; idx < messageCount; ++idx)
+    {
+        stream.push(int{idx});
+    }
+    stream.wait();
+
+    std::sort(received.begin(), received.end());
+    ASSERT_EQ(static_cast<std::size_t>(messageCount), received.size());
+    for (int idx = 0; idx < messageCount; ++idx)
+    {
+        ASSERT_EQ(idx * 3 + 1, received[idx]);
+    }
+}
+
+TEST(pipelineTest, fullRingsPushBackToSource)
+{
+    SimpleThreadPool thPool(2);
+    thPool.start();
+    std::promise<void> release;
+    auto released = release.get_future().share();
+    std::atomic<int> consumed{0};
+
+    auto stream = pipeline<int, 4>(thPool)
+                      .serial([](int value) { return value; })
+                      .serial([&, released](int) {
+                          released.wait();
+                          ++consumed;
+                      })
+                      .build();
+
+    // The sink is stuck, so only the rings and the messages held by the stages are filled
+    int pushed{0};
+    while (stream.try_push(int{pushed}))
+    {
+        ++pushed;
+        ASSERT_GT(100, pushed);
+    }
+    ASSERT_LT(0, pushed);
+
+    release.set_value();
+    stream.push(int{pushed});
+    stream.wait();
+    ASSERT_EQ(pushed + 1, consumed.load());
+}
+
+TEST(pipelineTest, failedMessageIsDropped)
+{
+    SimpleThreadPool thPool(2);
+    thPool.start();
+    std::vector<int> received;
+
+    auto stream = pipeline<int>(thPool)
+                      .serial([](int value) {
+                          if (value == 3)
+                              throw std::runtime_error("failure");
+                          return value;
+                      })
+                      .serial([&](int value) { received.push_back(value); })
+                      .build();
+
+    for (int idx = 0; idx < 6; ++idx)
+    {
+        stream.push(int{idx});
+    }
+    stream.wait();
+
+    ASSERT_EQ((std::vector<int>{0, 1, 2, 4, 5}), received);
+    const auto exceptions = stream.exceptions();
+    ASSERT_EQ(1u, exceptions.size());
+    ASSERT_THROW(std::rethrow_exception(exceptions.front()), std::runtime_error);
+}
+
+TEST(pipelineTest, failedMessageOfParallelStageKeepsOrder)
+{
+    constexpr int messageCount{1000};
+    SimpleThreadPool thPool(4);
+    thPool.start();
+    std::vector<int> received;
+
+    // The failures hit all lanes, the collecting stage must not wait for the dropped messages
+    auto stream = pipeline<int>(thPool)
+                      .parallel(3,
+                                [](int value) {
+                                    if (value % 5 == 0)
+                                        throw std::runtime_error("failure");
+                                    return value;
+                                })
+                      .parallel(3, [](int value) { return value * 2; })
+                      .serial([&](int value) { received.push_back(value); })
+                      .build();
+
+    for (int idx = 0; idx < messageCount; ++idx)
+    {
+        stream.push(int{idx});
+    }
+    stream.wait();
+
+    std::vector<int> expected;
+    for (int idx = 0; idx < messageCount; ++idx)
+    {
+        if (idx % 5 != 0)
+        {
+            expected.push_back(idx * 2);
+        }
+    }
+    ASSERT_EQ(expected, received);
+    ASSERT_EQ(static_cast<std::size_t>(messageCount / 5), stream.exceptions().size());
+}
+
+TEST(pipelineTest, moveOnlyMessagesAndStages)
+{
+    SimpleThreadPool thPool(2);
+    thPool.start();
+    int sum{0};
+    auto offset = std::make_unique<int>(10);
+
+    auto stream = pipeline<std::unique_ptr<int>>(thPool)
+                      .serial([offset = std::move(offset)](std::unique_ptr<int> value) { return *value + *offset; })
+                      .serial([&](int value) { sum += value; })
+                      .build();
+
+    stream.push(std::make_unique<int>(1));
+    stream.push(std::make_unique<int>(2));
+    stream.wait();
+
+    ASSERT_EQ(23, sum);
+}
+
+TEST(pipelineTest, incompatibleParallelStagesAreRejected)
+{
+    SimpleThreadPool thPool(1);
+    auto identity = [](int value) { return value; };
+
+    ASSERT_THROW(pipeline<int>(thPool).parallel(2, identity).parallel(3, identity), std::invalid_argument);
+    ASSERT_THROW(pipeline<int>(thPool).parallel(2, identity).parallel(2, identity, StageOrder::Any), std::invalid_argument);
+    ASSERT_THROW(pipeline<int>(thPool).parallel(0, identity), std::invalid_argument);
+}
+
+TEST(pipelineTest, steadyStateDoesNotAllocate)
+{
+    constexpr int messageCount{5000};
+    SimpleThreadPool thPool(4);
+    thPool.start();
+    std::atomic<long long> sum{0};
+
+    auto stream = pipeline<int>(thPool)
+                      .serial([](int value) { return value + 1; })
+                      .parallel(3, [](int value) { return value * 2; })
+                      .serial([&](int value) { sum += value; })
+                      .build();
+
+    // The lanes are scheduled by all threads, so their tasks are reserved rather than left to settle in the thread caches
+    SmallObjectPool::reserve(64, 1024);
+    for (int idx = 0; idx < messageCount; ++idx)
+    {
+        stream.push(int{idx});
+    }
+    stream.wait();
+
+    // Allocations of all threads are counted, not only of the pushing one
+    hookedAllocations = 0;
+    AllocationCounter::setHook(&countAllocation);
+    for (int idx = 0; idx < messageCount; ++idx)
+    {
+        stream.push(int{idx});
+    }
+    stream.wait();
+    AllocationCounter::setHook(nullptr);
+
+    ASSERT_EQ(2LL * messageCount * (messageCount + 1), sum.load());
+    ASSERT_EQ(0u, hookedAllocations.load());
+}
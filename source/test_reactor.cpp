@@ -0,0 +1,236 @@
+#include <gtest\gtest.h>
+
+#ifdef __linux__
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "Reactor.h"
+#include "SimpleThreadPool.h"
+#include "canceled_exception.h"
+
+namespace
+{
+    constexpr auto timeout = std::chrono::seconds(60);
+
+    class Pipe final
+    {
+    public:
+        Pipe()
+        {
+            EXPECT_EQ(0, ::pipe(_fds));
+        }
+
+        ~Pipe()
+        {
+            ::close(_fds[0]);
+            ::close(_fds[1]);
+        }
+
+        int reader() const
+        {
+            return _fds[0];
+        }
+
+        int writer() const
+        {
+            return _fds[1];
+        }
+
+    private:
+        int _fds[2];
+    };
+}
+
+TEST(reactorTest, readCompletesWhenDataArrives)
+{
+    SimpleThreadPool thPool(1);
+    thPool.start();
+    Reactor reactor(thPool);
+    Pipe pipe;
+
+    std::array<char, 16> buffer{};
+    std::size_t transferred{0};
+    auto read = reactor.async_read(pipe.reader(), buffer.data(), buffer.size(), transferred);
+    std::atomic_bool continued{false};
+    auto next = read.continue_with([&]() { continued = true; });
+
+    ASSERT_EQ(std::future_status::timeout, read.get_future().wait_for(std::chrono::milliseconds(50)));
+
+    const std::string message{"hello"};
+    ASSERT_EQ(static_cast<ssize_t>(message.size()), ::write(pipe.writer(), message.data(), message.size()));
+
+    ASSERT_EQ(std::future_status::ready, next.get_future().wait_for(timeout));
+    read.get_future().get();
+    ASSERT_TRUE(continued);
+    ASSERT_EQ(message.size(), transferred);
+    ASSERT_EQ(message, std::string(buffer.data(), transferred));
+}
+
+TEST(reactorTest, readyDescriptorCompletesImmediately)
+{
+    SimpleThreadPool thPool(1);
+    thPool.start();
+    Reactor reactor(thPool);
+    Pipe pipe;
+
+    ASSERT_EQ(1, ::write(pipe.writer(), "x", 1));
+
+    auto wait = reactor.async_wait(pipe.reader(), Reactor::Interest::Read);
+    ASSERT_EQ(std::future_status::ready, wait.get_future().wait_for(std::chrono::seconds(0)));
+}
+
+TEST(reactorTest, writeAndReadOverSocketPair)
+{
+    SimpleThreadPool thPool(2);
+    thPool.start();
+    Reactor reactor(thPool);
+    int sockets[2];
+    ASSERT_EQ(0, ::socketpair(AF_UNIX, SOCK_STREAM, 0, sockets));
+
+    const std::string message{"socket message"};
+    std::array<char, 64> buffer{};
+    std::size_t written{0}, received{0};
+
+    auto read = reactor.async_read(sockets[1], buffer.data(), buffer.size(), received);
+    auto write = reactor.async_write(sockets[0], message.data(), message.size(), written);
+
+    ASSERT_EQ(std::future_status::ready, write.get_future().wait_for(timeout));
+    ASSERT_EQ(std::future_status::ready, read.get_future().wait_for(timeout));
+    write.get_future().get();
+    read.get_future().get();
+    ASSERT_EQ(message.size(), written);
+    ASSERT_EQ(message, std::string(buffer.data(), received));
+
+    ::close(sockets[0]);
+    ::close(sockets[1]);
+}
+
+TEST(reactorTest, acceptConnection)
+{
+    SimpleThreadPool thPool(1);
+    thPool.start();
+    Reactor reactor(thPool);
+
+    const int listener = ::socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT_LE(0, listener);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    address.sin_port = 0;
+    ASSERT_EQ(0, ::bind(listener, reinterpret_cast<sockaddr*>(&address), sizeof(address)));
+    ASSERT_EQ(0, ::listen(listener, 4));
+    socklen_t length = sizeof(address);
+    ASSERT_EQ(0, ::getsockname(listener, reinterpret_cast<sockaddr*>(&address), &length));
+
+    int accepted{-1};
+    auto accept = reactor.async_accept(listener, accepted);
+    ASSERT_EQ(std::future_status::timeout, accept.get_future().wait_for(std::chrono::milliseconds(50)));
+
+    const int client = ::socket(AF_INET, SOCK_STREAM, 0);
+    ASSERT_EQ(0, ::connect(client, reinterpret_cast<sockaddr*>(&address), sizeof(address)));
+
+    ASSERT_EQ(std::future_status::ready, accept.get_future().wait_for(timeout));
+    accept.get_future().get();
+    ASSERT_LE(0, accepted);
+
+    ::close(accepted);
+    ::close(client);
+    ::close(listener);
+}
+
+TEST(reactorTest, regularFileIsReadOnCompletionPool)
+{
+    SimpleThreadPool thPool(1);
+    thPool.start();
+    Reactor reactor(thPool);
+
+    char path[] = "/tmp/reactorTestXXXXXX";
+    const int file = ::mkstemp(path);
+    ASSERT_LE(0, file);
+    ::unlink(path);
+    const std::string content{"file content"};
+    ASSERT_EQ(static_cast<ssize_t>(content.size()), ::write(file, content.data(), content.size()));
+    ASSERT_EQ(0, ::lseek(file, 0, SEEK_SET));
+
+    std::array<char, 64> buffer{};
+    std::size_t transferred{0};
+    auto read = reactor.async_read(file, buffer.data(), buffer.size(), transferred);
+
+    ASSERT_EQ(std::future_status::ready, read.get_future().wait_for(timeout));
+    read.get_future().get();
+    ASSERT_EQ(content, std::string(buffer.data(), transferred));
+
+    ::close(file);
+}
+
+TEST(reactorTest, manyOutstandingReadsDoNotBlockThreads)
+{
+    constexpr std::size_t pairCount{200};
+    SimpleThreadPool thPool(1);
+    thPool.start();
+    Reactor reactor(thPool);
+
+    std::vector<std::array<int, 2>> sockets(pairCount);
+    std::vector<char> buffers(pairCount);
+    std::vector<std::size_t> transferred(pairCount);
+    std::vector<ContinuationTask> reads;
+    std::atomic<std::size_t> continued{0};
+
+    for (std::size_t idx = 0; idx < pairCount; ++idx)
+    {
+        ASSERT_EQ(0, ::socketpair(AF_UNIX, SOCK_STREAM, 0, sockets[idx].data()));
+        auto read = reactor.async_read(sockets[idx][1], &buffers[idx], 1, transferred[idx]);
+        reads.push_back(read.continue_with([&]() { ++continued; }));
+    }
+
+    // The only pool thread is not blocked by the outstanding reads
+    std::promise<void> poolFree;
+    thPool.schedule([&]() { poolFree.set_value(); });
+    ASSERT_EQ(std::future_status::ready, poolFree.get_future().wait_for(timeout));
+
+    for (std::size_t idx = 0; idx < pairCount; ++idx)
+    {
+        const char value = static_cast<char>(idx);
+        ASSERT_EQ(1, ::write(sockets[idx][0], &value, 1));
+    }
+
+    for (auto& read : reads)
+    {
+        ASSERT_EQ(std::future_status::ready, read.get_future().wait_for(timeout));
+    }
+    ASSERT_EQ(pairCount, continued.load());
+    for (std::size_t idx = 0; idx < pairCount; ++idx)
+    {
+        ASSERT_EQ(1u, transferred[idx]);
+        ASSERT_EQ(static_cast<char>(idx), buffers[idx]);
+        ::close(sockets[idx][0]);
+        ::close(sockets[idx][1]);
+    }
+}
+
+TEST(reactorTest, releaseCancelsPendingOperations)
+{
+    SimpleThreadPool thPool(1);
+    thPool.start();
+    Reactor reactor(thPool);
+    Pipe pipe;
+
+    char buffer{0};
+    std::size_t transferred{0};
+    auto read = reactor.async_read(pipe.reader(), &buffer, 1, transferred);
+
+    reactor.release(pipe.reader());
+    ASSERT_THROW(read.get_future().get(), CanceledException);
+}
+
+#endif
@@ -1,10 +1,22 @@
 #include <gtest\gtest.h>
 #include <array>
 #include <atomic>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <set>
 #include <stdexcept>
+#include <string>
+#include <thread>
 #include <unordered_map>
+#include <vector>
 
 #include "SimpleThreadPool.h"
+#include "allocation_counter.h"
+#include "continuation_task.h"
+#include "queue_full_exception.h"
+#include "task_completion_source.h"
+#include "task_group.h"
 
 // TODO mock std::thread used by the SimpleThreadPool and add true unit tests
 // OPEN the following tests are rather integration test (but they are also needed)
@@ -297,4 +309,898 @@ TEST(simpleThreadPoolTest, exceptionsWillNotLowerTheNumberOfThreadsInPool)
 
     thPool.stop();
     (void)thPool.popExceptions();
+}
+
+TEST(simpleThreadPoolTest, fullQueueRejectsTasks)
+{
+    constexpr std::size_t capacity{2};
+    // The pool is not started, so the queue will not be emptied
+    SimpleThreadPool thPool(1, capacity, SimpleThreadPool::OverflowPolicy::Reject);
+
+    for (std::size_t idx = 0; idx < capacity; ++idx)
+    {
+        ASSERT_TRUE(thPool.try_schedule([]() {}));
+    }
+
+    ASSERT_FALSE(thPool.try_schedule([]() {}));
+    ASSERT_THROW(thPool.schedule([]() {}), QueueFullException);
+    ASSERT_EQ(2u, thPool.queueFullCount());
+}
+
+TEST(simpleThreadPoolTest, fullQueueRunsTaskOnCaller)
+{
+    SimpleThreadPool thPool(1, 1, SimpleThreadPool::OverflowPolicy::RunOnCaller);
+    std::thread::id firstId, secondId;
+
+    thPool.schedule([](std::thread::id& id) { id = std::this_thread::get_id(); }, std::ref(firstId));
+    thPool.schedule([](std::thread::id& id) { id = std::this_thread::get_id(); }, std::ref(secondId));
+
+    ASSERT_EQ(std::thread::id(), firstId) << "the first task was enqueued, it can't be executed by a not started pool";
+    ASSERT_EQ(std::this_thread::get_id(), secondId);
+    ASSERT_EQ(1u, thPool.queueFullCount());
+}
+
+TEST(simpleThreadPoolTest, batchIsExecuted)
+{
+    constexpr std::size_t batchSize{100};
+    SimpleThreadPool thPool(4);
+    std::atomic<std::size_t> executed{0};
+
+    std::vector<IThreadPool::MethodType> methods;
+    for (std::size_t idx = 0; idx < batchSize; ++idx)
+    {
+        methods.push_back(Bind::bind([](std::atomic<std::size_t>& counter) { ++counter; }, std::ref(executed)));
+    }
+
+    thPool.schedule_batch(methods.data(), methods.size());
+    for (auto& method : methods)
+    {
+        ASSERT_FALSE(method) << "the pool takes the scheduled methods";
+    }
+
+    thPool.start();
+    while (executed < batchSize)
+    {
+        std::this_thread::yield();
+    }
+    thPool.stop();
+}
+
+TEST(simpleThreadPoolTest, fullQueueRejectsRestOfBatch)
+{
+    constexpr std::size_t capacity{3};
+    // The pool is not started, so the queue will not be emptied
+    SimpleThreadPool thPool(1, capacity, SimpleThreadPool::OverflowPolicy::Reject);
+
+    std::array<IThreadPool::MethodType, 5> methods;
+    for (auto& method : methods)
+    {
+        method = Bind::bind([]() {});
+    }
+
+    ASSERT_THROW(thPool.schedule_batch(methods.data(), methods.size()), QueueFullException);
+    for (std::size_t idx = 0; idx < methods.size(); ++idx)
+    {
+        ASSERT_EQ(idx >= capacity, static_cast<bool>(methods[idx]));
+    }
+    ASSERT_EQ(1u, thPool.queueFullCount());
+}
+
+TEST(simpleThreadPoolTest, fullQueueBlocksTillSpaceIsAvailable)
+{
+    SimpleThreadPool thPool(1, 1, SimpleThreadPool::OverflowPolicy::Block);
+    std::mutex mtx;
+    std::condition_variable cv;
+    bool release{false};
+    std::atomic_bool fullSignalized{false};
+    std::atomic_bool lastExecuted{false};
+
+    thPool.setQueueFullHandler([&]() { fullSignalized = true; });
+    thPool.start();
+
+    // Occupy the only thread of the pool
+    thPool.schedule([&]() {
+        std::unique_lock<std::mutex> lk(mtx);
+        cv.wait(lk, [&]() { return release; });
+    });
+    // Wait for the thread to take the task and fill the queue again
+    while (thPool.try_schedule([]() {}) == false)
+    {
+        std::this_thread::yield();
+    }
+    fullSignalized = false;
+
+    std::thread producer([&]() { thPool.schedule([&]() { lastExecuted = true; }); });
+
+    using Clock = std::chrono::high_resolution_clock;
+    const auto start = Clock::now();
+    while (!fullSignalized && (Clock::now() - start) <= std::chrono::seconds(60))
+    {
+        std::this_thread::yield();
+    }
+    ASSERT_TRUE(fullSignalized);
+    ASSERT_FALSE(lastExecuted);
+
+    {
+        std::lock_guard<std::mutex> lk(mtx);
+        release = true;
+        cv.notify_one();
+    }
+    producer.join();
+
+    while (!lastExecuted && (Clock::now() - start) <= std::chrono::seconds(60))
+    {
+        std::this_thread::yield();
+    }
+    ASSERT_TRUE(lastExecuted);
+
+    thPool.stop();
+    ASSERT_TRUE(thPool.popExceptions().empty());
+}
+
+TEST(simpleThreadPoolTest, tasksWithSameAffinityRunOnSameWorker)
+{
+    constexpr std::size_t keyCount{8};
+    constexpr std::size_t repetitions{10};
+    SimpleThreadPool thPool(4);
+    thPool.start();
+    std::set<std::thread::id> usedThreads;
+
+    for (std::size_t key = 0; key < keyCount; ++key)
+    {
+        std::thread::id keyThread;
+        for (std::size_t idx = 0; idx < repetitions; ++idx)
+        {
+            // One task at a time, so there is no imbalance and nothing is stolen
+            std::promise<std::thread::id> id;
+            thPool.schedule_with(TaskHints{key}, [&]() { id.set_value(std::this_thread::get_id()); });
+            const auto taskThread = id.get_future().get();
+
+            if (idx == 0)
+            {
+                keyThread = taskThread;
+            }
+            ASSERT_EQ(keyThread, taskThread) << "key " << key;
+        }
+        usedThreads.insert(keyThread);
+    }
+
+    ASSERT_LT(1u, usedThreads.size()) << "the keys are spread over the workers";
+}
+
+namespace
+{
+    void scheduleHop(SimpleThreadPool& thPool, std::vector<std::thread::id>& hops, std::size_t count, std::promise<void>& done)
+    {
+        hops.push_back(std::this_thread::get_id());
+        if (hops.size() == count)
+        {
+            done.set_value();
+            return;
+        }
+
+        thPool.schedule(&scheduleHop, std::ref(thPool), std::ref(hops), count, std::ref(done));
+    }
+}
+
+TEST(simpleThreadPoolTest, tasksScheduledByWorkerStayOnIt)
+{
+    constexpr std::size_t hopCount{50};
+    SimpleThreadPool thPool(4);
+    thPool.start();
+    std::vector<std::thread::id> hops;
+    std::promise<void> done;
+
+    thPool.schedule(&scheduleHop, std::ref(thPool), std::ref(hops), hopCount, std::ref(done));
+    done.get_future().get();
+
+    for (const auto& hop : hops)
+    {
+        ASSERT_EQ(hops.front(), hop);
+    }
+}
+
+TEST(simpleThreadPoolTest, backlogOfWorkerIsStolen)
+{
+    constexpr std::size_t taskCount{8};
+    SimpleThreadPool thPool(4);
+    thPool.start();
+    std::mutex mtx;
+    std::set<std::thread::id> usedThreads;
+    std::atomic<std::size_t> executed{0};
+
+    for (std::size_t idx = 0; idx < taskCount; ++idx)
+    {
+        // All tasks prefer the same worker and each of them takes a while
+        thPool.schedule_with(TaskHints{0}, [&]() {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+            {
+                std::lock_guard<std::mutex> lk(mtx);
+                usedThreads.insert(std::this_thread::get_id());
+            }
+            ++executed;
+        });
+    }
+
+    while (executed < taskCount)
+    {
+        std::this_thread::yield();
+    }
+    thPool.stop();
+
+    ASSERT_LT(1u, usedThreads.size());
+}
+
+TEST(simpleThreadPoolTest, scheduleDoesNotAllocateAfterWarmUp)
+{
+    constexpr std::size_t warmUpCount{1000};
+    constexpr std::size_t taskCount{100};
+    SimpleThreadPool thPool(2);
+    std::atomic<std::size_t> executed{0};
+
+    // The whole warm-up is queued before the workers start, so there are enough recycled tasks even if the workers
+    // keep some of them in their caches
+    for (std::size_t idx = 0; idx < warmUpCount; ++idx)
+    {
+        thPool.schedule([&]() { ++executed; });
+    }
+    thPool.start();
+    while (executed < warmUpCount)
+    {
+        std::this_thread::yield();
+    }
+
+    AllocationCounter::Scope scope;
+    for (std::size_t idx = 0; idx < taskCount; ++idx)
+    {
+        thPool.schedule([&]() { ++executed; });
+    }
+    while (executed < warmUpCount + taskCount)
+    {
+        std::this_thread::yield();
+    }
+    const auto allocations = scope.delta().allocations;
+    thPool.stop();
+
+    ASSERT_EQ(0u, allocations);
+}
+
+TEST(simpleThreadPoolTest, exceptionsOverCapacityAreDropped)
+{
+    constexpr std::size_t taskCount{20};
+    constexpr std::size_t capacity{3};
+    SimpleThreadPool thPool(2);
+    thPool.setExceptionCapacity(capacity);
+    std::atomic<std::size_t> executed{0};
+
+    for (std::size_t idx = 0; idx < taskCount; ++idx)
+    {
+        thPool.schedule([&]() {
+            ++executed;
+            throw TestException();
+        });
+    }
+    thPool.start();
+    while (executed < taskCount)
+    {
+        std::this_thread::yield();
+    }
+    thPool.stop();
+
+    const auto except = thPool.popExceptions();
+    ASSERT_GE(2 * capacity, except.size());
+    ASSERT_LE(capacity, except.size());
+    ASSERT_EQ(taskCount, except.size() + thPool.droppedExceptionCount());
+}
+
+TEST(simpleThreadPoolTest, exceptionHandlerReplacesStoring)
+{
+    constexpr std::size_t taskCount{10};
+    SimpleThreadPool thPool(2);
+    std::atomic<std::size_t> handled{0};
+    thPool.setExceptionHandler([&](std::exception_ptr exception) {
+        ASSERT_THROW(std::rethrow_exception(exception), TestException);
+        ++handled;
+    });
+
+    for (std::size_t idx = 0; idx < taskCount; ++idx)
+    {
+        thPool.schedule([]() { throw TestException(); });
+    }
+    thPool.start();
+    while (handled < taskCount)
+    {
+        std::this_thread::yield();
+    }
+    thPool.stop();
+
+    ASSERT_TRUE(thPool.popExceptions().empty());
+    ASSERT_EQ(0u, thPool.droppedExceptionCount());
+}
+
+TEST(simpleThreadPoolTest, coalescedTasksTakeOnePlaceOfTheQueue)
+{
+    constexpr std::size_t taskCount{40};
+    // Without the coalescing only 4 of the tasks would fit into the queue of the not started pool
+    SimpleThreadPool thPool(1, 4, SimpleThreadPool::OverflowPolicy::Reject);
+    thPool.setCoalescing(10, std::chrono::hours(1));
+    std::atomic<std::size_t> executed{0};
+
+    {
+        SimpleThreadPool::CoalescingScope scope(thPool);
+        for (std::size_t idx = 0; idx < taskCount; ++idx)
+        {
+            thPool.schedule([&executed]() { ++executed; });
+        }
+    }
+    ASSERT_EQ(0u, executed.load());
+    ASSERT_EQ(0u, thPool.queueFullCount());
+
+    thPool.start();
+    while (executed < taskCount)
+    {
+        std::this_thread::yield();
+    }
+    thPool.stop();
+}
+
+TEST(simpleThreadPoolTest, coalescedTasksWaitForFlush)
+{
+    SimpleThreadPool thPool(2);
+    thPool.setCoalescing(100, std::chrono::hours(1));
+    thPool.start();
+    std::atomic<std::size_t> executed{0};
+
+    SimpleThreadPool::CoalescingScope scope(thPool);
+    for (std::size_t idx = 0; idx < 3; ++idx)
+    {
+        thPool.schedule([&executed]() { ++executed; });
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    ASSERT_EQ(0u, executed.load()) << "the tasks are buffered by the scheduling thread";
+
+    thPool.flush();
+    while (executed < 3)
+    {
+        std::this_thread::yield();
+    }
+    thPool.stop();
+}
+
+TEST(simpleThreadPoolTest, tasksCoalescedByWorkerAreFlushedAtTaskEnd)
+{
+    constexpr std::size_t taskCount{1000};
+    SimpleThreadPool thPool(4);
+    thPool.setCoalescing(64, std::chrono::hours(1));
+    thPool.start();
+    std::atomic<std::size_t> executed{0};
+    std::promise<void> done;
+
+    // The tasks fill whole batches and leave a partial one flushed when the scheduling task ends
+    thPool.schedule([&]() {
+        for (std::size_t idx = 0; idx < taskCount; ++idx)
+        {
+            thPool.schedule([&]() {
+                if (++executed == taskCount)
+                {
+                    done.set_value();
+                }
+            });
+        }
+    });
+
+    ASSERT_EQ(std::future_status::ready, done.get_future().wait_for(std::chrono::seconds(60)));
+    thPool.stop();
+}
+
+TEST(simpleThreadPoolTest, refusedBatchRunsOnFlushingThread)
+{
+    SimpleThreadPool thPool(1, 1, SimpleThreadPool::OverflowPolicy::Reject);
+    thPool.setCoalescing(4, std::chrono::hours(1));
+    std::vector<std::thread::id> ids(4);
+
+    // Fills the queue of the not started pool
+    thPool.schedule([]() {});
+    {
+        SimpleThreadPool::CoalescingScope scope(thPool);
+        for (auto& id : ids)
+        {
+            thPool.schedule([](std::thread::id& id) { id = std::this_thread::get_id(); }, std::ref(id));
+        }
+    }
+
+    for (const auto& id : ids)
+    {
+        ASSERT_EQ(std::this_thread::get_id(), id);
+    }
+    ASSERT_EQ(1u, thPool.queueFullCount());
+}
+
+TEST(simpleThreadPoolTest, coalescedTaskIsFlushedBeforeWait)
+{
+    SimpleThreadPool thPool(2);
+    thPool.setCoalescing(16, std::chrono::hours(1));
+    thPool.start();
+
+    std::atomic<bool> executed{false};
+    {
+        SimpleThreadPool::CoalescingScope scope(thPool);
+        TaskGroup group(thPool);
+        group.spawn([&executed]() { executed = true; });
+        // Held back by this thread, the wait would never end without the flush
+        group.wait();
+    }
+
+    ASSERT_TRUE(executed);
+    thPool.stop();
+}
+
+TEST(simpleThreadPoolTest, workerWaitsForTaskItCoalesced)
+{
+    SimpleThreadPool thPool(2);
+    thPool.setCoalescing(16, std::chrono::hours(1));
+    thPool.start();
+    std::promise<void> release;
+    auto released = release.get_future().share();
+    std::promise<void> blocking;
+
+    // The other worker is busy, so the continuation is held back by the waiting worker
+    thPool.schedule([&blocking, released]() {
+        blocking.set_value();
+        released.wait();
+    });
+    blocking.get_future().wait();
+
+    std::atomic<bool> childExecuted{false};
+    ContinuationTask parent(thPool, [&]() {
+        TaskGroup group(thPool);
+        group.spawn([&childExecuted]() { childExecuted = true; });
+        group.wait();
+    });
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    release.set_value();
+
+    ASSERT_EQ(std::future_status::ready, parent.get_future().wait_for(std::chrono::seconds(60)));
+    ASSERT_TRUE(childExecuted);
+    thPool.stop();
+}
+
+TEST(simpleThreadPoolTest, coalescedTaskOfBusyWorkerWaitsAtMostMaxDelay)
+{
+    SimpleThreadPool thPool(2);
+    thPool.setCoalescing(64, std::chrono::milliseconds(1));
+    thPool.start();
+    std::atomic<bool> stopped{false};
+    std::atomic<bool> busy{false};
+    std::promise<void> busyDone;
+
+    // Keeps the other worker busy by short tasks, it never waits, so it flushes only the late buffers
+    std::function<void()> keepBusy = [&]() {
+        busy = true;
+        const auto end = std::chrono::steady_clock::now() + std::chrono::microseconds(50);
+        while (std::chrono::steady_clock::now() < end)
+        {
+        }
+
+        if (stopped)
+        {
+            busyDone.set_value();
+        }
+        else
+        {
+            thPool.schedule([&keepBusy]() { keepBusy(); });
+        }
+    };
+    thPool.schedule([&keepBusy]() { keepBusy(); });
+    while (!busy)
+    {
+        std::this_thread::yield();
+    }
+
+    std::atomic<bool> childExecuted{false};
+    std::promise<bool> executedMeanwhile;
+    thPool.schedule([&]() {
+        thPool.schedule([&]() { childExecuted = true; });
+        // Without the delay enforced by the other worker the child waits for the end of this task
+        const auto giveUpAt = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+        while (!childExecuted && std::chrono::steady_clock::now() < giveUpAt)
+        {
+            std::this_thread::yield();
+        }
+        executedMeanwhile.set_value(childExecuted);
+    });
+
+    ASSERT_TRUE(executedMeanwhile.get_future().get());
+    stopped = true;
+    busyDone.get_future().wait();
+    thPool.stop();
+}
+namespace
+{
+    void spin(std::chrono::microseconds duration)
+    {
+        const auto end = std::chrono::steady_clock::now() + duration;
+        while (std::chrono::steady_clock::now() < end)
+        {
+        }
+    }
+
+    const SimpleThreadPool::TagProfile* findTag(const std::vector<SimpleThreadPool::TagProfile>& profile, const char* tag)
+    {
+        for (const auto& entry : profile)
+        {
+            if (entry.tag == tag || (entry.tag != nullptr && tag != nullptr && std::string(entry.tag) == tag))
+                return &entry;
+        }
+        return nullptr;
+    }
+}
+
+TEST(simpleThreadPoolTest, profileAggregatesByTag)
+{
+    SimpleThreadPool thPool(2);
+    thPool.setProfiling(true);
+    std::atomic<std::size_t> executed{0};
+    const char* callsite = nullptr;
+
+    for (std::size_t idx = 0; idx < 10; ++idx)
+    {
+        thPool.schedule_with(TaskHints{TaskHints::noAffinity, "busy"}, [&executed]() {
+            spin(std::chrono::milliseconds(1));
+            ++executed;
+        });
+    }
+    for (std::size_t idx = 0; idx < 20; ++idx)
+    {
+        thPool.schedule([&executed]() { ++executed; });
+    }
+    for (std::size_t idx = 0; idx < 5; ++idx)
+    {
+        const TaskHints hints{TaskHints::noAffinity, TASK_CALLSITE};
+        callsite = hints.tag;
+        thPool.schedule_with(hints, [&executed]() { ++executed; });
+    }
+    thPool.start();
+    while (executed < 35)
+    {
+        std::this_thread::yield();
+    }
+    thPool.stop();
+
+    const auto profile = thPool.profile();
+    ASSERT_EQ(3u, profile.size());
+
+    const auto* busy = findTag(profile, "busy");
+    ASSERT_NE(nullptr, busy);
+    ASSERT_EQ(10u, busy->count);
+    ASSERT_LE(std::chrono::milliseconds(10), busy->totalRunTime);
+    ASSERT_LE(std::chrono::milliseconds(1), busy->maxRunTime);
+    ASSERT_LT(std::chrono::nanoseconds::zero(), busy->cpuTime);
+    ASSERT_LT(SimpleThreadPool::Clock::duration::zero(), busy->totalQueueDelay) << "the tasks were scheduled before the start";
+
+    const auto* untagged = findTag(profile, nullptr);
+    ASSERT_NE(nullptr, untagged);
+    ASSERT_EQ(20u, untagged->count);
+
+    const auto* site = findTag(profile, callsite);
+    ASSERT_NE(nullptr, site);
+    ASSERT_EQ(5u, site->count);
+    ASSERT_NE(std::string::npos, std::string(site->tag).find("test_simplethreadpool.cpp:"));
+
+    const auto top = thPool.profile(1);
+    ASSERT_EQ(1u, top.size());
+    ASSERT_STREQ("busy", top.front().tag);
+
+    thPool.resetProfile();
+    ASSERT_TRUE(thPool.profile().empty());
+}
+
+TEST(simpleThreadPoolTest, profileMergesTagsWithSameText)
+{
+    static const char first[] = "same";
+    static const char second[] = "same";
+    SimpleThreadPool thPool(2);
+    thPool.setProfiling(true);
+    std::atomic<std::size_t> executed{0};
+
+    thPool.schedule_with(TaskHints{TaskHints::noAffinity, first}, [&executed]() { ++executed; });
+    thPool.schedule_with(TaskHints{TaskHints::noAffinity, second}, [&executed]() { ++executed; });
+    thPool.start();
+    while (executed < 2)
+    {
+        std::this_thread::yield();
+    }
+    thPool.stop();
+
+    const auto profile = thPool.profile();
+    ASSERT_EQ(1u, profile.size());
+    ASSERT_EQ(2u, profile.front().count);
+}
+
+TEST(simpleThreadPoolTest, notProfiledByDefault)
+{
+    SimpleThreadPool thPool(1);
+    std::atomic<std::size_t> executed{0};
+
+    thPool.schedule_with(TaskHints{TaskHints::noAffinity, "tag"}, [&executed]() { ++executed; });
+    thPool.start();
+    while (executed < 1)
+    {
+        std::this_thread::yield();
+    }
+    thPool.stop();
+
+    ASSERT_TRUE(thPool.profile().empty());
+}
+
+TEST(simpleThreadPoolTest, tasksWithDeadlineRunEarliestFirst)
+{
+    SimpleThreadPool thPool(1);
+    std::vector<int> order;
+    std::promise<void> done;
+    const auto now = SimpleThreadPool::Clock::now();
+
+    thPool.schedule([&]() {
+        order.push_back(0);
+        done.set_value();
+    });
+    for (int delay : {300, 100, 200})
+    {
+        thPool.schedule_with(TaskHints{TaskHints::noAffinity, nullptr, now + std::chrono::milliseconds(delay)},
+                             [&order, delay]() { order.push_back(delay); });
+    }
+    thPool.start();
+    done.get_future().wait();
+    thPool.stop();
+
+    ASSERT_EQ((std::vector<int>{100, 200, 300, 0}), order);
+}
+
+TEST(simpleThreadPoolTest, tasksWithoutDeadlineAreNotStarved)
+{
+    constexpr std::size_t urgentCount{3 * SimpleThreadPool::UrgentQuota};
+    SimpleThreadPool thPool(1);
+    std::vector<int> order;
+    std::promise<void> done;
+    const auto deadline = SimpleThreadPool::Clock::now() + std::chrono::hours(1);
+
+    const auto record = [&order, &done](int idx) {
+        order.push_back(idx);
+        if (order.size() == urgentCount + 1)
+        {
+            done.set_value();
+        }
+    };
+
+    thPool.schedule([&record]() { record(-1); });
+    for (std::size_t idx = 0; idx < urgentCount; ++idx)
+    {
+        thPool.schedule_with(TaskHints{TaskHints::noAffinity, nullptr, deadline}, [&record, idx]() { record(static_cast<int>(idx)); });
+    }
+    thPool.start();
+    done.get_future().wait();
+    thPool.stop();
+
+    ASSERT_EQ(-1, order[SimpleThreadPool::UrgentQuota]);
+}
+
+TEST(simpleThreadPoolTest, ownDeadlineTasksReleaseBlockedProducer)
+{
+    constexpr int taskCount{10000};
+    SimpleThreadPool thPool(2, 4, SimpleThreadPool::OverflowPolicy::Block);
+    thPool.start();
+    std::atomic<int> executed{0};
+    const auto deadline = SimpleThreadPool::Clock::now() + std::chrono::hours(1);
+
+    // The workers take their own tasks without the pool mutex, the producer blocked by the capacity is still notified
+    for (int idx = 0; idx < taskCount; ++idx)
+    {
+        thPool.schedule_with(TaskHints{TaskHints::noAffinity, nullptr, deadline}, [&executed]() { ++executed; });
+    }
+    while (executed < taskCount)
+    {
+        std::this_thread::yield();
+    }
+    thPool.stop();
+
+    ASSERT_EQ(taskCount, executed.load());
+}
+
+TEST(simpleThreadPoolTest, expiredTasksAreDropped)
+{
+    SimpleThreadPool thPool(1);
+    thPool.setExpiredPolicy(SimpleThreadPool::ExpiredPolicy::Drop);
+    std::atomic<bool> expiredExecuted{false};
+    std::promise<void> done;
+    const auto now = SimpleThreadPool::Clock::now();
+
+    thPool.schedule_with(TaskHints{TaskHints::noAffinity, nullptr, now - std::chrono::milliseconds(1)}, [&]() { expiredExecuted = true; });
+    thPool.schedule_with(TaskHints{TaskHints::noAffinity, nullptr, now + std::chrono::hours(1)}, [&]() { done.set_value(); });
+    thPool.start();
+    done.get_future().wait();
+    thPool.stop();
+
+    ASSERT_FALSE(expiredExecuted);
+    ASSERT_EQ(1u, thPool.expiredCount());
+}
+
+TEST(simpleThreadPoolTest, urgentTaskOfBusyWorkerIsTaken)
+{
+    SimpleThreadPool thPool(2);
+    thPool.start();
+    std::promise<void> urgentDone;
+    auto urgentFuture = urgentDone.get_future();
+    std::promise<void> release;
+    auto released = release.get_future().share();
+
+    // The urgent task is queued to the busy worker scheduling it, the idle one takes it without waiting for a steal
+    thPool.schedule([&, released]() {
+        thPool.schedule_with(TaskHints{TaskHints::noAffinity, nullptr, SimpleThreadPool::Clock::now() + std::chrono::milliseconds(5)},
+                             [&]() { urgentDone.set_value(); });
+        released.wait();
+    });
+
+    ASSERT_EQ(std::future_status::ready, urgentFuture.wait_for(std::chrono::seconds(60)));
+    release.set_value();
+    thPool.stop();
+}
+
+TEST(simpleThreadPoolTest, fiberWaitDoesNotTakeTheWorker)
+{
+    SimpleThreadPool thPool(1);
+    thPool.setFibers(64 * 1024);
+    thPool.start();
+    std::atomic<bool> childExecuted{false};
+
+    // With the only worker blocked by the wait, the child would never run
+    ContinuationTask parent(thPool, [&]() {
+        ContinuationTask child(thPool, [&]() { childExecuted = true; });
+        child.wait();
+        ASSERT_TRUE(child.is_ready());
+    });
+
+    ASSERT_EQ(std::future_status::ready, parent.get_future().wait_for(std::chrono::seconds(60)));
+    ASSERT_TRUE(childExecuted);
+    thPool.stop();
+}
+
+TEST(simpleThreadPoolTest, manyFibersWaitOnOneWorker)
+{
+    constexpr int waitingCount{50};
+    SimpleThreadPool thPool(1);
+    thPool.setFibers(64 * 1024);
+    thPool.start();
+    TaskCompletionSource gate(thPool);
+    std::atomic<int> passed{0};
+    std::vector<ContinuationTask> waiting;
+
+    for (int idx = 0; idx < waitingCount; ++idx)
+    {
+        waiting.emplace_back(thPool, [&]() {
+            gate.get_task().wait();
+            ++passed;
+        });
+    }
+    ContinuationTask opener(thPool, [&]() { gate.set_done(); });
+
+    for (auto& task : waiting)
+    {
+        ASSERT_EQ(std::future_status::ready, task.get_future().wait_for(std::chrono::seconds(60)));
+    }
+    ASSERT_EQ(waitingCount, passed.load());
+    thPool.stop();
+}
+
+TEST(simpleThreadPoolTest, taskGroupWaitsOnFiber)
+{
+    SimpleThreadPool thPool(2);
+    thPool.setFibers(64 * 1024);
+    thPool.start();
+    std::atomic<int> executed{0};
+
+    // Every task of the outer group waits for an inner group, more groups wait than there are workers
+    TaskGroup outer(thPool);
+    for (int idx = 0; idx < 8; ++idx)
+    {
+        outer.spawn([&]() {
+            TaskGroup inner(thPool);
+            for (int task = 0; task < 4; ++task)
+            {
+                inner.spawn([&]() { ++executed; });
+            }
+            inner.wait();
+        });
+    }
+
+    ASSERT_EQ(std::future_status::ready, outer.join().get_future().wait_for(std::chrono::seconds(60)));
+    ASSERT_EQ(32, executed.load());
+    thPool.stop();
+}
+
+TEST(simpleThreadPoolTest, destroyedTaskGroupWaitsOnFiber)
+{
+    SimpleThreadPool thPool(1);
+    thPool.setFibers(64 * 1024);
+    thPool.start();
+    std::atomic<bool> spawnedExecuted{false};
+
+    // The group is not waited for explicitly, its destructor waits
+    ContinuationTask owner(thPool, [&]() {
+        TaskGroup group(thPool);
+        group.spawn([&]() { spawnedExecuted = true; });
+    });
+
+    ASSERT_EQ(std::future_status::ready, owner.get_future().wait_for(std::chrono::seconds(60)));
+    ASSERT_TRUE(spawnedExecuted);
+    thPool.stop();
+}
+
+TEST(simpleThreadPoolTest, fiberWaitInCatchHandlerKeepsTheException)
+{
+    SimpleThreadPool thPool(2);
+    thPool.setFibers(64 * 1024);
+    thPool.start();
+    std::atomic<bool> childExecuted{false};
+    std::atomic<bool> exceptionKept{false};
+
+    ContinuationTask parent(thPool, [&]() {
+        try
+        {
+            throw std::runtime_error("handled");
+        }
+        catch (const std::runtime_error&)
+        {
+            ContinuationTask child(thPool, [&]() { childExecuted = true; });
+            child.wait();
+            try
+            {
+                throw;
+            }
+            catch (const std::runtime_error& exception)
+            {
+                exceptionKept = std::string("handled") == exception.what();
+            }
+        }
+    });
+
+    ASSERT_EQ(std::future_status::ready, parent.get_future().wait_for(std::chrono::seconds(60)));
+    ASSERT_TRUE(childExecuted);
+    ASSERT_TRUE(exceptionKept);
+    thPool.stop();
+}
+
+TEST(simpleThreadPoolTest, suspendedTaskIsNotTrackedAsRunning)
+{
+    SimpleThreadPool thPool(1);
+    thPool.setFibers(64 * 1024);
+    thPool.setTaskTracking(true);
+    thPool.start();
+    TaskCompletionSource gate(thPool);
+    std::promise<SimpleThreadPool::Clock::time_point> suspending;
+    std::promise<std::vector<SimpleThreadPool::RunningTask>> resumed;
+
+    thPool.schedule_with(TaskHints{TaskHints::noAffinity, "waiting"}, [&]() {
+        suspending.set_value(SimpleThreadPool::Clock::now());
+        gate.get_task().wait();
+        resumed.set_value(thPool.runningTasks());
+    });
+    const auto suspendedAfter = suspending.get_future().get();
+
+    // The worker is free once the fiber is suspended
+    const auto giveUpAt = std::chrono::steady_clock::now() + std::chrono::seconds(60);
+    while (!thPool.runningTasks().empty() && std::chrono::steady_clock::now() < giveUpAt)
+    {
+        std::this_thread::yield();
+    }
+    ASSERT_TRUE(thPool.runningTasks().empty());
+
+    // The task completing the gate does not take over the tracking of the suspended one
+    thPool.schedule_with(TaskHints{TaskHints::noAffinity, "opener"}, [&]() { gate.set_done(); });
+    auto resumedFuture = resumed.get_future();
+    ASSERT_EQ(std::future_status::ready, resumedFuture.wait_for(std::chrono::seconds(60)));
+    const auto running = resumedFuture.get();
+    ASSERT_EQ(1u, running.size());
+    ASSERT_STREQ("waiting", running.front().tag);
+    ASSERT_GE(suspendedAfter, running.front().startedAt);
+    thPool.stop();
 }
\ No newline at end of file
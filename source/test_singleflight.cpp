@@ -0,0 +1,193 @@
+#include <gtest\gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "ManualExecutor.h"
+#include "SimpleThreadPool.h"
+#include "single_flight.h"
+
+TEST(singleFlightTest, concurrentRequestsShareOneComputation)
+{
+    ManualExecutor executor;
+    SingleFlight<std::string, std::string> flight(executor);
+    int computed{0};
+    const auto load = [&computed]() {
+        ++computed;
+        return std::string("value");
+    };
+
+    auto first = flight.get("shard", load);
+    auto second = flight.get("shard", load);
+    auto other = flight.get("other", load);
+    executor.run_until_idle();
+
+    ASSERT_EQ(2, computed);
+    ASSERT_EQ("value", first.get());
+    ASSERT_EQ(&first.get(), &second.get());
+    ASSERT_NE(&first.get(), &other.get());
+    ASSERT_EQ(2u, flight.stats().computations);
+    ASSERT_EQ(1u, flight.stats().joined);
+}
+
+TEST(singleFlightTest, keyIsForgottenOnceComputedWithoutCache)
+{
+    ManualExecutor executor;
+    SingleFlight<int, int> flight(executor);
+    int computed{0};
+
+    flight.get(1, [&computed]() { return ++computed; });
+    executor.run_until_idle();
+    auto again = flight.get(1, [&computed]() { return ++computed; });
+    executor.run_until_idle();
+
+    ASSERT_EQ(2, again.get());
+    ASSERT_EQ(0u, flight.stats().cacheHits);
+}
+
+TEST(singleFlightTest, completedResultIsCached)
+{
+    ManualExecutor executor;
+    SingleFlight<int, int> flight(executor, 10);
+    int computed{0};
+
+    auto first = flight.get(1, [&computed]() { return ++computed; });
+    executor.run_until_idle();
+    auto cached = flight.get(1, [&computed]() { return ++computed; });
+
+    ASSERT_TRUE(cached.is_ready());
+    ASSERT_EQ(&first.get(), &cached.get());
+    ASSERT_EQ(1, computed);
+    ASSERT_EQ(1u, flight.stats().cacheHits);
+
+    flight.invalidate(1);
+    auto recomputed = flight.get(1, [&computed]() { return ++computed; });
+    executor.run_until_idle();
+    ASSERT_EQ(2, recomputed.get());
+}
+
+TEST(singleFlightTest, expiredResultIsComputedAgain)
+{
+    ManualExecutor executor;
+    SingleFlight<int, int> flight(executor, 10, std::chrono::milliseconds(1));
+    int computed{0};
+
+    flight.get(1, [&computed]() { return ++computed; });
+    executor.run_until_idle();
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    auto again = flight.get(1, [&computed]() { return ++computed; });
+    executor.run_until_idle();
+
+    ASSERT_EQ(2, again.get());
+    ASSERT_EQ(0u, flight.stats().cacheHits);
+}
+
+TEST(singleFlightTest, leastRecentlyUsedResultIsEvicted)
+{
+    ManualExecutor executor;
+    // A single shard, so the capacity is not divided
+    SingleFlight<int, int> flight(executor, 2, SingleFlight<int, int>::Clock::duration::max(), 1);
+    std::vector<int> computed;
+    const auto request = [&](int key) {
+        auto task = flight.get(key, [&computed, key]() {
+            computed.push_back(key);
+            return key;
+        });
+        executor.run_until_idle();
+        return task.get();
+    };
+
+    request(1);
+    request(2);
+    request(1);
+    request(3);
+    request(1);
+    request(2);
+
+    ASSERT_EQ((std::vector<int>{1, 2, 3, 2}), computed);
+}
+
+TEST(singleFlightTest, cacheCapacityIsNotExceededBySharding)
+{
+    ManualExecutor executor;
+    // More shards than results, each key likely lands in a shard of its own
+    SingleFlight<int, int> flight(executor, 1);
+    for (int round = 0; round < 2; ++round)
+    {
+        for (int key = 0; key < 16; ++key)
+        {
+            auto task = flight.get(key, [key]() { return key; });
+            executor.run_until_idle();
+            ASSERT_EQ(key, task.get());
+        }
+    }
+
+    // A single result is cached, the keys of the second round are computed again
+    ASSERT_GE(1u, flight.stats().cacheHits);
+    ASSERT_LE(31u, flight.stats().computations);
+}
+
+TEST(singleFlightTest, failureIsNotCached)
+{
+    ManualExecutor executor;
+    SingleFlight<int, int> flight(executor, 10);
+    int attempts{0};
+    const auto load = [&attempts]() -> int {
+        if (++attempts == 1)
+            throw std::runtime_error("failure");
+        return attempts;
+    };
+
+    auto failed = flight.get(1, load);
+    executor.run_until_idle();
+    ASSERT_THROW(failed.get(), std::runtime_error);
+
+    auto retried = flight.get(1, load);
+    executor.run_until_idle();
+    ASSERT_EQ(2, retried.get());
+}
+
+TEST(singleFlightTest, concurrentRequestsOnThreadPool)
+{
+    constexpr int keyCount{16};
+    constexpr int requestCount{1000};
+    SimpleThreadPool thPool(4);
+    thPool.start();
+    SingleFlight<int, int> flight(thPool, keyCount);
+    std::atomic<int> computed{0};
+    std::vector<std::thread> requesters;
+
+    for (int thread = 0; thread < 4; ++thread)
+    {
+        requesters.emplace_back([&]() {
+            for (int idx = 0; idx < requestCount; ++idx)
+            {
+                const int key = idx % keyCount;
+                auto task = flight.get(key, [&computed, key]() {
+                    ++computed;
+                    return key * 2;
+                });
+                // The future of the shared task is not shared, so the requesters poll it
+                while (!task.is_ready())
+                {
+                    std::this_thread::yield();
+                }
+                ASSERT_EQ(key * 2, task.get());
+            }
+        });
+    }
+    for (auto& requester : requesters)
+    {
+        requester.join();
+    }
+    thPool.stop();
+
+    // The capacity holds all keys, so each is computed once
+    ASSERT_EQ(keyCount, computed.load());
+    const auto stats = flight.stats();
+    ASSERT_EQ(4u * requestCount, stats.computations + stats.joined + stats.cacheHits);
+}
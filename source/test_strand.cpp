@@ -0,0 +1,241 @@
+#include <gtest\gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <functional>
+#include <future>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+#include "SimpleThreadPool.h"
+#include "Strand.h"
+#include "continuation_task.h"
+#include "mpsc_queue.h"
+#include "queue_full_exception.h"
+
+namespace
+{
+    class TestException : public std::exception
+    {
+    };
+
+    // Refuses every task, as a full pool with OverflowPolicy::Reject does
+    class RefusingPool final : public IThreadPool
+    {
+    protected:
+        void scheduleInner(MethodType&&) override
+        {
+            throw QueueFullException();
+        }
+    };
+}
+
+TEST(mpscQueueTest, itemsOfEachProducerAreInOrder)
+{
+    constexpr std::size_t producerCount{4};
+    constexpr std::size_t itemCount{10000};
+    MpscQueue<std::pair<std::size_t, std::size_t>> queue;
+
+    std::vector<std::thread> producers;
+    for (std::size_t producer = 0; producer < producerCount; ++producer)
+    {
+        producers.emplace_back([&, producer]() {
+            for (std::size_t idx = 0; idx < itemCount; ++idx)
+            {
+                queue.push(std::make_pair(producer, idx));
+            }
+        });
+    }
+
+    std::vector<std::size_t> expected(producerCount, 0);
+    std::size_t popped{0};
+    while (popped < producerCount * itemCount)
+    {
+        std::pair<std::size_t, std::size_t> item;
+        if (!queue.pop(item))
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        ASSERT_EQ(expected[item.first], item.second);
+        ++expected[item.first];
+        ++popped;
+    }
+
+    for (auto& producer : producers)
+    {
+        producer.join();
+    }
+    ASSERT_TRUE(queue.wasEmpty());
+}
+
+TEST(strandTest, tasksAreExecutedInOrderWithoutOverlap)
+{
+    constexpr std::size_t taskCount{5000};
+    SimpleThreadPool thPool(4);
+    Strand strand(thPool, 16);
+    thPool.start();
+
+    // Not synchronized on purpose, the strand guarantees the tasks do not overlap
+    std::vector<std::size_t> order;
+    std::atomic<int> running{0};
+    std::atomic_bool overlapped{false};
+    std::promise<void> done;
+
+    for (std::size_t idx = 0; idx < taskCount; ++idx)
+    {
+        strand.schedule([&, idx]() {
+            if (running.fetch_add(1) != 0)
+                overlapped = true;
+            order.push_back(idx);
+            running.fetch_sub(1);
+
+            if (idx + 1 == taskCount)
+                done.set_value();
+        });
+    }
+
+    ASSERT_EQ(std::future_status::ready, done.get_future().wait_for(std::chrono::seconds(60)));
+    ASSERT_FALSE(overlapped);
+    ASSERT_EQ(taskCount, order.size());
+    for (std::size_t idx = 0; idx < taskCount; ++idx)
+    {
+        ASSERT_EQ(idx, order[idx]);
+    }
+
+    thPool.stop();
+    ASSERT_TRUE(thPool.popExceptions().empty());
+}
+
+TEST(strandTest, tasksFromMultipleProducersAreSerialized)
+{
+    constexpr std::size_t producerCount{4};
+    constexpr std::size_t taskCount{2000};
+    SimpleThreadPool thPool(4);
+    Strand strand(thPool);
+    thPool.start();
+
+    std::size_t counter{0};
+    std::atomic<std::size_t> executed{0};
+
+    std::vector<std::thread> producers;
+    for (std::size_t producer = 0; producer < producerCount; ++producer)
+    {
+        producers.emplace_back([&]() {
+            for (std::size_t idx = 0; idx < taskCount; ++idx)
+            {
+                strand.schedule([&]() {
+                    ++counter;
+                    executed.fetch_add(1);
+                });
+            }
+        });
+    }
+    for (auto& producer : producers)
+    {
+        producer.join();
+    }
+
+    using Clock = std::chrono::high_resolution_clock;
+    const auto start = Clock::now();
+    while (executed.load() != producerCount * taskCount && (Clock::now() - start) <= std::chrono::seconds(60))
+    {
+        std::this_thread::yield();
+    }
+
+    ASSERT_EQ(producerCount * taskCount, executed.load());
+    ASSERT_EQ(producerCount * taskCount, counter);
+
+    thPool.stop();
+    ASSERT_TRUE(thPool.popExceptions().empty());
+}
+
+TEST(strandTest, exceptionsArePropagatedToUnderlyingPool)
+{
+    SimpleThreadPool thPool(2);
+    Strand strand(thPool);
+    std::atomic_bool lastExecuted{false};
+
+    strand.schedule([]() { throw TestException(); });
+    strand.schedule([&]() { lastExecuted = true; });
+    thPool.start();
+
+    using Clock = std::chrono::high_resolution_clock;
+    const auto start = Clock::now();
+    while (!lastExecuted && (Clock::now() - start) <= std::chrono::seconds(60))
+    {
+        std::this_thread::yield();
+    }
+    ASSERT_TRUE(lastExecuted);
+
+    thPool.stop();
+    const auto exceptions = thPool.popExceptions();
+    ASSERT_EQ(1u, exceptions.size());
+    ASSERT_THROW(std::rethrow_exception(exceptions.front()), TestException);
+}
+
+TEST(strandTest, refusedDrainStoresExceptions)
+{
+    RefusingPool thPool;
+    Strand strand(thPool);
+    bool lastExecuted{false};
+
+    // The tasks run on this thread, the exception of a task is not thrown to the scheduler of another one
+    ASSERT_NO_THROW(strand.schedule([]() { throw TestException(); }));
+    ASSERT_NO_THROW(strand.schedule([&]() { lastExecuted = true; }));
+    ASSERT_TRUE(lastExecuted);
+
+    const auto exceptions = strand.popExceptions();
+    ASSERT_EQ(1u, exceptions.size());
+    ASSERT_THROW(std::rethrow_exception(exceptions.front()), TestException);
+    ASSERT_TRUE(strand.popExceptions().empty());
+}
+
+TEST(strandTest, refusedDrainDoesNotRecurse)
+{
+    constexpr std::size_t taskCount{1000000};
+    RefusingPool thPool;
+    Strand strand(thPool, 1);
+    std::size_t executed{0};
+
+    // Each task schedules the next one, so every batch ends with a pending task and the drain is scheduled again
+    std::function<void()> next = [&]() {
+        if (++executed < taskCount)
+        {
+            strand.schedule([&next]() { next(); });
+        }
+    };
+    strand.schedule([&next]() { next(); });
+
+    ASSERT_EQ(taskCount, executed);
+}
+
+TEST(strandTest, continuationsOnStrand)
+{
+    constexpr std::size_t taskCount{100};
+    SimpleThreadPool thPool(4);
+    Strand strand(thPool);
+    thPool.start();
+
+    std::vector<std::size_t> order;
+    std::vector<ContinuationTask> tasks;
+    ContinuationTask root(strand, [&]() { order.push_back(0); });
+    for (std::size_t idx = 1; idx < taskCount; ++idx)
+    {
+        // All continuations are attached to the same parent, the strand keeps their order
+        tasks.push_back(root.continue_with([&, idx]() { order.push_back(idx); }));
+    }
+
+    for (auto& task : tasks)
+    {
+        ASSERT_EQ(std::future_status::ready, task.get_future().wait_for(std::chrono::seconds(60)));
+    }
+
+    ASSERT_EQ(taskCount, order.size());
+    for (std::size_t idx = 0; idx < taskCount; ++idx)
+    {
+        ASSERT_EQ(idx, order[idx]);
+    }
+}
@@ -0,0 +1,123 @@
+#include <gtest\gtest.h>
+
+#include <atomic>
+#include <chrono>
+#include <stdexcept>
+
+#include "ManualExecutor.h"
+#include "SimpleThreadPool.h"
+#include "canceled_exception.h"
+#include "task_group.h"
+
+TEST(taskGroupTest, allTasksAreJoined)
+{
+    constexpr std::size_t taskCount{1000};
+    SimpleThreadPool thPool(4);
+    thPool.start();
+    std::atomic<std::size_t> executed{0};
+
+    TaskGroup group(thPool);
+    for (std::size_t idx = 0; idx < taskCount; ++idx)
+    {
+        group.spawn([&]() { ++executed; });
+    }
+
+    group.wait();
+    ASSERT_EQ(taskCount, executed.load());
+    ASSERT_TRUE(group.exceptions().empty());
+}
+
+TEST(taskGroupTest, tasksSpawnTasks)
+{
+    constexpr std::size_t taskCount{100};
+    SimpleThreadPool thPool(4);
+    thPool.start();
+    std::atomic<std::size_t> executed{0};
+
+    TaskGroup group(thPool);
+    for (std::size_t idx = 0; idx < taskCount; ++idx)
+    {
+        group.spawn([&]() {
+            group.spawn([&]() { ++executed; });
+            ++executed;
+        });
+    }
+
+    group.wait();
+    ASSERT_EQ(2 * taskCount, executed.load());
+}
+
+TEST(taskGroupTest, emptyGroupIsCompleted)
+{
+    ManualExecutor executor;
+    TaskGroup group(executor);
+
+    ASSERT_EQ(std::future_status::ready, group.join().get_future().wait_for(std::chrono::seconds(0)));
+}
+
+TEST(taskGroupTest, joinIsNotBlocking)
+{
+    ManualExecutor executor;
+    std::atomic_bool continued{false};
+
+    TaskGroup group(executor);
+    group.spawn([]() {});
+    group.spawn([]() {});
+    auto next = group.join().continue_with([&]() { continued = true; });
+
+    ASSERT_FALSE(continued);
+    // Two tasks of the group and the continuation
+    ASSERT_EQ(3u, executor.run_until_idle());
+    ASSERT_TRUE(continued);
+}
+
+TEST(taskGroupTest, exceptionsAreCollected)
+{
+    ManualExecutor executor;
+    std::atomic<std::size_t> executed{0};
+
+    TaskGroup group(executor);
+    group.spawn([]() { throw std::runtime_error("first"); });
+    group.spawn([&]() { ++executed; });
+    group.spawn([]() { throw std::logic_error("second"); });
+    auto task = group.join();
+
+    executor.run_until_idle();
+    ASSERT_EQ(1u, executed.load());
+    ASSERT_EQ(2u, group.exceptions().size());
+    ASSERT_THROW(task.get_future().get(), std::runtime_error);
+}
+
+TEST(taskGroupTest, failureCancelsRemainingTasks)
+{
+    ManualExecutor executor;
+    std::atomic<std::size_t> executed{0};
+    bool tokenCanceled{false};
+
+    TaskGroup group(executor, TaskGroup::FailurePolicy::CancelOnFailure);
+    group.spawn([]() { throw std::runtime_error("failure"); });
+    group.spawn([&]() { ++executed; });
+    group.spawn([&](CancellationToken token) { tokenCanceled = token.is_canceled(); });
+    auto task = group.join();
+
+    executor.run_until_idle();
+    ASSERT_EQ(0u, executed.load());
+    ASSERT_FALSE(tokenCanceled) << "the skipped task is not executed at all";
+    ASSERT_EQ(1u, group.exceptions().size());
+    ASSERT_THROW(task.get_future().get(), std::runtime_error);
+}
+
+TEST(taskGroupTest, canceledGroupSkipsTasks)
+{
+    ManualExecutor executor;
+    std::atomic<std::size_t> executed{0};
+
+    TaskGroup group(executor);
+    group.spawn([&]() { ++executed; });
+    group.cancel();
+    auto task = group.join();
+
+    executor.run_until_idle();
+    ASSERT_EQ(0u, executed.load());
+    ASSERT_THROW(task.get_future().get(), CanceledException);
+}
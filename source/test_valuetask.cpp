@@ -0,0 +1,185 @@
+#include <gtest\gtest.h>
+
+#include <atomic>
+#include <future>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "ManualExecutor.h"
+#include "SimpleThreadPool.h"
+#include "allocation_counter.h"
+#include "value_task.h"
+
+namespace
+{
+    struct CopyCounter
+    {
+        explicit CopyCounter(int value)
+            : value(value)
+        {
+        }
+
+        CopyCounter(const CopyCounter& other)
+            : value(other.value)
+        {
+            ++copies;
+        }
+
+        CopyCounter(CopyCounter&& other) noexcept
+            : value(other.value)
+        {
+        }
+
+        int value;
+        static int copies;
+    };
+
+    int CopyCounter::copies{0};
+}
+
+TEST(valueTaskTest, continuationsReadTheSameResult)
+{
+    constexpr std::size_t readerCount{50};
+    ManualExecutor executor;
+    CopyCounter::copies = 0;
+    std::vector<const CopyCounter*> read;
+
+    ValueTask<CopyCounter> task(executor, []() { return CopyCounter(7); });
+    for (std::size_t idx = 0; idx < readerCount; ++idx)
+    {
+        task.continue_with([&read](const CopyCounter& value) { read.push_back(&value); });
+    }
+    executor.run_until_idle();
+
+    ASSERT_EQ(readerCount, read.size());
+    for (const auto* value : read)
+    {
+        ASSERT_EQ(&task.get(), value);
+    }
+    ASSERT_EQ(7, task.get().value);
+    ASSERT_EQ(0, CopyCounter::copies);
+}
+
+TEST(valueTaskTest, continuationAddedAfterCompletion)
+{
+    ManualExecutor executor;
+    int read{0};
+
+    ValueTask<int> task(executor, []() { return 3; });
+    executor.run_until_idle();
+    ASSERT_TRUE(task.is_ready());
+
+    auto last = task.continue_with([&read](int value) { read = value; });
+    executor.run_until_idle();
+
+    ASSERT_TRUE(last.is_ready());
+    ASSERT_EQ(3, read);
+}
+
+TEST(valueTaskTest, thenChainsResults)
+{
+    ManualExecutor executor;
+
+    auto text = ValueTask<int>(executor, []() { return 21; }).then([](int value) { return value * 2; }).then([](int value) {
+        return std::to_string(value);
+    });
+    executor.run_until_idle();
+
+    ASSERT_EQ("42", text.get());
+}
+
+TEST(valueTaskTest, resultOutlivesTheParentTask)
+{
+    ManualExecutor executor;
+    std::string read;
+
+    ContinuationTask last(executor);
+    {
+        ValueTask<std::string> task(executor, []() { return std::string(100, 'x'); });
+        last = task.continue_with([&read](const std::string& value) { read = value; });
+    }
+    executor.run_until_idle();
+
+    ASSERT_TRUE(last.is_ready());
+    ASSERT_EQ(std::string(100, 'x'), read);
+}
+
+TEST(valueTaskTest, failurePropagatesWithoutReading)
+{
+    ManualExecutor executor;
+    bool read{false};
+
+    ValueTask<int> task(executor, []() -> int { throw std::runtime_error("failure"); });
+    auto reader = task.continue_with([&read](int) { read = true; });
+    auto next = task.then([](int value) { return value + 1; });
+    executor.run_until_idle();
+
+    ASSERT_FALSE(read);
+    ASSERT_THROW(task.get(), std::runtime_error);
+    ASSERT_THROW(next.get(), std::runtime_error);
+    ASSERT_THROW(reader.get_future().get(), std::runtime_error);
+}
+
+TEST(valueTaskTest, resultIsNotAvailableBeforeCompletion)
+{
+    ManualExecutor executor;
+
+    ValueTask<int> task(executor, []() { return 1; });
+    ASSERT_FALSE(task.is_ready());
+    ASSERT_THROW(task.get(), std::future_error);
+
+    executor.run_until_idle();
+    ASSERT_EQ(1, task.get());
+}
+
+TEST(valueTaskTest, readersDoNotAllocateAfterWarmUp)
+{
+    constexpr std::size_t readerCount{50};
+    ManualExecutor executor;
+    std::size_t sum{0};
+
+    const auto runReaders = [&]() {
+        ValueTask<std::vector<std::size_t>> task(executor, []() { return std::vector<std::size_t>(1000, 1); });
+        executor.run_until_idle();
+
+        // Only the readers are measured, the result itself is allocated by the vector
+        AllocationCounter::Scope scope;
+        for (std::size_t idx = 0; idx < readerCount; ++idx)
+        {
+            task.continue_with([&sum](const std::vector<std::size_t>& value) { sum += value.size(); });
+        }
+        executor.run_until_idle();
+        return scope.delta().allocations;
+    };
+
+    // Fills the recycled tasks and the queue of the executor
+    runReaders();
+
+    const auto allocations = runReaders();
+    ASSERT_EQ(2 * readerCount * 1000, sum);
+    ASSERT_EQ(0u, allocations);
+}
+
+TEST(valueTaskTest, readersOnThreadPool)
+{
+    constexpr std::size_t readerCount{50};
+    SimpleThreadPool thPool(4);
+    thPool.start();
+    std::atomic<std::size_t> sum{0};
+    std::vector<ContinuationTask> readers;
+
+    ValueTask<std::vector<int>> task(thPool, []() { return std::vector<int>(100, 2); });
+    for (std::size_t idx = 0; idx < readerCount; ++idx)
+    {
+        readers.push_back(task.continue_with([&sum](const std::vector<int>& value) { sum += value.size() * value.front(); }));
+    }
+    for (auto& reader : readers)
+    {
+        reader.get_future().get();
+    }
+
+    ASSERT_EQ(readerCount * 200, sum.load());
+    ASSERT_EQ(100u, task.get().size());
+    thPool.stop();
+}
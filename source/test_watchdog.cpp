@@ -0,0 +1,131 @@
+#include <gtest\gtest.h>
+
+#include <chrono>
+#include <cstring>
+#include <future>
+#include <thread>
+
+#include "ManualExecutor.h"
+#include "SimpleThreadPool.h"
+#include "continuation_task.h"
+#include "watchdog.h"
+
+TEST(watchdogTest, longTaskIsReported)
+{
+    SimpleThreadPool thPool(2);
+    thPool.start();
+    Watchdog watchdog(std::chrono::milliseconds(20));
+    watchdog.watch(thPool);
+    std::promise<void> release;
+    auto released = release.get_future().share();
+
+    thPool.schedule_with(TaskHints{TaskHints::noAffinity, "slow"}, [released]() { released.wait(); });
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    const auto report = watchdog.check();
+    ASSERT_EQ(1u, report.stalledTasks.size());
+    ASSERT_EQ(&thPool, report.stalledTasks.front().pool);
+    ASSERT_STREQ("slow", report.stalledTasks.front().task.tag);
+    ASSERT_LE(std::chrono::milliseconds(20), report.stalledTasks.front().running);
+    ASSERT_TRUE(report.pendingTasks.empty());
+
+    release.set_value();
+    thPool.stop();
+    ASSERT_TRUE(watchdog.check().empty());
+}
+
+TEST(watchdogTest, shortTaskIsNotReported)
+{
+    SimpleThreadPool thPool(1);
+    thPool.start();
+    Watchdog watchdog(std::chrono::minutes(1));
+    watchdog.watch(thPool);
+    std::promise<void> started;
+    std::promise<void> release;
+    auto released = release.get_future().share();
+
+    thPool.schedule([&started, released]() {
+        started.set_value();
+        released.wait();
+    });
+    started.get_future().wait();
+
+    ASSERT_TRUE(watchdog.check().empty());
+    ASSERT_EQ(1u, thPool.runningTasks().size());
+
+    release.set_value();
+    thPool.stop();
+}
+
+TEST(watchdogTest, pendingContinuationIsReported)
+{
+    ManualExecutor executor;
+    Watchdog watchdog(std::chrono::milliseconds(20));
+
+    ContinuationTask task(executor, []() {});
+    auto last = task.continue_with([]() {});
+    watchdog.watch(last, "chain");
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    // Waiting for its parent the continuation is not pending yet
+    ASSERT_TRUE(watchdog.check().empty());
+
+    const auto beforeRelease = Watchdog::Clock::now();
+    ASSERT_TRUE(executor.run_one());
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    const auto report = watchdog.check();
+    ASSERT_EQ(1u, report.pendingTasks.size());
+    ASSERT_STREQ("chain", report.pendingTasks.front().tag);
+    ASSERT_LE(std::chrono::milliseconds(20), report.pendingTasks.front().pending);
+    ASSERT_GE(Watchdog::Clock::now() - beforeRelease, report.pendingTasks.front().pending);
+
+    ASSERT_EQ(1u, executor.run_until_idle());
+    ASSERT_TRUE(last.is_ready());
+    ASSERT_TRUE(watchdog.check().empty());
+}
+
+TEST(watchdogTest, handlerIsCalledPeriodically)
+{
+    SimpleThreadPool thPool(1);
+    thPool.start();
+    Watchdog watchdog(std::chrono::milliseconds(10));
+    watchdog.watch(thPool);
+    std::promise<void> release;
+    auto released = release.get_future().share();
+
+    thPool.schedule_with(TaskHints{TaskHints::noAffinity, "stuck"}, [released]() { released.wait(); });
+
+    std::promise<void> reported;
+    bool first{true};
+    watchdog.start(std::chrono::milliseconds(5), [&](const Watchdog::Report& report) {
+        if (first && !report.stalledTasks.empty() && std::strcmp("stuck", report.stalledTasks.front().task.tag) == 0)
+        {
+            first = false;
+            reported.set_value();
+        }
+    });
+
+    ASSERT_EQ(std::future_status::ready, reported.get_future().wait_for(std::chrono::seconds(60)));
+    watchdog.stop();
+    release.set_value();
+    thPool.stop();
+}
+
+TEST(watchdogTest, releasedTaskIsPendingFromTheWatch)
+{
+    ManualExecutor executor;
+    Watchdog watchdog(std::chrono::milliseconds(20));
+
+    ContinuationTask task(executor, []() {});
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+    const auto beforeWatch = Watchdog::Clock::now();
+    watchdog.watch(task, "root");
+    std::this_thread::sleep_for(std::chrono::milliseconds(30));
+
+    const auto report = watchdog.check();
+    ASSERT_EQ(1u, report.pendingTasks.size());
+    ASSERT_GE(Watchdog::Clock::now() - beforeWatch, report.pendingTasks.front().pending);
+
+    executor.run_until_idle();
+}
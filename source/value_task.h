@@ -0,0 +1,160 @@
+#pragma once
+
+#include <future>
+#include <optional>
+#include <type_traits>
+#include <utility>
+#include "continuation_task.h"
+
+/// ContinuationTask with a result. The result is stored once in the shared state of the task and all its continuations
+/// and holders read it by const reference, so a big immutable value is shared without copies, locks or allocations
+/// per consumer.
+/// \note A continuation reads the result directly, it is scheduled only after the task succeeded.
+template <typename T>
+class ValueTask final
+{
+    static_assert(!std::is_reference_v<T> && !std::is_void_v<T>, "the result is stored by value, use ContinuationTask for void");
+
+public:
+    /**
+     * Creates a new instance, the result of the @p method is the result of the task.
+     * @param thPool thread pool to be used for task scheduling
+     * @param method task to be executed on the thread pool, it returns T
+     * @param cancellation token for canceling this task
+     * @note The @p thPool instance needs to stay alive as long as this instance and all its continuations are alive.
+     * @note If the @p thPool refuses the task (e.g. with QueueFullException) the exception is stored in the future.
+     */
+    template <typename Function>
+    ValueTask(IThreadPool& thPool, Function&& method, CancellationToken cancellation = ContinuationTask::_dummyToken);
+
+    /**
+     * Creates a new instance executed after the @p parent is finished, the result of the @p method is the result of the task.
+     * @param parent task to be continued, its thread pool and cancellation are inherited
+     * @param method task to be executed on the thread pool, it returns T
+     * @see ContinuationTask::continue_with(TaskMethod&&)
+     */
+    template <typename Function>
+    ValueTask(ContinuationTask& parent, Function&& method);
+
+    /**
+     * Schedules a new task for execution after the task represented by this instance is finished.
+     * @param method task to be executed on the thread pool, it receives the result by const reference
+     * @returns A new continuation instance representing the new task.
+     * @see ContinuationTask::continue_with(TaskMethod&&)
+     */
+    template <typename Function>
+    ContinuationTask continue_with(Function&& method);
+
+    /**
+     * Schedules a new task with a result for execution after the task represented by this instance is finished.
+     * @param method task to be executed on the thread pool, it receives the result by const reference
+     * @returns A new instance representing the new task, its result is returned by the @p method.
+     * @see ContinuationTask::continue_with(TaskMethod&&)
+     */
+    template <typename Function>
+    ValueTask<std::invoke_result_t<std::decay_t<Function>&, const T&>> then(Function&& method);
+
+    /// @returns true if the task is completed, the check is a single acquire load.
+    bool is_ready() const noexcept;
+
+    /**
+     * @returns The result of the completed task, it is valid as long as this instance or its copy is alive.
+     * @throws The exception of the failed task, std::future_error if the task is not completed yet.
+     */
+    const T& get() const;
+
+    /// @returns The underlying task, e.g. for its future or for the continuations not reading the result.
+    const ContinuationTask& task() const noexcept;
+
+private:
+    template <typename>
+    friend class ValueTask;
+
+    class Slot final : public ContinuationTask::ResultSlot
+    {
+    public:
+        std::optional<T> value;
+    };
+
+    ValueTask(Slot& slot, ContinuationTask&& task) noexcept;
+
+    // Owned by the task, so it lives as long as _task
+    Slot* _slot;
+    ContinuationTask _task;
+};
+
+template <typename T>
+template <typename Function>
+ValueTask<T>::ValueTask(IThreadPool& thPool, Function&& method, CancellationToken cancellation /* = _dummyToken*/)
+    : _slot(new Slot())
+    , _task(thPool,
+            [slot = _slot, method = std::forward<Function>(method)]() mutable { slot->value.emplace(method()); },
+            _slot,
+            std::move(cancellation))
+{
+}
+
+template <typename T>
+template <typename Function>
+ValueTask<T>::ValueTask(ContinuationTask& parent, Function&& method)
+    : _slot(new Slot())
+    , _task(parent.continue_reading(
+          nullptr, _slot, [slot = _slot, method = std::forward<Function>(method)]() mutable { slot->value.emplace(method()); }))
+{
+}
+
+template <typename T>
+ValueTask<T>::ValueTask(Slot& slot, ContinuationTask&& task) noexcept
+    : _slot(&slot)
+    , _task(std::move(task))
+{
+}
+
+template <typename T>
+template <typename Function>
+ContinuationTask ValueTask<T>::continue_with(Function&& method)
+{
+    // Only the slot is captured, a small method keeps the continuation within the small buffer of the TaskMethod
+    return _task.continue_reading(
+        _slot, nullptr, [slot = _slot, method = std::forward<Function>(method)]() mutable { method(std::as_const(*slot->value)); });
+}
+
+template <typename T>
+template <typename Function>
+ValueTask<std::invoke_result_t<std::decay_t<Function>&, const T&>> ValueTask<T>::then(Function&& method)
+{
+    using Result = ValueTask<std::invoke_result_t<std::decay_t<Function>&, const T&>>;
+
+    auto* result = new typename Result::Slot();
+    auto task = _task.continue_reading(_slot,
+                                       result,
+                                       [input = _slot, result, method = std::forward<Function>(method)]() mutable {
+                                           result->value.emplace(method(std::as_const(*input->value)));
+                                       });
+    return Result(*result, std::move(task));
+}
+
+template <typename T>
+bool ValueTask<T>::is_ready() const noexcept
+{
+    return _task.is_ready();
+}
+
+template <typename T>
+const T& ValueTask<T>::get() const
+{
+    // The completion is published by the task after the result is written
+    if (!_task.is_ready())
+        throw std::future_error(std::future_errc::no_state);
+
+    if (auto exception = _task.outcome())
+        std::rethrow_exception(std::move(exception));
+
+    return *_slot->value;
+}
+
+template <typename T>
+const ContinuationTask& ValueTask<T>::task() const noexcept
+{
+    return _task;
+}
@@ -0,0 +1,117 @@
+#include "watchdog.h"
+
+#include <utility>
+
+bool Watchdog::Report::empty() const noexcept
+{
+    return stalledTasks.empty() && pendingTasks.empty();
+}
+
+Watchdog::Watchdog(Clock::duration threshold)
+    : _threshold(threshold)
+    , _run{false}
+{
+}
+
+Watchdog::~Watchdog()
+{
+    stop();
+}
+
+void Watchdog::watch(SimpleThreadPool& pool)
+{
+    pool.setTaskTracking(true);
+
+    std::lock_guard<std::mutex> lk(_mtx);
+    _pools.push_back(&pool);
+}
+
+void Watchdog::watch(const ContinuationTask& task, const char* tag)
+{
+    const auto since = task.track_release() ? Clock::time_point() : Clock::now();
+
+    std::lock_guard<std::mutex> lk(_mtx);
+    _tasks.push_back({task, tag, since});
+}
+
+Watchdog::Report Watchdog::check()
+{
+    Report report;
+    const auto now = Clock::now();
+
+    std::lock_guard<std::mutex> lk(_mtx);
+    for (const auto* pool : _pools)
+    {
+        for (const auto& task : pool->runningTasks())
+        {
+            if (now - task.startedAt >= _threshold)
+            {
+                report.stalledTasks.push_back({pool, task, now - task.startedAt});
+            }
+        }
+    }
+
+    for (std::size_t idx = 0; idx < _tasks.size();)
+    {
+        auto& watched = _tasks[idx];
+        if (watched.task.is_ready())
+        {
+            // The order of the watched tasks does not matter
+            watched = std::move(_tasks.back());
+            _tasks.pop_back();
+            continue;
+        }
+
+        if (watched.since == Clock::time_point())
+        {
+            watched.since = watched.task.released_at();
+        }
+
+        if (watched.since != Clock::time_point() && now - watched.since >= _threshold)
+        {
+            report.pendingTasks.push_back({watched.tag, now - watched.since});
+        }
+        ++idx;
+    }
+
+    return report;
+}
+
+void Watchdog::start(Clock::duration period, ReportHandler handler)
+{
+    std::lock_guard<std::mutex> lk(_threadMtx);
+    if (_thread.joinable())
+        return;
+
+    _run = true;
+    _thread = std::thread(&Watchdog::threadMethod, this, period, std::move(handler));
+}
+
+void Watchdog::stop()
+{
+    {
+        std::lock_guard<std::mutex> lk(_threadMtx);
+        _run = false;
+        _wake.notify_all();
+    }
+
+    if (_thread.joinable())
+    {
+        _thread.join();
+    }
+}
+
+void Watchdog::threadMethod(Clock::duration period, ReportHandler handler)
+{
+    std::unique_lock<std::mutex> lk(_threadMtx);
+    while (!_wake.wait_for(lk, period, [&] { return !_run; }))
+    {
+        lk.unlock();
+        const auto report = check();
+        if (!report.empty())
+        {
+            handler(report);
+        }
+        lk.lock();
+    }
+}
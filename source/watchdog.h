@@ -0,0 +1,91 @@
+#pragma once
+
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include "SimpleThreadPool.h"
+#include "continuation_task.h"
+
+/// Reports the tasks running on SimpleThreadPool workers longer than a threshold and the watched continuation tasks
+/// pending longer than the threshold, e.g. to find the workers stuck in long tasks when the throughput collapses.
+/// The report is taken by Watchdog::check() or periodically by the thread started by Watchdog::start().
+/// \note The tasks are named by TaskHints::tag, see ContinuationTask::continue_with(const TaskHints&, TaskMethod&&).
+/// \note The watched pools need to outlive the watchdog.
+class Watchdog final
+{
+public:
+    using Clock = SimpleThreadPool::Clock;
+
+    struct StalledTask
+    {
+        const SimpleThreadPool* pool;
+        SimpleThreadPool::RunningTask task;
+        Clock::duration running;
+    };
+
+    struct PendingTask
+    {
+        /// Tag given to Watchdog::watch(const ContinuationTask&, const char*).
+        const char* tag;
+        Clock::duration pending;
+    };
+
+    struct Report
+    {
+        std::vector<StalledTask> stalledTasks;
+        std::vector<PendingTask> pendingTasks;
+
+        bool empty() const noexcept;
+    };
+
+    using ReportHandler = std::function<void(const Report&)>;
+
+    /// @param threshold tasks running or pending for a shorter time are not reported
+    explicit Watchdog(Clock::duration threshold);
+    /// Stops the thread started by Watchdog::start().
+    ~Watchdog();
+
+    Watchdog(const Watchdog&) = delete;
+    Watchdog& operator=(const Watchdog&) = delete;
+
+    /// Enables the task tracking of the @p pool and watches its workers.
+    void watch(SimpleThreadPool& pool);
+    /// Watches the @p task (e.g. the last continuation of a chain) till it is completed.
+    /// The task is pending from its release to the pool, a continuation waiting for its parent or a not started
+    /// deferred task is not reported. A task released before the call is pending from the call.
+    /// @param tag name of the task in the reports, the string needs to outlive the watchdog
+    void watch(const ContinuationTask& task, const char* tag);
+
+    /// @returns Tasks exceeding the threshold at the moment, the completed continuation tasks are no longer watched.
+    Report check();
+
+    /// Starts a thread calling Watchdog::check() every @p period, the @p handler is called from it with the not empty reports.
+    /// \note Successive calls without call to Watchdog::stop() in between has no effect.
+    /// \note The @p handler must not throw.
+    void start(Clock::duration period, ReportHandler handler);
+    void stop();
+
+private:
+    struct WatchedTask
+    {
+        ContinuationTask task;
+        const char* tag;
+        // Release of the task to its pool, the clock epoch till the task is released
+        Clock::time_point since;
+    };
+
+    void threadMethod(Clock::duration period, ReportHandler handler);
+
+    const Clock::duration _threshold;
+    std::mutex _mtx;
+    std::vector<SimpleThreadPool*> _pools;
+    std::vector<WatchedTask> _tasks;
+
+    std::mutex _threadMtx;
+    std::condition_variable _wake;
+    bool _run;
+    std::thread _thread;
+};